@@ -0,0 +1,70 @@
+#pragma once
+#include <stdint.h>
+
+// pollutants - indexed by AQI_xxx
+#define AQI_PM2_5 0
+#define AQI_PM10 1
+#define AQI_POLLUTANT_COUNT 2
+
+// US-EPA categories
+#define AQI_GOOD 0
+#define AQI_MODERATE 1
+#define AQI_USG 2 // unhealthy for sensitive groups
+#define AQI_UNHEALTHY 3
+#define AQI_VERY_UNHEALTHY 4
+#define AQI_HAZARDOUS 5
+#define AQI_CATEGORY_COUNT 6
+#define AQI_UNKNOWN 0xFF
+
+// hourly averages kept - NowCast looks back 12 hours, the daily mean 24
+#define AQI_NOWCAST_HOURS 12
+#define AQI_HOURS 24
+
+// index for a concentration in ug/m3 against the EPA breakpoints (2024 PM2.5 revision) - 0-500
+uint16_t aqiIndex(uint8_t pollutant, float concentration);
+uint8_t aqiCategory(uint16_t index);
+const char *aqiCategoryName(uint8_t category);
+
+// US-EPA Air Quality Index from the PM readings
+//
+// Keeps a 24 hour ring of hourly sums per pollutant, filled a reading at a time, so the
+// 12 hour NowCast and the 24 hour mean are both worked out from at most 24 numbers. The hour
+// in progress counts as the most recent hour, so the index follows the air now rather than
+// lagging up to an hour behind. Fixed memory, no Arduino dependencies.
+class classAqi
+{
+public:
+    classAqi();
+
+    // adds a reading (ug/m3) taken at timeS (seconds since boot)
+    void add(uint32_t timeS, float pm2_5, float pm10);
+
+    // EPA NowCast concentration - false until two of the last three hours have readings
+    bool getNowCast(uint8_t pollutant, float &concentration);
+
+    // mean of the last 24 hours (however many of them have readings) - false if none do
+    bool getMean(uint8_t pollutant, float &concentration);
+
+    // index from each pollutant's NowCast, and the overall index (the worse of the two)
+    uint16_t getIndex(uint8_t pollutant);
+    uint16_t getIndex();
+    uint8_t getCategory(uint8_t pollutant);
+    uint8_t getCategory();
+
+    // the pollutant setting the overall index
+    uint8_t getDominant();
+
+    // true once there's enough data for an index
+    bool isAvailable();
+
+private:
+    void _advance(uint32_t hour);
+    bool _hourMean(uint8_t pollutant, uint8_t hoursAgo, float &mean);
+
+    // hourly sums ending with the hour in progress at _hour
+    float _sum[AQI_POLLUTANT_COUNT][AQI_HOURS];
+    uint16_t _count[AQI_HOURS];
+    uint8_t _head = 0;
+    uint32_t _hour = 0;
+    bool _started = false;
+};
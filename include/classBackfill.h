@@ -0,0 +1,74 @@
+#pragma once
+#include <Arduino.h> // Programming core language and functions
+#include <FS.h>      // file system abstraction (LittleFS on the device)
+
+#include "classHistory.h" // sensor records
+
+// samples held in RAM (24 bytes each, ~96KB of PSRAM) - over an hour of 1s telemetry
+#define BACKFILL_CAPACITY 4096
+
+// once RAM is full the oldest samples move to flash, a chunk (about a page) at a time
+#define BACKFILL_SPILL_PATH "/backfill"
+#define BACKFILL_SPILL_CHUNK 10
+#define BACKFILL_SPILL_MAX 8192
+
+// a sample waiting to be published
+typedef struct __attribute__((packed))
+{
+    uint64_t timeMs; // monotonic time it was taken
+    sensorRecord_t record;
+} backfillEntry_t;
+
+static_assert(sizeof(backfillEntry_t) == 24, "backfillEntry_t should stay 24 bytes");
+
+// Bounded first-in first-out store of samples taken while they couldn't be published
+//
+// Samples go into a ring in PSRAM. When that fills, and a file system has been given, the
+// oldest are appended to a spill file - everything in the file is older than anything in
+// the ring, so reading the file first and then the ring keeps them in order. With both full
+// the oldest sample in the ring is overwritten (and counted as dropped). The spill file only
+// lives for the current boot (the sample log keeps the long term record). Entries are read
+// with peek() and only removed by pop() once they have been published, so a failed publish
+// loses nothing. Not thread safe - owned by the network loop.
+class classBackfill
+{
+public:
+    classBackfill();
+
+    // allocates the ring (in PSRAM when available) - returns false if there isn't room
+    bool begin(uint32_t capacity = BACKFILL_CAPACITY);
+
+    // lets full rings spill to flash - anything left over from the last boot is dropped
+    void setSpill(fs::FS &fs);
+
+    void push(uint64_t timeMs, const sensorRecord_t &record);
+
+    // copies up to max of the oldest entries without removing them - returns how many
+    uint16_t peek(backfillEntry_t *entries, uint16_t max);
+
+    // removes the oldest count entries
+    void pop(uint16_t count);
+
+    uint32_t count() { return (_spillCount - _spillRead) + _count; }
+    uint32_t getSpilled() { return _spillCount - _spillRead; }
+    uint32_t getDropped() { return _dropped; }
+
+private:
+    backfillEntry_t *_slot(uint32_t index) { return &_buffer[(_oldest + index) % _capacity]; }
+
+    bool _spill();
+    void _dropSpill();
+
+    backfillEntry_t *_buffer = NULL;
+    uint32_t _capacity = 0;
+    uint32_t _oldest = 0;
+    uint32_t _count = 0;
+
+    // spill file entries written and entries already popped from the front of it
+    fs::FS *_fs = NULL;
+    uint32_t _spillCount = 0;
+    uint32_t _spillRead = 0;
+    bool _spillFailed = false;
+
+    uint32_t _dropped = 0;
+};
@@ -0,0 +1,96 @@
+#pragma once
+#include <Arduino.h> // Programming core language and functions
+#include <Wire.h>    // For I2C
+
+#include <bsec.h> // Library for the BME680 sensor
+
+#include "classStateStore.h" // CRC-checked copies of the calibration state
+
+#define STATE_SAVE_PERIOD UINT32_C(360 * 60 * 1000) // 360 minutes - 4 times a day
+
+// NVS namespace holding the state copies
+#define STATE_STORE_NAMESPACE "bsecState"
+
+// the original single copy in EEPROM (a length byte then the blob) - only ever read, to carry calibration over
+#define STATE_LEGACY_OFFSET 0
+#define STATE_LEGACY_SIZE (BSEC_MAX_STATE_BLOB_SIZE + 1)
+
+// calls made later than this after BSEC asked for them are counted as late
+#define BSEC_JITTER_TOLERANCE_MS 100
+
+// BSEC sample rates
+#define BME_RATE_ULP 0
+#define BME_RATE_LP 1
+#define BME_RATE_CONT 2
+#define DEFAULT_BME_RATE BME_RATE_LP
+
+// optional BSEC outputs subscribed on top of the standard five (bit n = output n)
+#define BME_OUTPUT_STATIC_IAQ 0
+#define BME_OUTPUT_RAW_GAS 1
+#define BME_OUTPUT_STAB_STATUS 2
+#define BME_OUTPUT_RUN_IN_STATUS 3
+#define BME_EXTRA_OUTPUT_COUNT 4
+
+class classBme
+{
+public:
+    classBme();
+
+    // starts the sensor, loads the saved calibration state and subscribes to the outputs - returns true if found
+    bool begin(uint8_t address, TwoWire &wire);
+
+    // only enters BSEC when its next measurement is due - returns true when there are new outputs
+    bool loop();
+
+    // time until BSEC next needs servicing, so the caller can yield instead of spinning
+    uint32_t getMsUntilNextCall();
+
+    void setTemperatureOffset(float offset);
+
+    // queue a new subscription - applied from loop() between BSEC calls, so no reboot is needed
+    void setSampleRate(uint8_t rate);
+    void setExtraOutputs(uint8_t outputs);
+    uint8_t getExtraOutputs() { return _subscribedOutputs; }
+    float getExtraOutput(uint8_t output);
+
+    // latest outputs
+    uint8_t getIaqAccuracy() { return _bsec.iaqAccuracy; }
+    float getCo2Equivalent() { return _bsec.co2Equivalent; }
+    float getBreathVocEquivalent() { return _bsec.breathVocEquivalent; }
+    float getTemperature() { return _bsec.temperature; }
+    float getHumidity() { return _bsec.humidity; }
+
+    // how late each call was against the time BSEC asked for
+    uint32_t getLastJitterMs() { return _lastJitterMs; }
+    uint32_t getMaxJitterMs() { return _maxJitterMs; }
+    uint32_t getLateCalls() { return _lateCalls; }
+
+private:
+    void _subscribe();
+
+    void _loadState();
+    void _updateState();
+
+    // 64-bit monotonic time in ms - used for our deadlines and BSEC's own timestamps
+    int64_t _nowMs();
+
+    Bsec _bsec;
+
+    classStateStore _store;
+    uint8_t _state[BSEC_MAX_STATE_BLOB_SIZE] = {0};
+    // when the calibration state is next saved - zero until the first save
+    int64_t _nextStateSaveMs = 0;
+
+    bool _found = false;
+
+    // requested and currently active subscription
+    uint8_t _sampleRate = DEFAULT_BME_RATE;
+    uint8_t _extraOutputs = 0;
+    uint8_t _subscribedOutputs = 0;
+    bool _subscriptionPending = false;
+
+    uint32_t _calls = 0;
+    uint32_t _lastJitterMs = 0;
+    uint32_t _maxJitterMs = 0;
+    uint32_t _lateCalls = 0;
+};
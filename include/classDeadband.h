@@ -0,0 +1,70 @@
+#pragma once
+#include <stdint.h>
+
+// channels tracked - enough for every sensor record channel
+#define DEADBAND_CHANNELS_MAX 8
+
+// longest a payload can be held back for when nothing has moved
+#define DEFAULT_DEADBAND_HEARTBEAT_S 60
+#define DEADBAND_HEARTBEAT_S_MAX 3600
+
+// Decides which channels are worth publishing - only those that have moved beyond their deadband
+// since they were last sent, or that haven't been sent for a heartbeat, and everything once the
+// heartbeat is due for the payload as a whole
+//
+// A channel's deadband is the larger of an absolute step and a percentage of its last sent value.
+// Each channel keeps its own heartbeat, so one that keeps changing (and so keeps the payloads
+// going) can't hold a quiet one back for longer than the heartbeat.
+// Channels with no deadband always go out, so with none set every payload is sent as before.
+// Values are compared in the caller's integer units (e.g. a sensor record's scaled readings).
+class classDeadband
+{
+public:
+    classDeadband();
+
+    // absolute is in the channel's integer units - both zero turns the deadband off
+    void setDeadband(uint8_t channel, int32_t absolute, float percent);
+    void clearDeadbands();
+    bool isEnabled() { return _enabled; }
+
+    void setHeartbeatMs(uint32_t heartbeatMs) { _heartbeatMs = heartbeatMs; }
+
+    // starts deciding on a payload - everything is sent when the heartbeat is due
+    void begin(uint64_t nowMs);
+
+    // true if the channel should be in this payload
+    bool check(uint8_t channel, int32_t value);
+
+    // true if the payload is worth publishing at all - counts it as suppressed if not
+    bool isDue();
+
+    // once the payload has gone out - sent channels become the new reference values
+    void sent(uint64_t nowMs);
+
+    uint32_t getSent() { return _sentCount; }
+    uint32_t getSuppressed() { return _suppressedCount; }
+
+private:
+    typedef struct
+    {
+        int32_t absolute;
+        float percent;
+        int32_t last;    // value last sent
+        int32_t pending; // value in the payload being built
+        uint64_t lastSentMs;
+        bool hasLast;
+        bool include;
+    } channel_t;
+
+    channel_t _channels[DEADBAND_CHANNELS_MAX];
+    bool _enabled = false;
+
+    uint32_t _heartbeatMs = DEFAULT_DEADBAND_HEARTBEAT_S * 1000UL;
+    uint64_t _lastSentMs = 0;
+    uint64_t _payloadMs = 0; // when the payload being built was started
+    bool _heartbeat = true;
+    bool _changed = false;
+
+    uint32_t _sentCount = 0;
+    uint32_t _suppressedCount = 0;
+};
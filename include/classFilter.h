@@ -0,0 +1,52 @@
+#pragma once
+#include <stdint.h>
+
+// filter modes
+#define FILTER_MODE_MEDIAN 0 // output the median of the window
+#define FILTER_MODE_HAMPEL 1 // pass readings through, replacing outliers with the median
+
+// window length in readings - the filter only looks back this far so it adds little lag
+#define FILTER_WINDOW_MAX 15
+#define DEFAULT_FILTER_WINDOW 5
+
+// Hampel outlier threshold in (scaled) median absolute deviations
+#define DEFAULT_FILTER_THRESHOLD 3.0
+// never treat a deviation smaller than this as an outlier, however flat the readings have been
+#define FILTER_MIN_DEVIATION 1.0
+
+// Sliding median / Hampel filter for spiky integer readings
+//
+// Keeps the window twice - in arrival order (to know which reading leaves next) and sorted
+// (for the median). Each update finds the leaving and arriving readings in the sorted copy
+// with a binary search and shifts the entries between them, so nothing is ever re-sorted.
+// No Arduino dependencies.
+class classFilter
+{
+public:
+    classFilter();
+
+    // window is clamped to 1 - FILTER_WINDOW_MAX, and the filter starts empty again
+    void begin(uint8_t mode, uint8_t window, float threshold = DEFAULT_FILTER_THRESHOLD);
+
+    // adds a reading and returns the filtered value
+    uint16_t update(uint16_t value);
+
+    // number of readings replaced as outliers (Hampel mode)
+    uint32_t getRejected() { return _rejected; }
+
+private:
+    float _median();
+    float _medianDeviation(float median);
+    uint8_t _lowerBound(uint16_t value);
+
+    uint8_t _mode = FILTER_MODE_MEDIAN;
+    uint8_t _size = DEFAULT_FILTER_WINDOW;
+    float _threshold = DEFAULT_FILTER_THRESHOLD;
+
+    uint16_t _window[FILTER_WINDOW_MAX];
+    uint16_t _sorted[FILTER_WINDOW_MAX];
+    uint8_t _count = 0;
+    uint8_t _head = 0;
+
+    uint32_t _rejected = 0;
+};
@@ -0,0 +1,95 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// one slot per second - 24 hours of 1 Hz samples (16 bytes each, ~1.4MB of PSRAM)
+#define HISTORY_CAPACITY (24UL * 60 * 60)
+
+// fixed-point scaling of the record fields
+#define RECORD_TEMP_SCALE 100 // 0.01 C
+#define RECORD_HUM_SCALE 100  // 0.01 %
+#define RECORD_BVOC_SCALE 10  // 0.1 ppm
+
+// record validity bits - a slot with neither set is a gap (device busy, sensor missing)
+#define RECORD_VALID_PMS 0x01
+#define RECORD_VALID_BME 0x02
+
+// Readings at one point in time, kept as fixed-point integers so a day of them fits in PSRAM
+//
+// The timestamp is not stored - the history holds exactly one slot per second, so it is
+// implied by the slot's position.
+typedef struct __attribute__((packed))
+{
+    uint16_t pm1_0; // ug/m3
+    uint16_t pm2_5;
+    uint16_t pm10;
+    int16_t temp;   // always celcius
+    uint16_t hum;
+    uint16_t co2e;  // ppm
+    uint16_t bvoc;
+    uint8_t iaqAccuracy;
+    uint8_t valid;  // RECORD_VALID_xxx
+} sensorRecord_t;
+
+static_assert(sizeof(sensorRecord_t) == 16, "sensorRecord_t should stay 16 bytes");
+
+// channels of a record - indexed by RECORD_xxx
+#define RECORD_PM1_0 0
+#define RECORD_PM2_5 1
+#define RECORD_PM10 2
+#define RECORD_TEMP 3
+#define RECORD_HUM 4
+#define RECORD_CO2E 5
+#define RECORD_BVOC 6
+#define RECORD_CHANNEL_COUNT 7
+
+// raw fixed-point value of a channel - false if the record is missing or that sensor hadn't reported
+bool recordGet(const sensorRecord_t *record, uint8_t channel, int32_t &value);
+// stores a raw fixed-point value (validity bits are left to the caller)
+void recordSet(sensorRecord_t &record, uint8_t channel, int32_t value);
+// divisor that turns a channel's raw value into its real units
+float recordScale(uint8_t channel);
+
+static inline float recordTemp(const sensorRecord_t &record) { return (float)record.temp / RECORD_TEMP_SCALE; }
+static inline float recordHum(const sensorRecord_t &record) { return (float)record.hum / RECORD_HUM_SCALE; }
+static inline float recordBvoc(const sensorRecord_t &record) { return (float)record.bvoc / RECORD_BVOC_SCALE; }
+
+// Fixed-capacity ring of per-second sensor records
+//
+// Slots map directly onto seconds, so a record is found by index or by time with a bit of
+// arithmetic rather than a search. Seconds with no append are left as empty (invalid) slots,
+// and once full the oldest second is overwritten. Not thread safe - owned by the network loop.
+class classHistory
+{
+public:
+    classHistory();
+
+    // allocates the ring (in PSRAM when available) - returns false if there isn't room
+    bool begin(uint32_t capacity = HISTORY_CAPACITY);
+
+    // stores the record for the given second (seconds since boot) - anything for a second
+    // already held is ignored
+    void append(uint32_t timeS, const sensorRecord_t &record);
+
+    // number of seconds held, from getOldestTime() to getNewestTime()
+    uint32_t count() { return _count; }
+    uint32_t getCapacity() { return _capacity; }
+    uint32_t getOldestTime() { return _newestTimeS - (_count - 1); }
+    uint32_t getNewestTime() { return _newestTimeS; }
+
+    // record by position (0 = oldest) or by time - NULL when out of range
+    // the returned slot is only valid until the next append()
+    const sensorRecord_t *get(uint32_t index);
+    const sensorRecord_t *getAt(uint32_t timeS);
+
+private:
+    sensorRecord_t *_slot(uint32_t index) { return &_buffer[(_oldest + index) % _capacity]; }
+
+    sensorRecord_t *_buffer = NULL;
+    uint32_t _capacity = 0;
+
+    // slot holding the oldest second, how many seconds are held and the newest time
+    uint32_t _oldest = 0;
+    uint32_t _count = 0;
+    uint32_t _newestTimeS = 0;
+};
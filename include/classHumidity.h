@@ -0,0 +1,40 @@
+#pragma once
+#include <stdint.h>
+
+// kappa-Kohler defaults - zero kappa means no correction
+#define DEFAULT_HUMIDITY_KAPPA 0.0
+#define DEFAULT_HUMIDITY_DENSITY 1.65 // g/cm3
+
+// above this the growth curve heads for infinity (and fog wets the sensor anyway) - clamp to it
+#define HUMIDITY_CORRECTION_RH_MAX 95
+
+// fixed-point precision of the correction factors
+#define HUMIDITY_FACTOR_BITS 14
+
+// correction factor C for a given relative humidity (%) - wet mass over dry mass
+// C = 1 + (kappa / density) / (1 / aw - 1), with the water activity aw taken as RH / 100
+float humidityGrowthFactor(float humidity, float kappa, float density);
+
+// Hygroscopic growth correction for optical PM readings
+//
+// Optical sensors size the droplet, not the dry particle, so they read high in humid air.
+// The growth factor only depends on the humidity once kappa and density are set, so it is
+// worked out once per whole percent of RH into a table of fixed-point 1 / C multipliers and
+// each correction is a lookup and an integer multiply. No Arduino dependencies.
+class classHumidity
+{
+public:
+    classHumidity();
+
+    // rebuilds the table - a kappa of zero turns the correction off
+    void begin(float kappa, float density = DEFAULT_HUMIDITY_DENSITY);
+
+    bool isEnabled() { return _enabled; }
+
+    // dry-equivalent concentration for a reading taken at the given humidity (0.01 %)
+    uint16_t correct(uint16_t concentration, uint16_t humidity);
+
+private:
+    bool _enabled = false;
+    uint16_t _factor[HUMIDITY_CORRECTION_RH_MAX + 1];
+};
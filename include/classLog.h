@@ -0,0 +1,114 @@
+#pragma once
+#include <Arduino.h> // Programming core language and functions
+#include <FS.h>      // file system abstraction (LittleFS on the device)
+
+#include "classHistory.h" // sensor records
+#include "crc32.h" // block checks
+
+// where the segments live - one file per segment, named by sequence number
+#define LOG_DIR "/log"
+
+// blocks are written whole, one flash page at a time
+#define LOG_BLOCK_SIZE 256
+#define LOG_BLOCK_MAGIC 0x4C53 // "SL"
+
+// segment rotation - 256 blocks (64KB, ~21 hours of minute records at 5 a block) a segment, oldest dropped beyond 8
+#define LOG_SEGMENT_BLOCKS 256
+#define LOG_SEGMENT_COUNT 8
+
+// how often a partly filled block is written out - the most a power cut can lose. Each flush
+// costs a whole block, so at one entry a minute this fills blocks 5 entries at a time rather
+// than 12, which still keeps about a week of minute records on flash
+#define LOG_FLUSH_INTERVAL_MS (5UL * 60 * 1000)
+
+typedef struct __attribute__((packed))
+{
+    uint32_t timeS; // seconds since boot
+    sensorRecord_t record;
+} logEntry_t;
+
+typedef struct __attribute__((packed))
+{
+    uint16_t magic;
+    uint8_t count; // entries used
+    uint8_t reserved;
+    uint32_t bootId; // which boot the entry times belong to
+    uint32_t crc;    // CRC-32 of the block with this field zeroed
+} logBlockHeader_t;
+
+#define LOG_BLOCK_ENTRIES ((LOG_BLOCK_SIZE - sizeof(logBlockHeader_t)) / sizeof(logEntry_t))
+
+typedef struct __attribute__((packed))
+{
+    logBlockHeader_t header;
+    logEntry_t entries[LOG_BLOCK_ENTRIES];
+    uint8_t padding[LOG_BLOCK_SIZE - sizeof(logBlockHeader_t) - (LOG_BLOCK_ENTRIES * sizeof(logEntry_t))];
+} logBlock_t;
+
+static_assert(sizeof(logBlock_t) == LOG_BLOCK_SIZE, "logBlock_t must fill a block exactly");
+
+// called for every entry found when replaying the log
+typedef void (*logCallback)(uint32_t bootId, uint32_t timeS, const sensorRecord_t &record);
+
+// Append-only log of sensor records that survives reboots and power cuts
+//
+// Entries are gathered in RAM and written a whole CRC-protected block at a time, so flash is
+// programmed in page sized bursts rather than per sample - call flush() every
+// LOG_FLUSH_INTERVAL_MS to bound what a power cut loses. Blocks go into numbered segment
+// files, and once there are too many segments the oldest is deleted. A block that was only
+// partly written when the power went simply fails its CRC - replay stops at the last good
+// block of that segment, and the next boot starts a fresh segment so nothing is ever appended
+// after a torn block. A segment that ends cleanly is carried on with instead.
+class classLog
+{
+public:
+    classLog();
+
+    // scans the existing segments and carries on from the last one (or starts a new one after a
+    // torn write) - returns false if the file system isn't usable
+    bool begin(fs::FS &fs);
+
+    // buffers an entry, writing the block out once it is full
+    void append(uint32_t timeS, const sensorRecord_t &record);
+
+    // writes out a partly filled block now
+    void flush();
+
+    // calls back with every entry still held, oldest first - returns the number of entries
+    uint32_t replay(logCallback callback);
+
+    uint32_t getBootId() { return _bootId; }
+    uint32_t getSegmentCount() { return _lastSegment - _firstSegment + 1; }
+    uint32_t getBlocksWritten() { return _blocksWritten; }
+    uint32_t getWriteErrors() { return _writeErrors; }
+    // 1 if the last segment ended in a torn block when the log was opened
+    uint32_t getRecoveredBlocks() { return _recoveredBlocks; }
+
+private:
+    // what walking a segment found
+    typedef struct
+    {
+        uint32_t entries;
+        uint32_t blocks;
+        uint32_t lastBootId; // 0 if there were no good blocks
+        bool torn;           // ends with a partly written block
+    } segmentScan_t;
+
+    void _path(char *buffer, uint32_t segment);
+    bool _readBlock(File &file, logBlock_t &block);
+    segmentScan_t _scanSegment(uint32_t segment, logCallback callback);
+    void _rotate();
+
+    fs::FS *_fs = NULL;
+
+    uint32_t _bootId = 0;
+    uint32_t _firstSegment = 0;
+    uint32_t _lastSegment = 0;
+    uint16_t _segmentBlocks = 0;
+
+    logBlock_t _block;
+
+    uint32_t _blocksWritten = 0;
+    uint32_t _writeErrors = 0;
+    uint32_t _recoveredBlocks = 0;
+};
@@ -0,0 +1,202 @@
+#pragma once
+#include <Arduino.h> // Programming core language and functions
+#include <atomic>
+
+#include "classScheduler.h" // 64-bit monotonic clock
+
+// PMS7003 frames are a fixed 32 bytes - 0x42 0x4D, frame length, 13 data words, checksum
+#define PMS_FRAME_SIZE 32
+#define PMS_FRAME_START_1 0x42
+#define PMS_FRAME_START_2 0x4D
+#define PMS_FRAME_LENGTH (PMS_FRAME_SIZE - 4)
+#define PMS_FRAME_WORDS 13
+
+// number of decoded frames buffered between the UART event task and loop() - must be a power of 2
+#define PMS_FRAME_QUEUE_SIZE 8
+
+// bytes in the UART RX FIFO before the receive callback fires (a timeout also fires it for partial frames)
+#define PMS_RX_FIFO_THRESHOLD 32
+
+// host commands - 0x42 0x4D, command, 2 data bytes, 2 checksum bytes
+#define PMS_COMMAND_SIZE 7
+#define PMS_CMD_MODE 0xE1 // data 0 = passive, 1 = active
+#define PMS_CMD_READ 0xE2 // request a frame while in passive mode
+#define PMS_MODE_PASSIVE 0
+#define PMS_MODE_ACTIVE 1
+
+// duty cycle defaults - a zero interval keeps the sensor running continuously in active mode
+#define DEFAULT_PMS_SAMPLE_INTERVAL_S 0
+#define PMS_SAMPLE_INTERVAL_S_MAX 3600
+#define DEFAULT_PMS_WARMUP_S 30
+#define PMS_WARMUP_S_MAX 120
+#define DEFAULT_PMS_SAMPLE_FRAMES 5
+#define PMS_SAMPLE_FRAMES_MAX 30
+
+// how often frames are requested while sampling in passive mode
+#define PMS_PASSIVE_READ_MS 1000
+// extra time allowed for the requested frames to arrive before giving up on a cycle
+#define PMS_SAMPLE_TIMEOUT_MS 5000
+
+// sampling states
+#define PMS_STATE_CONTINUOUS 0
+#define PMS_STATE_SLEEPING 1
+#define PMS_STATE_WARMUP 2
+#define PMS_STATE_SAMPLING 3
+
+// a received frame laid over the raw UART bytes - every word is big-endian on the wire,
+// so read them through pmsWord() rather than copying the frame into a decoded struct
+typedef union __attribute__((packed))
+{
+    uint8_t raw[PMS_FRAME_SIZE];
+    struct __attribute__((packed))
+    {
+        uint16_t start;
+        uint16_t length;
+        // concentration in ug/m3 using the factory CF=1 calibration
+        uint16_t pm1_0Cf1;
+        uint16_t pm2_5Cf1;
+        uint16_t pm10Cf1;
+        // concentration in ug/m3 under atmospheric environment
+        uint16_t pm1_0;
+        uint16_t pm2_5;
+        uint16_t pm10;
+        // number of particles beyond the given diameter in 0.1L of air
+        uint16_t count0_3;
+        uint16_t count0_5;
+        uint16_t count1_0;
+        uint16_t count2_5;
+        uint16_t count5_0;
+        uint16_t count10;
+        uint16_t reserved;
+        uint16_t checksum;
+    };
+    // data words 0-12 start at words[2]
+    uint16_t words[PMS_FRAME_SIZE / 2];
+} pmsFrame_t;
+
+static_assert(sizeof(pmsFrame_t) == PMS_FRAME_SIZE, "pmsFrame_t must overlay a raw frame");
+
+// converts a big-endian frame word to host order
+static inline uint16_t pmsWord(uint16_t word) { return __builtin_bswap16(word); }
+
+// a sample's data words in host order - only these leave classPms, never the frame itself
+//
+// The CF=1 values and particle counts are live values for telemetry and the info screen
+// (the pmsChannels option) - the history and the flash log keep the atmospheric PM only.
+typedef union
+{
+    struct
+    {
+        uint16_t pm1_0Cf1;
+        uint16_t pm2_5Cf1;
+        uint16_t pm10Cf1;
+        uint16_t pm1_0;
+        uint16_t pm2_5;
+        uint16_t pm10;
+        uint16_t count0_3;
+        uint16_t count0_5;
+        uint16_t count1_0;
+        uint16_t count2_5;
+        uint16_t count5_0;
+        uint16_t count10;
+        uint16_t reserved;
+    };
+    uint16_t words[PMS_FRAME_WORDS];
+} pmsSample_t;
+
+static_assert(sizeof(pmsSample_t) == PMS_FRAME_WORDS * 2, "pmsSample_t must match the frame's data words");
+
+// name of a PMS_STATE_xxx
+const char *pmsStateName(uint8_t state);
+
+class classPms
+{
+public:
+    classPms();
+
+    // hooks the parser onto the UART receive event - serial must already be started
+    // setPin is the PMS SET line used to sleep the sensor between duty cycles
+    void begin(HardwareSerial *serial, uint8_t setPin);
+
+    // runs the sampling state machine - returns true when a new sample is ready
+    bool loop();
+
+    // latest sample - the last frame's data words when continuous, or the average of a duty cycle's frames
+    const pmsSample_t *getSample() { return &_sample; }
+    uint64_t getSampleMs() { return _lastSampleMs; }
+    uint32_t getSampleAgeMs() { return monotonicMs() - _lastSampleMs; }
+
+    // wake the sensor every intervalS, let it settle for warmupS then average the given number of frames
+    // an interval of zero runs the sensor continuously
+    void setDutyCycle(uint16_t intervalS, uint8_t warmupS, uint8_t frames);
+    bool isDutyCycled() { return _state != PMS_STATE_CONTINUOUS; }
+
+    uint8_t getState() { return _state; }
+    const char *getStateName() { return pmsStateName(_state); }
+
+    // pushes raw bytes through the frame parser - called from the UART event task (or a replay harness)
+    void feed(const uint8_t *data, size_t length);
+
+    // returns the oldest received frame in place (or NULL when there is nothing waiting)
+    // the frame stays valid until pop() is called
+    const pmsFrame_t *peek();
+    void pop();
+
+    // number of decoded frames waiting to be read
+    uint8_t available();
+
+    // parser counters
+    uint32_t getFrameCount() { return _frameCount; }
+    uint32_t getChecksumErrors() { return _checksumErrors; }
+    uint32_t getSkippedBytes() { return _skippedBytes; }
+    uint32_t getOverflows() { return _overflows; }
+    uint32_t getSampleTimeouts() { return _sampleTimeouts; }
+
+private:
+    void _sendCommand(uint8_t command, uint16_t data);
+    void _wake();
+    void _sleep();
+    void _average();
+
+    void _receive();
+    void _parseByte(uint8_t data);
+    void _resync();
+    void _push();
+
+    HardwareSerial *_serial = NULL;
+    uint8_t _setPin = 0;
+
+    // duty cycle settings
+    uint32_t _intervalMs = DEFAULT_PMS_SAMPLE_INTERVAL_S * 1000;
+    uint32_t _warmupMs = DEFAULT_PMS_WARMUP_S * 1000;
+    uint8_t _sampleFrames = DEFAULT_PMS_SAMPLE_FRAMES;
+
+    uint8_t _state = PMS_STATE_CONTINUOUS;
+    uint64_t _stateMs = 0L;
+    uint64_t _cycleMs = 0L;
+    uint64_t _requestMs = 0L;
+    // a read request is waiting for its reply - only one frame is averaged per request
+    bool _readRequested = false;
+
+    // running totals of the data words while sampling
+    uint32_t _sum[PMS_FRAME_WORDS];
+    uint8_t _sampleCount = 0;
+
+    pmsSample_t _sample;
+    uint64_t _lastSampleMs = 0L;
+    uint32_t _sampleTimeouts = 0;
+
+    // single producer (UART event task) / single consumer (loop) ring of received frames
+    // frames are assembled directly in the free slot at _head, so nothing is copied once valid
+    pmsFrame_t _queue[PMS_FRAME_QUEUE_SIZE];
+    uint8_t *_frame = _queue[0].raw;
+    uint8_t _index = 0;
+
+    std::atomic<uint8_t> _head{0};
+    std::atomic<uint8_t> _tail{0};
+
+    volatile uint32_t _frameCount = 0;
+    volatile uint32_t _checksumErrors = 0;
+    volatile uint32_t _skippedBytes = 0;
+    volatile uint32_t _overflows = 0;
+};
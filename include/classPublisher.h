@@ -0,0 +1,91 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// payloads held for retry - each slot takes one telemetry payload
+#define PUBLISHER_QUEUE_SIZE 4
+#define PUBLISHER_PAYLOAD_MAX 2048
+
+// retry backoff - doubles on each failure up to the max, with +/- 25% jitter
+#define PUBLISHER_BACKOFF_MIN_MS 500
+#define PUBLISHER_BACKOFF_MAX_MS 30000
+#define PUBLISHER_JITTER_PERCENT 25
+
+// states
+#define PUBLISHER_STATE_OK 0
+#define PUBLISHER_STATE_RETRYING 1
+#define PUBLISHER_STATE_OFFLINE 2
+
+// what publish() did with a payload
+#define PUBLISHER_SENT 0
+#define PUBLISHER_QUEUED 1   // held and retried by loop() - the publisher owns it now
+#define PUBLISHER_REJECTED 2 // offline, queue full or too large - the caller keeps it
+
+// hands a payload to the broker - returns false if it didn't go
+typedef bool (*publishCallback)(const char *payload, size_t length, const char *subtopic);
+
+// Publishes through a small queue that backs off when the broker isn't taking payloads
+//
+// A payload that fails is copied into the queue and retried from loop() after an
+// exponentially growing, jittered delay - it is never rebuilt, and nothing is tried again
+// on every pass. Anything published while payloads are waiting joins the back of the
+// queue so the order is kept. Offline (no broker connection) nothing is attempted and new
+// payloads are rejected, leaving the caller to hold on to its data. Subtopics are kept by
+// pointer, so they must be string literals (or NULL).
+//
+// Time and the jitter seed are passed in so the publisher has no Arduino / esp-idf
+// dependencies. Not thread safe - owned by the network loop.
+class classPublisher
+{
+public:
+    classPublisher();
+
+    // allocates the queue (in PSRAM when available) - returns false if there isn't room
+    bool begin(publishCallback callback, uint32_t seed);
+
+    // sends now if nothing is waiting, otherwise queues - returns PUBLISHER_xxx
+    uint8_t publish(const char *payload, size_t length, const char *subtopic, uint64_t now);
+
+    // tracks the connection and retries the queue when its backoff is up
+    void loop(bool online, uint64_t now);
+
+    uint8_t getState() { return _state; }
+    const char *getStateName();
+
+    // true when a new payload would go straight out
+    bool isIdle() { return _state == PUBLISHER_STATE_OK && _count == 0; }
+
+    // payloads waiting in the queue
+    uint8_t getDepth() { return _count; }
+
+    uint32_t getSent() { return _sent; }
+    uint32_t getFailures() { return _failures; }
+    uint32_t getRejected() { return _rejected; }
+
+private:
+    bool _enqueue(const char *payload, size_t length, const char *subtopic);
+    void _failed(uint64_t now);
+    uint32_t _jitter(uint32_t delayMs);
+
+    publishCallback _callback = NULL;
+
+    struct
+    {
+        const char *subtopic;
+        uint16_t length;
+    } _slots[PUBLISHER_QUEUE_SIZE];
+    char *_payloads = NULL; // PUBLISHER_PAYLOAD_MAX bytes a slot
+    uint8_t _head = 0;
+    uint8_t _count = 0;
+
+    uint8_t _state = PUBLISHER_STATE_OK;
+    uint32_t _backoffMs = PUBLISHER_BACKOFF_MIN_MS;
+    uint64_t _retryMs = 0;
+
+    // xorshift32 state for the jitter
+    uint32_t _random = 1;
+
+    uint32_t _sent = 0;
+    uint32_t _failures = 0;
+    uint32_t _rejected = 0;
+};
@@ -0,0 +1,66 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+// Lock-free single producer / single consumer queue for passing messages between tasks
+//
+// Exactly one task may push() and exactly one (other) task may pop(). Each side only
+// writes its own index, and the release/acquire pair on that index publishes the item
+// it guards, so no locks or critical sections are needed. Deliberately free of any
+// Arduino / FreeRTOS includes so it builds (and can be race checked) on a host as well.
+//
+// SIZE must be a power of 2 - one slot is kept free to tell full from empty.
+template <typename T, uint16_t SIZE>
+class classQueue
+{
+    static_assert(SIZE >= 2 && (SIZE & (SIZE - 1)) == 0, "classQueue SIZE must be a power of 2");
+
+public:
+    // producer side - returns false (and counts a drop) if the consumer has fallen behind
+    bool push(const T &item)
+    {
+        uint16_t head = _head.load(std::memory_order_relaxed);
+        uint16_t next = (head + 1) & (SIZE - 1);
+
+        if (next == _tail.load(std::memory_order_acquire))
+        {
+            _dropped++;
+            return false;
+        }
+
+        _items[head] = item;
+        _head.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side - returns false if there is nothing waiting
+    bool pop(T &item)
+    {
+        uint16_t tail = _tail.load(std::memory_order_relaxed);
+
+        if (tail == _head.load(std::memory_order_acquire))
+            return false;
+
+        item = _items[tail];
+        _tail.store((tail + 1) & (SIZE - 1), std::memory_order_release);
+        return true;
+    }
+
+    // number of items waiting - exact from the consumer side, a snapshot from anywhere else
+    uint16_t available()
+    {
+        return (_head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire)) & (SIZE - 1);
+    }
+
+    // items rejected because the queue was full - only meaningful from the producer side
+    uint32_t getDropped() { return _dropped; }
+
+private:
+    T _items[SIZE];
+
+    std::atomic<uint16_t> _head{0};
+    std::atomic<uint16_t> _tail{0};
+
+    uint32_t _dropped = 0;
+};
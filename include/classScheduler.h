@@ -0,0 +1,51 @@
+#pragma once
+#include <stdint.h>
+
+// maximum number of jobs a single scheduler can hold
+#define SCHEDULER_MAX_JOBS 8
+#define SCHEDULER_NO_JOB -1
+
+// a periodic job - return false to have it run again on the next pass (e.g. a publish that failed)
+typedef bool (*jobCallback)(void);
+
+// milliseconds since boot from the 64-bit esp_timer - unlike millis() this never wraps in the life of the unit
+uint64_t monotonicMs();
+
+// Runs periodic jobs off the 64-bit monotonic clock
+//
+// Each job keeps an absolute 64-bit deadline, so there is no 32-bit wrap to get wrong and
+// the period does not drift with how late loop() gets called. A job runs at most once per
+// loop() - if it fell more than a period behind the missed runs are skipped (and counted)
+// rather than fired back to back. Not thread safe - give each task its own scheduler.
+//
+// Time is always passed in so the scheduler itself has no Arduino / esp-idf dependencies.
+class classScheduler
+{
+public:
+    // run callback every periodMs, starting one period from now - returns the job id or SCHEDULER_NO_JOB when full
+    // a period of zero leaves the job paused until setPeriod() is called
+    int8_t every(uint32_t periodMs, jobCallback callback, uint64_t now = monotonicMs());
+
+    // change a job's period - it next runs one new period from now
+    void setPeriod(int8_t job, uint32_t periodMs, uint64_t now = monotonicMs());
+
+    // runs every job that is due
+    void loop(uint64_t now = monotonicMs());
+
+    // time until the next job is due (UINT32_MAX when nothing is scheduled) so the caller can sleep
+    uint32_t getMsUntilNext(uint64_t now = monotonicMs());
+
+    // number of runs skipped because a job fell more than a period behind
+    uint32_t getSkipped() { return _skipped; }
+
+private:
+    struct
+    {
+        jobCallback callback;
+        uint32_t periodMs;
+        uint64_t dueMs;
+    } _jobs[SCHEDULER_MAX_JOBS];
+
+    uint8_t _jobCount = 0;
+    uint32_t _skipped = 0;
+};
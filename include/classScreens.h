@@ -20,6 +20,10 @@ class classScreens
     void clear();
     void updateInfoScreen(char * xMAC,char * xIP,char * xMQTT);
 
+    // extra label/value rows shown below the device info
+    void setInfoRowCount(uint8_t count);
+    void updateInfoRow(uint8_t row, const char * label, const char * value);
+
     lv_obj_t * bootScreen;
     lv_obj_t * normalScreen;
     lv_obj_t * infoScreen;
@@ -77,6 +81,9 @@ class classScreens
 
     lv_obj_t *_infoTextArea;
 
+    // first table row used by the extra info rows (row before is left blank as a spacer)
+    #define _INFO_EXTRA_ROW 9
+
     // LVGL object for the temperature icon
     lv_obj_t * _tempIcon;
 
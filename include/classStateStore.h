@@ -0,0 +1,58 @@
+#pragma once
+#include <Arduino.h>     // Programming core language and functions
+#include <Preferences.h> // NVS key/value store
+
+#include "crc32.h" // slot checks
+
+// number of copies kept - each its own NVS key, saves alternate between them
+#define STATE_STORE_SLOTS 2
+#define STATE_STORE_MAGIC 0x5353 // "SS"
+
+typedef struct __attribute__((packed))
+{
+    uint16_t magic;
+    uint16_t length;   // blob length, so a change of blob size isn't mistaken for valid state
+    uint32_t sequence; // bumped on every save - the highest valid one is the newest
+    uint32_t crc;      // CRC-32 of the sequence, length and blob
+} stateSlotHeader_t;
+
+// Keeps a fixed-size blob in NVS as CRC-checked, sequence numbered copies
+//
+// Each slot (header and blob) is a single NVS key written with one putBytes(), and NVS
+// already makes that write atomic - a power cut leaves either the old or the new value, and
+// NVS spreads its own writes over the partition. The CRC catches a copy that is damaged
+// anyway, and saves alternate between the slots so the previous copy is still there to fall
+// back on. At boot the valid slot with the highest sequence wins.
+class classStateStore
+{
+public:
+    classStateStore();
+
+    // opens the NVS namespace (up to 15 characters) and finds the newest valid copy
+    bool begin(const char *name, uint16_t length);
+
+    // copies the newest valid blob into data - false if there is none
+    bool load(uint8_t *data);
+
+    // writes the blob into the slot after the newest - false if NVS did not take it
+    bool save(const uint8_t *data);
+
+    bool isValid() { return _valid; }
+    uint32_t getSequence() { return _sequence; }
+    uint8_t getSlot() { return _slot; }
+
+private:
+    void _key(char *buffer, uint8_t slot);
+    bool _readSlot(uint8_t slot);
+
+    Preferences _prefs;
+
+    // header and blob of the slot last read or written
+    uint8_t *_buffer = NULL;
+    uint16_t _length = 0;
+
+    // newest valid slot
+    bool _valid = false;
+    uint8_t _slot = STATE_STORE_SLOTS - 1;
+    uint32_t _sequence = 0;
+};
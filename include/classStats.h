@@ -0,0 +1,79 @@
+#pragma once
+#include <stdint.h>
+
+#include "classHistory.h" // per-second sensor history the windows slide over
+
+// sliding windows - indexed by STATS_WINDOW_xxx
+#define STATS_WINDOW_1M 0
+#define STATS_WINDOW_15M 1
+#define STATS_WINDOW_1H 2
+#define STATS_WINDOW_COUNT 3
+
+// window lengths in seconds (must all fit in the history)
+#define STATS_WINDOW_S {60, 900, 3600}
+
+typedef struct
+{
+    uint16_t count; // valid samples in the window
+    float mean;
+    float min;
+    float max;
+    float stddev;
+} statsResult_t;
+
+// Rolling mean, standard deviation, min and max of each record channel over sliding windows
+//
+// Slides along the history one second at a time - the sample entering each window is added
+// and the one leaving it (looked up in the history) is taken back out, so each update is
+// constant time whatever the window length. Sums are kept as exact integers of the records'
+// fixed-point values, so adding and removing never drifts. Min and max come from monotonic
+// deques of sample times. Not thread safe - owned by the network loop with the history.
+class classStats
+{
+public:
+    classStats();
+
+    // allocates the min/max deques (in PSRAM when available) - returns false if there isn't room
+    bool begin(classHistory *history);
+
+    // catch up with the history - call after each append
+    void update();
+
+    // results for a channel over a window - false if there are no valid samples in it yet
+    bool get(uint8_t channel, uint8_t window, statsResult_t &result);
+
+    uint16_t getWindowS(uint8_t window);
+
+private:
+    typedef struct
+    {
+        uint16_t *times; // low 16 bits of each sample's time - every window is well under 65536s
+        uint16_t size;
+        uint16_t head;
+        uint16_t count;
+    } deque_t;
+
+    typedef struct
+    {
+        int64_t sum;
+        int64_t sumSquares;
+        uint16_t count;
+        deque_t min;
+        deque_t max;
+    } window_t;
+
+    void _reset(uint32_t timeS);
+    void _add(uint32_t timeS);
+    void _remove(uint32_t timeS);
+
+    int32_t _dequeValue(deque_t &deque, uint16_t position, uint8_t channel);
+    void _dequePush(deque_t &deque, uint32_t timeS, int32_t value, uint8_t channel, bool isMax);
+
+    classHistory *_history = NULL;
+    window_t _windows[RECORD_CHANNEL_COUNT][STATS_WINDOW_COUNT];
+
+    // first and last seconds taken in since the stats were (re)started
+    uint32_t _startTimeS = 0;
+    uint32_t _lastTimeS = 0;
+    bool _started = false;
+};
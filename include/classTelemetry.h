@@ -0,0 +1,90 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// room for the payload and the pre-rendered keys - sized for every optional channel and all the stats windows
+#define TELEMETRY_BUFFER_SIZE 2048
+#define TELEMETRY_KEY_BUFFER_SIZE 768
+#define TELEMETRY_KEYS_MAX 64
+// deepest nesting of objects and arrays (the stats are three deep)
+#define TELEMETRY_DEPTH_MAX 4
+
+// no key - for array items
+#define TELEMETRY_NO_KEY -1
+
+// wire formats
+#define TELEMETRY_FORMAT_JSON 0
+#define TELEMETRY_FORMAT_CBOR 1 // RFC 8949
+
+// Writes the telemetry straight into a fixed buffer, with no heap use per payload
+//
+// Keys are rendered once, as "key": fragments, when the template is built - after that a
+// payload is just memcpys of those and integer formatting of the values, fixed-point for
+// anything with decimals. Values are only ever numbers or our own names, so no escaping.
+//
+// The same calls can produce CBOR instead - objects and arrays become indefinite length
+// maps and arrays (so nothing needs counting up front) and fixed-point values are sent as
+// decimal fractions (tag 4, [-decimals, value]), keeping them as integers on the wire.
+class classTelemetry
+{
+public:
+    classTelemetry();
+
+    // template - drop every key, then add them back, returns the key id (TELEMETRY_NO_KEY if full)
+    void clearKeys();
+    int8_t addKey(const char *key);
+    int8_t addKey(const char *prefix, const char *suffix);
+
+    // applies from the next begin()
+    void setFormat(uint8_t format) { _nextFormat = format; }
+
+    // payload - begin(), any mix of values and objects, then end()
+    void begin();
+    void addInt(int8_t key, int64_t value);
+    // value is scaled by 10^decimals, so 215 with 1 decimal is written as 21.5
+    void addFixed(int8_t key, int32_t value, uint8_t decimals);
+    void addString(int8_t key, const char *value);
+    void addNull(int8_t key);
+    void beginObject(int8_t key);
+    void endObject();
+
+    // arrays of values - items are added with TELEMETRY_NO_KEY in place of a key
+    void beginArray(int8_t key);
+    void endArray();
+
+    // the finished payload - NULL if it didn't fit
+    const char *end(size_t &length);
+
+    // true when nothing has been added since begin()
+    bool isEmpty() { return _length == 1; }
+
+private:
+    void _key(int8_t key);
+    void _open(int8_t key, char bracket);
+    void _close(char bracket);
+
+    void _put(const char *data, size_t length);
+    void _putChar(char c);
+    void _putUInt(uint64_t value, uint8_t minDigits);
+
+    // CBOR head - major type and argument, in the shortest form
+    void _putHead(uint8_t major, uint64_t argument);
+    void _putCborInt(int64_t value);
+
+    char _keys[TELEMETRY_KEY_BUFFER_SIZE];
+    uint16_t _keyOffset[TELEMETRY_KEYS_MAX];
+    uint8_t _keyLength[TELEMETRY_KEYS_MAX];
+    uint8_t _keyCount = 0;
+    uint16_t _keysUsed = 0;
+
+    uint8_t _format = TELEMETRY_FORMAT_JSON;
+    uint8_t _nextFormat = TELEMETRY_FORMAT_JSON;
+
+    char _buffer[TELEMETRY_BUFFER_SIZE];
+    size_t _length = 0;
+    bool _overflow = false;
+
+    // whether the object or array at each depth still needs its first member
+    bool _first[TELEMETRY_DEPTH_MAX + 1];
+    uint8_t _depth = 0;
+};
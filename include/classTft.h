@@ -2,12 +2,14 @@
 #include <Arduino.h> // Programming core language and functions
 
 #include "classScreens.h" // custom library with the screen handling
+#include "classAqi.h"     // AQI categories
 
 #include "panel/cfgDisplay.hpp" // low level TFT handling and config
 
 // High level for the screen brightness when triggered - 0-100%
 #define DEFAULT_BACKLIGHT_HIGH 35
 #define DEFAULT_TFT_TIMEOUT_INTERVAL_MS 0 // zero disables timeout
+#define BOOT_SPLASH_MIN_MS 1000 // shortest time the splash screen is shown for
 #define TFT_TIMEOUT_INTERVAL_MS_MAX 3600
 
 // defualt level that triggers yellow warning for PM1.0
@@ -20,6 +22,11 @@
 #define DEFAULT_PM10_YELLOW 20
 #define DEFAULT_PM10_RED 50
 
+// how the PM2.5 and PM10 readings are coloured - fixed warning levels or their US-EPA AQI category
+#define WARNING_MODE_LEVELS 0
+#define WARNING_MODE_AQI 1
+#define DEFAULT_WARNING_MODE WARNING_MODE_AQI
+
 static lv_disp_draw_buf_t draw_buf;
 static lv_color_t buf[TFT_WIDTH * 10];
 
@@ -39,6 +46,9 @@ public:
     // updates the warning levels via mqtt
     void updateWarnLevels(uint16_t xPM1_0_YELLOW, uint16_t xPM1_0_RED, uint16_t xPM2_5_YELLOW, uint16_t xPM2_5_RED, uint16_t xPM10_YELLOW, uint16_t xPM10_RED);
 
+    // latest AQI category (AQI_xxx) of each pollutant - AQI_UNKNOWN falls back to the warning levels
+    void updateAqiCategories(uint8_t xPM2_5, uint8_t xPM10);
+
     void sendBmeData(uint8_t xiaqError, uint16_t Xco2e, float Xbvoc, float Xhum, float Xtemp); // update the library with new data from sensors
     void sendPmsData(uint16_t xPM1_0, uint16_t xPM2_5, uint16_t xPM10);     // update the library with new data from sensors
 
@@ -48,17 +58,23 @@ public:
     void setWifiStatus(bool wifiState, bool mqttState);
     void setInfoData(char * xMAC,char * xIP,char * xMQTT);
 
+    // extra label/value rows on the info screen (e.g. optional sensor channels)
+    void setInfoRowCount(uint8_t count);
+    void setInfoRow(uint8_t row, const char * label, const char * value);
+
     uint8_t maxBrightness = DEFAULT_BACKLIGHT_HIGH;
     uint32_t tftTimeoutIntervalMs = DEFAULT_TFT_TIMEOUT_INTERVAL_MS;
+    uint8_t warningMode = DEFAULT_WARNING_MODE;
 
 private:
 
     void _setBackLight(int val);
+    void _setAqiColor(lv_obj_t * text, uint8_t category, uint8_t * color);
 
     // current value of the backlight
     int _backLight = DEFAULT_BACKLIGHT_HIGH;
 
-    uint32_t _lastTftTimeoutIntervalMs = 0L;
+    uint64_t _lastTftTimeoutIntervalMs = 0L;
 
     #define _BOOT_SCREEN 0
     #define _NORMAL_SCREEN 1
@@ -72,7 +88,7 @@ private:
     uint8_t _lvglSpeed = 10;
 
     // stores the last time lvgl was run in loop()
-    unsigned long _lastLvgl;
+    uint64_t _lastLvgl = 0L;
 
     uint8_t _wifiState = -1;
 
@@ -81,8 +97,11 @@ private:
     bool _tempUnits = 0;
 
     bool _booted = 0;
+    // when the splash screen went up
+    uint64_t _splashMs = 0L;
 
     bool _pmsFound = 0;
+    bool _bmeFound = 0;
 
     uint16_t _co2e = 0;
     float _bvoc = 0.0;
@@ -104,6 +123,9 @@ private:
     uint8_t _PM2_5Color = 0;
     uint8_t _PM10Color = 0;
 
+    uint8_t _PM2_5Category = AQI_UNKNOWN;
+    uint8_t _PM10Category = AQI_UNKNOWN;
+
     uint8_t _green = 0;
     uint8_t _yellow = 1;
     uint8_t _red = 2;
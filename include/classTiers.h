@@ -0,0 +1,84 @@
+#pragma once
+#include <stdint.h>
+
+#include "classHistory.h" // per-second sensor history the tiers are built from
+
+// resolution tiers - indexed by TIER_xxx, finest first (the raw tier is the per-second history itself)
+#define TIER_RAW 0
+#define TIER_MINUTE 1
+#define TIER_HOUR 2
+#define TIER_COUNT 3
+
+// bucket length and how many buckets each downsampled tier keeps
+#define TIER_MINUTE_STEP_S 60
+#define TIER_MINUTE_CAPACITY (24 * 60) // a day
+#define TIER_HOUR_STEP_S 3600
+#define TIER_HOUR_CAPACITY (30 * 24) // 30 days
+
+typedef struct
+{
+    float min;
+    float mean;
+    float max;
+} tierPoint_t;
+
+// Round-robin store of the readings at falling resolutions - per second, per minute and per hour
+//
+// Each downsampled tier accumulates the seconds of its current bucket as they arrive, then
+// keeps the bucket's min, mean and max as three records in fixed-size rings keyed by bucket
+// number, so memory is set at compile time and nothing is ever recomputed from raw data.
+// Not thread safe - owned by the network loop with the history.
+class classTiers
+{
+public:
+    classTiers();
+
+    // allocates the tier rings (in PSRAM when available) - returns false if there isn't room
+    bool begin(classHistory *history);
+
+    // catch up with the history - call after each append
+    void update();
+
+    // the finest tier that reaches back to fromS without returning more than maxPoints for the range
+    // (or failing that the finest that fits in maxPoints)
+    uint8_t selectTier(uint32_t fromS, uint32_t toS, uint16_t maxPoints);
+
+    uint32_t getStepS(uint8_t tier);
+
+    // start of the oldest complete bucket held by a tier - false when it has none yet
+    bool getOldestTime(uint8_t tier, uint32_t &timeS);
+
+    // min/mean/max of a channel over the bucket holding timeS - false for a gap or a bucket not yet complete
+    bool get(uint8_t tier, uint32_t timeS, uint8_t channel, tierPoint_t &point);
+
+    // the mean record of a downsampled tier's bucket holding timeS - NULL for a gap or a bucket not yet complete
+    const sensorRecord_t *getMean(uint8_t tier, uint32_t timeS);
+
+private:
+    typedef struct
+    {
+        uint32_t stepS;
+
+        // completed buckets, keyed by bucket number (timeS / stepS)
+        classHistory min;
+        classHistory mean;
+        classHistory max;
+
+        // the bucket being filled
+        uint32_t bucket;
+        int64_t sum[RECORD_CHANNEL_COUNT];
+        int32_t low[RECORD_CHANNEL_COUNT];
+        int32_t high[RECORD_CHANNEL_COUNT];
+        uint16_t count[RECORD_CHANNEL_COUNT];
+    } tier_t;
+
+    void _add(uint32_t timeS);
+    void _start(tier_t &tier, uint32_t bucket);
+    void _close(tier_t &tier);
+
+    classHistory *_history = NULL;
+    tier_t _tiers[TIER_COUNT - 1];
+
+    uint32_t _lastTimeS = 0;
+    bool _started = false;
+};
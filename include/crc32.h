@@ -0,0 +1,20 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC-32 (IEEE) - small and table free, only used on blocks written a few times a day
+// pass the previous result back in as crc to carry on over data split across buffers
+static inline uint32_t crc32Ieee(const uint8_t *data, size_t length, uint32_t crc = 0)
+{
+    crc = ~crc;
+
+    while (length--)
+    {
+        crc ^= *data++;
+        for (uint8_t i = 0; i < 8; i++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
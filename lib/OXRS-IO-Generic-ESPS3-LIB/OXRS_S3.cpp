@@ -25,6 +25,9 @@ OXRS_MQTT _mqtt(_mqttClient);
 // REST API
 OXRS_API _api(_mqtt);
 
+// WiFi provisioning (non-blocking, so the captive portal is serviced from loop())
+WiFiManager _wm;
+
 // Logging (topic updated once MQTT connects successfully)
 MqttLogger _logger(_mqttClient, "log", MqttLoggerMode::MqttAndSerial);
 
@@ -36,6 +39,9 @@ JsonDocument _fwCommandSchema;
 jsonCallback _onConfig;
 jsonCallback _onCommand;
 
+// Number of successful MQTT connections since boot
+uint32_t _mqttConnects = 0;
+
 /* JSON helpers */
 void _mergeJson(JsonVariant dst, JsonVariantConst src)
 {
@@ -169,6 +175,9 @@ void _mqttConnected()
   JsonDocument json;
   _mqtt.publishAdopt(_api.getAdopt(json.as<JsonVariant>()));
 
+  // Let the firmware know it needs to re-announce itself
+  _mqttConnects++;
+
   // Log the fact we are now connected
   _logger.println("[espS3] mqtt connected");
 }
@@ -283,6 +292,9 @@ void OXRS_S3::begin(jsonCallback config, jsonCallback command)
 
 void OXRS_S3::loop(void)
 {
+  // Keep the WiFi connection (or captive portal) going - never blocks
+  _loopNetwork();
+
   // Check our network connection
   if (_isNetworkConnected())
   {
@@ -304,6 +316,11 @@ void OXRS_S3::loop(void)
     WiFiClient client = _server.available();
     _api.loop(&client);
   }
+  else
+  {
+    // no network, so no broker either
+    mqttConnected = false;
+  }
 }
 
 void OXRS_S3::setConfigSchema(JsonVariant json)
@@ -328,6 +345,11 @@ OXRS_API *OXRS_S3::getAPI()
   return &_api;
 }
 
+uint32_t OXRS_S3::getMqttConnects()
+{
+  return _mqttConnects;
+}
+
 boolean OXRS_S3::publishStatus(JsonVariant json)
 {
   // Exit early if no network connection
@@ -348,6 +370,35 @@ boolean OXRS_S3::publishTelemetry(JsonVariant json)
   return _mqtt.publishTelemetry(json);
 }
 
+boolean OXRS_S3::publishTelemetryRaw(const char *payload, size_t length, const char *subtopic)
+{
+  // Exit early if no network connection
+  if (!_isNetworkConnected() || !_mqtt.connected())
+  {
+    return false;
+  }
+
+  char topic[96];
+  _mqtt.getTelemetryTopic(topic);
+  if (subtopic)
+  {
+    strncat(topic, "/", sizeof(topic) - strlen(topic) - 1);
+    strncat(topic, subtopic, sizeof(topic) - strlen(topic) - 1);
+  }
+  return _mqttClient.publish(topic, (const uint8_t *)payload, length, false);
+}
+
+boolean OXRS_S3::publishRaw(const char *topic, const char *payload, size_t length, boolean retain)
+{
+  // Exit early if no network connection
+  if (!_isNetworkConnected() || !_mqtt.connected())
+  {
+    return false;
+  }
+
+  return _mqttClient.publish(topic, (const uint8_t *)payload, length, retain);
+}
+
 size_t OXRS_S3::write(uint8_t character)
 {
   // Pass to logger - allows firmware to use `GPIO32.println("Log this!")`
@@ -366,16 +417,82 @@ void OXRS_S3::_initialiseNetwork(byte *mac)
   _logger.print(F("[espS3] wifi mac address: "));
   _logger.println(mac_display);
 
-  // Ensure we are in the correct WiFi mode
+  // Ensure we are in the correct WiFi mode, and let the driver reconnect by itself after an outage
   WiFi.mode(WIFI_STA);
+  WiFi.setAutoReconnect(true);
+
+  // Connect using saved creds in the background, or start captive portal if none found
+  // NOTE: never blocks - the portal is serviced from loop() and the ip is logged once connected
+  _wm.setConfigPortalBlocking(false);
+  _wifiStartMs = millis();
+
+  if (_wm.getWiFiIsSaved())
+  {
+    WiFi.begin();
+  }
+  else
+  {
+    _startConfigPortal();
+  }
+}
+
+void OXRS_S3::_startConfigPortal(void)
+{
+  // with nothing saved there's nothing else to do, so keep it open - otherwise give it up
+  // after a while so the saved network gets tried again
+  _wm.setConfigPortalTimeout(_wm.getWiFiIsSaved() ? WIFI_PORTAL_TIMEOUT_S : 0);
+  _wm.startConfigPortal(WIFI_PORTAL_SSID, WIFI_PORTAL_PASSWORD);
+}
+
+void OXRS_S3::_loopNetwork(void)
+{
+  if (_wm.getConfigPortalActive())
+  {
+    // returns true once new creds have been saved and we have connected with them
+    _wm.process();
+
+    // timed out unused - back to the saved network alone
+    if (!_wm.getConfigPortalActive() && !_isNetworkConnected())
+    {
+      _logger.println(F("[espS3] config portal timed out, retrying saved wifi"));
+      WiFi.mode(WIFI_STA);
+      WiFi.begin();
+    }
+  }
+
+  if (_isNetworkConnected())
+  {
+    _everConnected = true;
 
-  // Connect using saved creds, or start captive portal if none found
-  // NOTE: Blocks until connected or the portal is closed
-  WiFiManager wm;
-  bool success = wm.autoConnect("OXRS_WiFi", "superhouse");
+    // the saved creds came good again - no need for the portal now
+    if (_wm.getConfigPortalActive())
+    {
+      _wm.stopConfigPortal();
+    }
 
-  _logger.print(F("[espS3] ip address: "));
-  _logger.println(success ? WiFi.localIP() : IPAddress(0, 0, 0, 0));
+    if (!_wasConnected)
+    {
+      _logger.print(F("[espS3] ip address: "));
+      _logger.println(WiFi.localIP());
+      _wasConnected = true;
+    }
+    return;
+  }
+
+  if (_wasConnected)
+  {
+    _logger.println(F("[espS3] wifi connection lost"));
+    _wasConnected = false;
+  }
+
+  // the saved creds have never worked this boot - offer the portal once, in case the network
+  // has changed. A network that has worked is just down, so leave the driver retrying it
+  if (!_everConnected && !_portalOffered && !_wm.getConfigPortalActive() && (millis() - _wifiStartMs) >= WIFI_PORTAL_DELAY_MS)
+  {
+    _logger.println(F("[espS3] wifi not connecting, starting config portal"));
+    _portalOffered = true;
+    _startConfigPortal();
+  }
 }
 
 void OXRS_S3::_initialiseMqtt(byte *mac)
@@ -11,6 +11,15 @@
 // REST API
 #define       REST_API_PORT             80
 
+// WiFi provisioning - the captive portal is open from boot when nothing is saved, and is offered
+// once if the saved network hasn't connected this long after boot. Outages after that are left
+// to the driver's reconnects. An offered portal closes after going unused for WIFI_PORTAL_TIMEOUT_S
+// (WiFiManager drops the STA connection while it is up), and the saved network is tried again
+#define       WIFI_PORTAL_DELAY_MS      60000
+#define       WIFI_PORTAL_TIMEOUT_S     180
+#define       WIFI_PORTAL_SSID          "OXRS_WiFi"
+#define       WIFI_PORTAL_PASSWORD      "superhouse"
+
 class OXRS_S3 : public Print
 {
   public:
@@ -31,12 +40,20 @@ class OXRS_S3 : public Print
     boolean publishStatus(JsonVariant json);
     boolean publishTelemetry(JsonVariant json);
 
+    // Publish an already serialised payload to the tele/ topic, or a subtopic of it
+    boolean publishTelemetryRaw(const char * payload, size_t length, const char * subtopic = NULL);
+
+    // Publish an already serialised payload to any topic (e.g. retained discovery config)
+    boolean publishRaw(const char * topic, const char * payload, size_t length, boolean retain);
+
     // Implement Print.h wrapper
     virtual size_t write(uint8_t);
     using Print::write;
 
     // for baseFirmWare to know Mqtt state
     bool mqttConnected = false;
+    // bumped on every (re)connect - anything retained (e.g. discovery) should be published again when it changes
+    uint32_t getMqttConnects(void);
     // for baseFirmWare to know network state
     bool networkConnected = false;
 
@@ -51,7 +68,17 @@ class OXRS_S3 : public Print
     void _initialiseMqtt(byte * mac);
     void _initialiseRestApi(void);
 
+    // services the captive portal and offers it if the saved network never connects
+    void _loopNetwork(void);
+    void _startConfigPortal(void);
+
     boolean _isNetworkConnected(void);
+
+    // when we started trying to connect, and whether we ever have (or offered the portal) since
+    uint32_t _wifiStartMs = 0;
+    boolean _wasConnected = false;
+    boolean _everConnected = false;
+    boolean _portalOffered = false;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,238 @@
+#include <classAqi.h>
+#include <math.h>
+#include <string.h>
+
+// concentration breakpoints (ug/m3) for each category - the index runs from the low to the high end of each
+typedef struct
+{
+    float low;
+    float high;
+    uint16_t indexLow;
+    uint16_t indexHigh;
+} aqiBreakpoint_t;
+
+static const aqiBreakpoint_t pm2_5Breakpoints[AQI_CATEGORY_COUNT] = {
+    {0.0, 9.0, 0, 50},
+    {9.1, 35.4, 51, 100},
+    {35.5, 55.4, 101, 150},
+    {55.5, 125.4, 151, 200},
+    {125.5, 225.4, 201, 300},
+    {225.5, 325.4, 301, 500},
+};
+
+static const aqiBreakpoint_t pm10Breakpoints[AQI_CATEGORY_COUNT] = {
+    {0, 54, 0, 50},
+    {55, 154, 51, 100},
+    {155, 254, 101, 150},
+    {255, 354, 151, 200},
+    {355, 424, 201, 300},
+    {425, 604, 301, 500},
+};
+
+static const char *categoryName[AQI_CATEGORY_COUNT] = {"good", "moderate", "unhealthySensitive", "unhealthy", "veryUnhealthy", "hazardous"};
+
+uint16_t aqiIndex(uint8_t pollutant, float concentration)
+{
+    const aqiBreakpoint_t *breakpoints = pollutant == AQI_PM2_5 ? pm2_5Breakpoints : pm10Breakpoints;
+
+    // EPA truncates before the lookup - PM2.5 to 0.1 ug/m3, PM10 to 1 ug/m3
+    concentration = pollutant == AQI_PM2_5 ? floorf(concentration * 10) / 10 : floorf(concentration);
+
+    if (concentration <= 0)
+        return 0;
+
+    for (uint8_t i = 0; i < AQI_CATEGORY_COUNT; i++)
+    {
+        const aqiBreakpoint_t &bp = breakpoints[i];
+
+        // compare in tenths so 9.0 and 9.1 fall either side of a breakpoint whatever the float rounding
+        if (lroundf(concentration * 10) <= lroundf(bp.high * 10))
+        {
+            return lroundf((bp.indexHigh - bp.indexLow) / (bp.high - bp.low) * (concentration - bp.low) + bp.indexLow);
+        }
+    }
+
+    // beyond the index
+    return 500;
+}
+
+uint8_t aqiCategory(uint16_t index)
+{
+    for (uint8_t i = 0; i < AQI_CATEGORY_COUNT; i++)
+    {
+        if (index <= pm2_5Breakpoints[i].indexHigh)
+            return i;
+    }
+    return AQI_HAZARDOUS;
+}
+
+const char *aqiCategoryName(uint8_t category)
+{
+    return category < AQI_CATEGORY_COUNT ? categoryName[category] : "unknown";
+}
+
+classAqi::classAqi() {};
+
+void classAqi::add(uint32_t timeS, float pm2_5, float pm10)
+{
+    uint32_t hour = timeS / 3600;
+
+    if (!_started)
+    {
+        memset(_sum, 0, sizeof(_sum));
+        memset(_count, 0, sizeof(_count));
+        _head = 0;
+        _hour = hour;
+        _started = true;
+    }
+    else if (hour > _hour)
+    {
+        _advance(hour);
+    }
+    else if (hour < _hour)
+    {
+        return;
+    }
+
+    _sum[AQI_PM2_5][_head] += pm2_5;
+    _sum[AQI_PM10][_head] += pm10;
+    _count[_head]++;
+}
+
+// moves on to a new hour, emptying any hours that went by without a reading
+void classAqi::_advance(uint32_t hour)
+{
+    uint32_t hours = hour - _hour;
+    if (hours > AQI_HOURS)
+        hours = AQI_HOURS;
+
+    while (hours-- > 0)
+    {
+        _head = (_head + 1) % AQI_HOURS;
+        _sum[AQI_PM2_5][_head] = 0;
+        _sum[AQI_PM10][_head] = 0;
+        _count[_head] = 0;
+    }
+
+    _hour = hour;
+}
+
+bool classAqi::_hourMean(uint8_t pollutant, uint8_t hoursAgo, float &mean)
+{
+    uint8_t slot = (_head + AQI_HOURS - hoursAgo) % AQI_HOURS;
+    if (_count[slot] == 0)
+        return false;
+
+    mean = _sum[pollutant][slot] / _count[slot];
+    return true;
+}
+
+bool classAqi::getNowCast(uint8_t pollutant, float &concentration)
+{
+    if (!_started || pollutant >= AQI_POLLUTANT_COUNT)
+        return false;
+
+    float hourly[AQI_NOWCAST_HOURS];
+    bool valid[AQI_NOWCAST_HOURS];
+    float low = INFINITY;
+    float high = 0;
+    uint8_t recent = 0;
+
+    for (uint8_t i = 0; i < AQI_NOWCAST_HOURS; i++)
+    {
+        valid[i] = _hourMean(pollutant, i, hourly[i]);
+        if (!valid[i])
+            continue;
+
+        if (i < 3)
+            recent++;
+        if (hourly[i] < low)
+            low = hourly[i];
+        if (hourly[i] > high)
+            high = hourly[i];
+    }
+
+    // EPA needs two of the three most recent hours
+    if (recent < 2)
+        return false;
+
+    // weight factor from how much the air has been changing - never less than 0.5 for PM
+    float weight = high > 0 ? low / high : 1;
+    if (weight < 0.5)
+        weight = 0.5;
+
+    float sum = 0;
+    float weights = 0;
+    float factor = 1;
+    for (uint8_t i = 0; i < AQI_NOWCAST_HOURS; i++)
+    {
+        if (valid[i])
+        {
+            sum += factor * hourly[i];
+            weights += factor;
+        }
+        factor *= weight;
+    }
+
+    concentration = sum / weights;
+    return true;
+}
+
+bool classAqi::getMean(uint8_t pollutant, float &concentration)
+{
+    if (!_started || pollutant >= AQI_POLLUTANT_COUNT)
+        return false;
+
+    float sum = 0;
+    uint32_t count = 0;
+    for (uint8_t i = 0; i < AQI_HOURS; i++)
+    {
+        sum += _sum[pollutant][i];
+        count += _count[i];
+    }
+
+    if (count == 0)
+        return false;
+
+    concentration = sum / count;
+    return true;
+}
+
+uint16_t classAqi::getIndex(uint8_t pollutant)
+{
+    float concentration;
+    if (!getNowCast(pollutant, concentration))
+        return 0;
+
+    return aqiIndex(pollutant, concentration);
+}
+
+uint16_t classAqi::getIndex()
+{
+    return getIndex(getDominant());
+}
+
+uint8_t classAqi::getCategory(uint8_t pollutant)
+{
+    float concentration;
+    if (!getNowCast(pollutant, concentration))
+        return AQI_UNKNOWN;
+
+    return aqiCategory(aqiIndex(pollutant, concentration));
+}
+
+uint8_t classAqi::getCategory()
+{
+    return getCategory(getDominant());
+}
+
+uint8_t classAqi::getDominant()
+{
+    return getIndex(AQI_PM10) > getIndex(AQI_PM2_5) ? AQI_PM10 : AQI_PM2_5;
+}
+
+bool classAqi::isAvailable()
+{
+    float concentration;
+    return getNowCast(AQI_PM2_5, concentration);
+}
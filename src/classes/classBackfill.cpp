@@ -0,0 +1,149 @@
+#include <classBackfill.h>
+
+#if defined(BOARD_HAS_PSRAM)
+#include <esp32-hal-psram.h>
+#endif
+
+classBackfill::classBackfill() {};
+
+bool classBackfill::begin(uint32_t capacity)
+{
+#if defined(BOARD_HAS_PSRAM)
+    _buffer = (backfillEntry_t *)ps_malloc(capacity * sizeof(backfillEntry_t));
+#else
+    _buffer = (backfillEntry_t *)malloc(capacity * sizeof(backfillEntry_t));
+#endif
+
+    _capacity = _buffer ? capacity : 0;
+    _oldest = 0;
+    _count = 0;
+
+    return _buffer != NULL;
+}
+
+void classBackfill::setSpill(fs::FS &fs)
+{
+    _fs = &fs;
+    _dropSpill();
+}
+
+void classBackfill::push(uint64_t timeMs, const sensorRecord_t &record)
+{
+    if (_capacity == 0)
+        return;
+
+    if (_count == _capacity && !_spill())
+    {
+        // nowhere left - lose the oldest sample in RAM
+        _oldest = (_oldest + 1) % _capacity;
+        _count--;
+        _dropped++;
+    }
+
+    backfillEntry_t *entry = _slot(_count++);
+    entry->timeMs = timeMs;
+    entry->record = record;
+}
+
+uint16_t classBackfill::peek(backfillEntry_t *entries, uint16_t max)
+{
+    uint16_t copied = 0;
+
+    // the spill file holds the oldest entries
+    if (_spillRead < _spillCount && max > 0)
+    {
+        uint16_t wanted = min((uint32_t)max, _spillCount - _spillRead);
+        size_t length = wanted * sizeof(backfillEntry_t);
+
+        File file = _fs->open(BACKFILL_SPILL_PATH, "r");
+        if (file && file.seek(_spillRead * sizeof(backfillEntry_t)) && file.read((uint8_t *)entries, length) == length)
+        {
+            copied = wanted;
+        }
+        else
+        {
+            // can't read it back - give up on what was spilled rather than stall the rest
+            Serial.println(F("[BFL] spill file unreadable, dropping it"));
+            _dropped += _spillCount - _spillRead;
+            _dropSpill();
+        }
+        file.close();
+    }
+
+    // then the ring, but only once the file has been emptied - its entries are newer
+    if (_spillRead == _spillCount)
+    {
+        while (copied < max && copied < _count)
+        {
+            entries[copied] = *_slot(copied);
+            copied++;
+        }
+    }
+
+    return copied;
+}
+
+void classBackfill::pop(uint16_t count)
+{
+    uint32_t spilled = min((uint32_t)count, _spillCount - _spillRead);
+    _spillRead += spilled;
+    count -= spilled;
+
+    // once the file has been read through it can go
+    if (spilled > 0 && _spillRead == _spillCount)
+    {
+        _dropSpill();
+    }
+
+    count = min((uint32_t)count, _count);
+    _oldest = (_oldest + count) % _capacity;
+    _count -= count;
+}
+
+// moves the oldest chunk of the ring to the end of the spill file - false if it can't take them
+bool classBackfill::_spill()
+{
+    if (_fs == NULL || _spillFailed || _spillCount + BACKFILL_SPILL_CHUNK > BACKFILL_SPILL_MAX || _count < BACKFILL_SPILL_CHUNK)
+        return false;
+
+    backfillEntry_t chunk[BACKFILL_SPILL_CHUNK];
+    for (uint8_t i = 0; i < BACKFILL_SPILL_CHUNK; i++)
+    {
+        chunk[i] = *_slot(i);
+    }
+
+    File file = _fs->open(BACKFILL_SPILL_PATH, "a");
+    if (!file)
+        return false;
+
+    // a short write leaves a partial chunk on the end - what came before is still read back,
+    // but nothing more is appended until the file has been emptied and removed
+    size_t written = file.write((const uint8_t *)chunk, sizeof(chunk));
+    file.close();
+    if (written != sizeof(chunk))
+    {
+        Serial.println(F("[BFL] spill write failed"));
+        if (_spillRead == _spillCount)
+        {
+            _dropSpill();
+        }
+        _spillFailed = true;
+        return false;
+    }
+
+    _spillCount += BACKFILL_SPILL_CHUNK;
+    _oldest = (_oldest + BACKFILL_SPILL_CHUNK) % _capacity;
+    _count -= BACKFILL_SPILL_CHUNK;
+    return true;
+}
+
+void classBackfill::_dropSpill()
+{
+    if (_fs && _fs->exists(BACKFILL_SPILL_PATH))
+    {
+        _fs->remove(BACKFILL_SPILL_PATH);
+    }
+    _spillCount = 0;
+    _spillRead = 0;
+    _spillFailed = false;
+}
@@ -0,0 +1,252 @@
+#include <classBme.h>
+#include <EEPROM.h>
+#include <classScheduler.h>
+
+const uint8_t bsec_config_iaq[] =
+    {
+#include "../resources/bsec_iaq.txt"
+};
+
+bsec_virtual_sensor_t sensorList[5] = {
+    BSEC_OUTPUT_IAQ,
+    BSEC_OUTPUT_CO2_EQUIVALENT,
+    BSEC_OUTPUT_BREATH_VOC_EQUIVALENT,
+    BSEC_OUTPUT_SENSOR_HEAT_COMPENSATED_TEMPERATURE,
+    BSEC_OUTPUT_SENSOR_HEAT_COMPENSATED_HUMIDITY,
+};
+
+// optional outputs - indexed by BME_OUTPUT_xxx
+bsec_virtual_sensor_t extraSensorList[BME_EXTRA_OUTPUT_COUNT] = {
+    BSEC_OUTPUT_STATIC_IAQ,
+    BSEC_OUTPUT_RAW_GAS,
+    BSEC_OUTPUT_STABILIZATION_STATUS,
+    BSEC_OUTPUT_RUN_IN_STATUS,
+};
+
+// indexed by BME_RATE_xxx
+const float sampleRates[3] = {BSEC_SAMPLE_RATE_ULP, BSEC_SAMPLE_RATE_LP, BSEC_SAMPLE_RATE_CONT};
+
+classBme::classBme() {};
+
+bool classBme::begin(uint8_t address, TwoWire &wire)
+{
+    Serial.println(F("[BME] Starting BSEC"));
+
+    _store.begin(STATE_STORE_NAMESPACE, BSEC_MAX_STATE_BLOB_SIZE);
+
+    _bsec.begin(address, wire);
+
+    if (_bsec.bsecStatus == BSEC_OK && _bsec.bme68xStatus == BME68X_OK)
+    {
+        _found = true;
+        _bsec.setConfig(bsec_config_iaq);
+        _loadState();
+        _subscribe();
+        if (_bsec.bsecStatus != BSEC_OK && _bsec.bme68xStatus != BME68X_OK)
+        {
+            _found = false;
+        }
+    }
+
+    return _found;
+}
+
+bool classBme::loop()
+{
+    if (!_found)
+        return false;
+
+    // safe to change the subscription here as we are never inside BSEC
+    if (_subscriptionPending)
+    {
+        _subscribe();
+    }
+
+    // nothing to do until BSEC asks for the next measurement
+    int64_t now = _nowMs();
+    if (now < _bsec.nextCall)
+        return false;
+
+    // first call has no schedule to be late against
+    if (_calls++ > 0)
+    {
+        _lastJitterMs = now - _bsec.nextCall;
+        _maxJitterMs = max(_maxJitterMs, _lastJitterMs);
+        if (_lastJitterMs > BSEC_JITTER_TOLERANCE_MS)
+        {
+            _lateCalls++;
+        }
+    }
+
+    // hand BSEC the same timestamp so its schedule stays on our time base
+    if (!_bsec.run(now))
+        return false;
+
+    _updateState();
+    return true;
+}
+
+uint32_t classBme::getMsUntilNextCall()
+{
+    if (!_found)
+        return UINT32_MAX;
+
+    int64_t remaining = _bsec.nextCall - _nowMs();
+    return remaining > 0 ? (uint32_t)remaining : 0;
+}
+
+void classBme::setTemperatureOffset(float offset)
+{
+    if (_found)
+    {
+        _bsec.setTemperatureOffset(offset);
+    }
+}
+
+void classBme::setSampleRate(uint8_t rate)
+{
+    if (rate > BME_RATE_CONT || rate == _sampleRate)
+        return;
+
+    _sampleRate = rate;
+    _subscriptionPending = true;
+}
+
+void classBme::setExtraOutputs(uint8_t outputs)
+{
+    outputs &= (1 << BME_EXTRA_OUTPUT_COUNT) - 1;
+    if (outputs == _extraOutputs)
+        return;
+
+    _extraOutputs = outputs;
+    _subscriptionPending = true;
+}
+
+float classBme::getExtraOutput(uint8_t output)
+{
+    switch (output)
+    {
+    case BME_OUTPUT_STATIC_IAQ:
+        return _bsec.staticIaq;
+    case BME_OUTPUT_RAW_GAS:
+        return _bsec.gasResistance;
+    case BME_OUTPUT_STAB_STATUS:
+        return _bsec.stabStatus;
+    case BME_OUTPUT_RUN_IN_STATUS:
+        return _bsec.runInStatus;
+    }
+    return 0;
+}
+
+void classBme::_subscribe()
+{
+    _subscriptionPending = false;
+
+    // BSEC keeps serving anything still subscribed, so outputs we dropped have to be switched off
+    bsec_virtual_sensor_t list[5 + BME_EXTRA_OUTPUT_COUNT];
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < BME_EXTRA_OUTPUT_COUNT; i++)
+    {
+        if ((_subscribedOutputs & (1 << i)) && !(_extraOutputs & (1 << i)))
+        {
+            list[count++] = extraSensorList[i];
+        }
+    }
+    if (count > 0)
+    {
+        _bsec.updateSubscription(list, count, BSEC_SAMPLE_RATE_DISABLED);
+    }
+
+    count = 0;
+    for (uint8_t i = 0; i < 5; i++)
+    {
+        list[count++] = sensorList[i];
+    }
+    for (uint8_t i = 0; i < BME_EXTRA_OUTPUT_COUNT; i++)
+    {
+        if (_extraOutputs & (1 << i))
+        {
+            list[count++] = extraSensorList[i];
+        }
+    }
+    _bsec.updateSubscription(list, count, sampleRates[_sampleRate]);
+    _subscribedOutputs = _extraOutputs;
+
+    // pick up the new schedule straight away - the old deadline may be minutes away at ULP
+    _bsec.nextCall = _nowMs();
+    _calls = 0;
+}
+
+int64_t classBme::_nowMs()
+{
+    return monotonicMs();
+}
+
+void classBme::_loadState()
+{
+    if (_store.load(_state))
+    {
+        Serial.printf("[BME] Reading state from NVS (slot %u, save %u)\n", _store.getSlot(), _store.getSequence());
+        _bsec.setState(_state);
+        return;
+    }
+
+    // state saved by older firmware - left where it is, the first save goes into NVS
+    // (the EEPROM buffer is released either way, it is only ever needed here)
+    bool legacy = EEPROM.begin(STATE_LEGACY_SIZE) && EEPROM.read(STATE_LEGACY_OFFSET) == BSEC_MAX_STATE_BLOB_SIZE;
+    if (legacy)
+    {
+        EEPROM.readBytes(STATE_LEGACY_OFFSET + 1, _state, BSEC_MAX_STATE_BLOB_SIZE);
+    }
+    EEPROM.end();
+
+    if (legacy)
+    {
+        Serial.println(F("[BME] Reading legacy state from EEPROM"));
+        _bsec.setState(_state);
+    }
+    else
+    {
+        Serial.println(F("[BME] No saved state, starting calibration from scratch"));
+    }
+}
+
+void classBme::_updateState()
+{
+    bool update = false;
+    int64_t now = _nowMs();
+    if (_nextStateSaveMs == 0)
+    {
+        /* First state update when IAQ accuracy is >= 3 */
+        if (_bsec.iaqAccuracy >= 3)
+        {
+            update = true;
+        }
+    }
+    else
+    {
+        /* Update every STATE_SAVE_PERIOD minutes - a 64-bit deadline, so this keeps working past 49 days */
+        if (now >= _nextStateSaveMs)
+        {
+            update = true;
+        }
+    }
+
+    if (update)
+    {
+        _nextStateSaveMs = now + STATE_SAVE_PERIOD;
+        _bsec.getState(_state);
+
+        if (_bsec.bsecStatus == BSEC_OK && _bsec.bme68xStatus == BME68X_OK)
+        {
+            if (_store.save(_state))
+            {
+                Serial.printf("[BME] Writing state to NVS (slot %u, save %u)\n", _store.getSlot(), _store.getSequence());
+            }
+            else
+            {
+                Serial.println(F("[BME] Failed to write state to NVS"));
+            }
+        }
+    }
+}
@@ -0,0 +1,105 @@
+#include <classDeadband.h>
+#include <string.h>
+
+classDeadband::classDeadband()
+{
+    memset(_channels, 0, sizeof(_channels));
+};
+
+void classDeadband::setDeadband(uint8_t channel, int32_t absolute, float percent)
+{
+    if (channel >= DEADBAND_CHANNELS_MAX)
+        return;
+
+    _channels[channel].absolute = absolute < 0 ? 0 : absolute;
+    _channels[channel].percent = percent < 0 ? 0 : percent;
+
+    _enabled = false;
+    for (uint8_t i = 0; i < DEADBAND_CHANNELS_MAX; i++)
+    {
+        if (_channels[i].absolute > 0 || _channels[i].percent > 0)
+        {
+            _enabled = true;
+        }
+    }
+}
+
+void classDeadband::clearDeadbands()
+{
+    for (uint8_t i = 0; i < DEADBAND_CHANNELS_MAX; i++)
+    {
+        _channels[i].absolute = 0;
+        _channels[i].percent = 0;
+    }
+    _enabled = false;
+}
+
+void classDeadband::begin(uint64_t nowMs)
+{
+    _heartbeat = _sentCount == 0 || nowMs - _lastSentMs >= _heartbeatMs;
+    _changed = false;
+    _payloadMs = nowMs;
+
+    for (uint8_t i = 0; i < DEADBAND_CHANNELS_MAX; i++)
+    {
+        _channels[i].include = false;
+    }
+}
+
+bool classDeadband::check(uint8_t channel, int32_t value)
+{
+    if (channel >= DEADBAND_CHANNELS_MAX)
+        return true;
+
+    channel_t &c = _channels[channel];
+    c.pending = value;
+
+    // the payload's heartbeat, or this channel's own - it has sat inside its deadband for too long
+    if (_heartbeat || !c.hasLast || _payloadMs - c.lastSentMs >= _heartbeatMs)
+    {
+        c.include = true;
+    }
+    else
+    {
+        int32_t band = c.absolute;
+        int32_t relative = (c.last < 0 ? -c.last : c.last) * c.percent / 100;
+        if (relative > band)
+        {
+            band = relative;
+        }
+
+        // no deadband means every reading counts as a change
+        int32_t moved = value > c.last ? value - c.last : c.last - value;
+        c.include = (c.absolute == 0 && c.percent == 0) || moved > band;
+    }
+
+    _changed |= c.include;
+    return c.include;
+}
+
+bool classDeadband::isDue()
+{
+    if (_heartbeat || _changed)
+        return true;
+
+    _suppressedCount++;
+    return false;
+}
+
+void classDeadband::sent(uint64_t nowMs)
+{
+    for (uint8_t i = 0; i < DEADBAND_CHANNELS_MAX; i++)
+    {
+        // timed from the start of the payload, like the check, so a heartbeat the same length as
+        // the telemetry interval comes round on the interval rather than one after
+        if (_channels[i].include)
+        {
+            _channels[i].last = _channels[i].pending;
+            _channels[i].lastSentMs = _payloadMs;
+            _channels[i].hasLast = true;
+        }
+    }
+
+    _lastSentMs = nowMs;
+    _sentCount++;
+}
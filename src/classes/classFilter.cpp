@@ -0,0 +1,116 @@
+#include <classFilter.h>
+#include <math.h>
+#include <string.h>
+
+// scales the median absolute deviation to a standard deviation for normally distributed readings
+#define MAD_SCALE 1.4826
+
+classFilter::classFilter() {};
+
+void classFilter::begin(uint8_t mode, uint8_t window, float threshold)
+{
+    _mode = mode;
+    _size = window < 1 ? 1 : (window > FILTER_WINDOW_MAX ? FILTER_WINDOW_MAX : window);
+    _threshold = threshold;
+    _count = 0;
+    _head = 0;
+}
+
+uint16_t classFilter::update(uint16_t value)
+{
+    // window full - take the oldest reading back out of the sorted copy
+    if (_count == _size)
+    {
+        uint8_t leaving = _lowerBound(_window[_head]);
+        memmove(&_sorted[leaving], &_sorted[leaving + 1], (_count - leaving - 1) * sizeof(uint16_t));
+        _count--;
+    }
+
+    uint8_t arriving = _lowerBound(value);
+    memmove(&_sorted[arriving + 1], &_sorted[arriving], (_count - arriving) * sizeof(uint16_t));
+    _sorted[arriving] = value;
+    _count++;
+
+    _window[_head] = value;
+    _head = (_head + 1) % _size;
+
+    float median = _median();
+
+    if (_mode == FILTER_MODE_MEDIAN)
+        return lroundf(median);
+
+    // Hampel - too few readings to judge yet
+    if (_count < 3)
+        return value;
+
+    float deviation = MAD_SCALE * _medianDeviation(median);
+    if (deviation < FILTER_MIN_DEVIATION)
+        deviation = FILTER_MIN_DEVIATION;
+
+    if (fabsf(value - median) > _threshold * deviation)
+    {
+        _rejected++;
+        return lroundf(median);
+    }
+
+    return value;
+}
+
+float classFilter::_median()
+{
+    if (_count & 1)
+        return _sorted[_count / 2];
+
+    return (_sorted[_count / 2 - 1] + _sorted[_count / 2]) / 2.0;
+}
+
+// median of |reading - median| - the deviations either side of the median are already in order
+// in the sorted window, so walking outwards from the middle merges them without sorting
+float classFilter::_medianDeviation(float median)
+{
+    int8_t left = _lowerBound(ceilf(median)) - 1;
+    uint8_t right = left + 1;
+
+    float lower = 0;
+    float upper = 0;
+    for (uint8_t i = 0; i <= _count / 2; i++)
+    {
+        float deviation;
+        if (left >= 0 && (right >= _count || median - _sorted[left] <= _sorted[right] - median))
+        {
+            deviation = median - _sorted[left--];
+        }
+        else
+        {
+            deviation = _sorted[right++] - median;
+        }
+
+        if (i == (_count - 1) / 2)
+            lower = deviation;
+        if (i == _count / 2)
+            upper = deviation;
+    }
+
+    return (lower + upper) / 2;
+}
+
+// first sorted entry not less than value
+uint8_t classFilter::_lowerBound(uint16_t value)
+{
+    uint8_t low = 0;
+    uint8_t high = _count;
+
+    while (low < high)
+    {
+        uint8_t mid = (low + high) / 2;
+        if (_sorted[mid] < value)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+    return low;
+}
@@ -0,0 +1,167 @@
+#include <classHistory.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(BOARD_HAS_PSRAM)
+#include <esp32-hal-psram.h>
+#endif
+
+classHistory::classHistory() {};
+
+bool classHistory::begin(uint32_t capacity)
+{
+#if defined(BOARD_HAS_PSRAM)
+    _buffer = (sensorRecord_t *)ps_malloc(capacity * sizeof(sensorRecord_t));
+#else
+    _buffer = (sensorRecord_t *)malloc(capacity * sizeof(sensorRecord_t));
+#endif
+
+    _capacity = _buffer ? capacity : 0;
+    _oldest = 0;
+    _count = 0;
+
+    return _buffer != NULL;
+}
+
+void classHistory::append(uint32_t timeS, const sensorRecord_t &record)
+{
+    if (_capacity == 0)
+        return;
+
+    if (_count == 0)
+    {
+        _oldest = 0;
+        _count = 1;
+        _newestTimeS = timeS;
+        *_slot(0) = record;
+        return;
+    }
+
+    // late or repeated - a second is never rewritten once stored, so anything sliding over it stays consistent
+    if (timeS <= _newestTimeS)
+        return;
+
+    // gone quiet for longer than we hold - start again rather than blank every slot
+    uint32_t gap = timeS - _newestTimeS;
+    if (gap >= _capacity)
+    {
+        _count = 0;
+        append(timeS, record);
+        return;
+    }
+
+    // mark any skipped seconds as empty, dropping the oldest once full
+    while (gap-- > 0)
+    {
+        if (_count < _capacity)
+        {
+            _count++;
+        }
+        else
+        {
+            _oldest = (_oldest + 1) % _capacity;
+        }
+
+        sensorRecord_t *slot = _slot(_count - 1);
+        if (gap == 0)
+        {
+            *slot = record;
+        }
+        else
+        {
+            memset(slot, 0, sizeof(sensorRecord_t));
+        }
+    }
+
+    _newestTimeS = timeS;
+}
+
+const sensorRecord_t *classHistory::get(uint32_t index)
+{
+    if (index >= _count)
+        return NULL;
+
+    return _slot(index);
+}
+
+const sensorRecord_t *classHistory::getAt(uint32_t timeS)
+{
+    if (_count == 0 || timeS > _newestTimeS || timeS < getOldestTime())
+        return NULL;
+
+    return _slot(timeS - getOldestTime());
+}
+
+bool recordGet(const sensorRecord_t *record, uint8_t channel, int32_t &value)
+{
+    if (record == NULL)
+        return false;
+
+    switch (channel)
+    {
+    case RECORD_PM1_0:
+        value = record->pm1_0;
+        return record->valid & RECORD_VALID_PMS;
+    case RECORD_PM2_5:
+        value = record->pm2_5;
+        return record->valid & RECORD_VALID_PMS;
+    case RECORD_PM10:
+        value = record->pm10;
+        return record->valid & RECORD_VALID_PMS;
+    case RECORD_TEMP:
+        value = record->temp;
+        return record->valid & RECORD_VALID_BME;
+    case RECORD_HUM:
+        value = record->hum;
+        return record->valid & RECORD_VALID_BME;
+    case RECORD_CO2E:
+        value = record->co2e;
+        return record->valid & RECORD_VALID_BME;
+    case RECORD_BVOC:
+        value = record->bvoc;
+        return record->valid & RECORD_VALID_BME;
+    }
+    return false;
+}
+
+void recordSet(sensorRecord_t &record, uint8_t channel, int32_t value)
+{
+    switch (channel)
+    {
+    case RECORD_PM1_0:
+        record.pm1_0 = value;
+        break;
+    case RECORD_PM2_5:
+        record.pm2_5 = value;
+        break;
+    case RECORD_PM10:
+        record.pm10 = value;
+        break;
+    case RECORD_TEMP:
+        record.temp = value;
+        break;
+    case RECORD_HUM:
+        record.hum = value;
+        break;
+    case RECORD_CO2E:
+        record.co2e = value;
+        break;
+    case RECORD_BVOC:
+        record.bvoc = value;
+        break;
+    }
+}
+
+float recordScale(uint8_t channel)
+{
+    switch (channel)
+    {
+    case RECORD_TEMP:
+        return RECORD_TEMP_SCALE;
+    case RECORD_HUM:
+        return RECORD_HUM_SCALE;
+    case RECORD_BVOC:
+        return RECORD_BVOC_SCALE;
+    }
+    return 1;
+}
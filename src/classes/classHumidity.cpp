@@ -0,0 +1,38 @@
+#include <classHumidity.h>
+
+float humidityGrowthFactor(float humidity, float kappa, float density)
+{
+    if (humidity <= 0)
+        return 1;
+    if (humidity > HUMIDITY_CORRECTION_RH_MAX)
+        humidity = HUMIDITY_CORRECTION_RH_MAX;
+
+    float aw = humidity / 100;
+    return 1 + (kappa / density) / ((1 / aw) - 1);
+}
+
+classHumidity::classHumidity() {};
+
+void classHumidity::begin(float kappa, float density)
+{
+    _enabled = kappa > 0 && density > 0;
+
+    for (uint8_t rh = 0; rh <= HUMIDITY_CORRECTION_RH_MAX; rh++)
+    {
+        float growth = _enabled ? humidityGrowthFactor(rh, kappa, density) : 1;
+        _factor[rh] = (1 << HUMIDITY_FACTOR_BITS) / growth + 0.5;
+    }
+}
+
+uint16_t classHumidity::correct(uint16_t concentration, uint16_t humidity)
+{
+    if (!_enabled)
+        return concentration;
+
+    // nearest whole percent
+    uint16_t rh = (humidity + 50) / 100;
+    if (rh > HUMIDITY_CORRECTION_RH_MAX)
+        rh = HUMIDITY_CORRECTION_RH_MAX;
+
+    return ((uint32_t)concentration * _factor[rh] + (1 << (HUMIDITY_FACTOR_BITS - 1))) >> HUMIDITY_FACTOR_BITS;
+}
@@ -0,0 +1,203 @@
+#include <classLog.h>
+
+classLog::classLog() {};
+
+bool classLog::begin(fs::FS &fs)
+{
+    _fs = &fs;
+
+    if (!_fs->exists(LOG_DIR) && !_fs->mkdir(LOG_DIR))
+    {
+        _fs = NULL;
+        return false;
+    }
+
+    // find the range of segments on flash
+    bool found = false;
+    File dir = _fs->open(LOG_DIR);
+    File file;
+    while ((file = dir.openNextFile()))
+    {
+        uint32_t segment = strtoul(file.name(), NULL, 16);
+        file.close();
+
+        if (!found || segment < _firstSegment)
+            _firstSegment = segment;
+        if (!found || segment > _lastSegment)
+            _lastSegment = segment;
+        found = true;
+    }
+    dir.close();
+
+    _segmentBlocks = 0;
+    _block.header.count = 0;
+
+    uint32_t lastBootId = 0;
+    if (found)
+    {
+        // keep appending to the last segment unless the power went mid-write (or it is full)
+        uint32_t newest = _lastSegment;
+        segmentScan_t last = _scanSegment(newest, NULL);
+        if (last.torn)
+        {
+            _recoveredBlocks++;
+        }
+
+        if (last.torn || last.blocks >= LOG_SEGMENT_BLOCKS)
+        {
+            _lastSegment++;
+        }
+        else
+        {
+            _segmentBlocks = last.blocks;
+        }
+
+        // carry on from the boot id in the last good block written, looking back through older
+        // segments if the newest has none (its first block was torn)
+        lastBootId = last.lastBootId;
+        for (uint32_t segment = newest; lastBootId == 0 && segment-- > _firstSegment;)
+        {
+            lastBootId = _scanSegment(segment, NULL).lastBootId;
+        }
+    }
+    else
+    {
+        _firstSegment = _lastSegment = 0;
+    }
+
+    _bootId = lastBootId + 1;
+    _rotate();
+
+    Serial.printf("[LOG] boot %u, segments %u-%u, %u bad block(s) recovered\n", _bootId, _firstSegment, _lastSegment, _recoveredBlocks);
+    return true;
+}
+
+void classLog::append(uint32_t timeS, const sensorRecord_t &record)
+{
+    if (_fs == NULL)
+        return;
+
+    logEntry_t &entry = _block.entries[_block.header.count++];
+    entry.timeS = timeS;
+    entry.record = record;
+
+    if (_block.header.count == LOG_BLOCK_ENTRIES)
+    {
+        flush();
+    }
+}
+
+void classLog::flush()
+{
+    if (_fs == NULL || _block.header.count == 0)
+        return;
+
+    // unused entries are zeroed so the CRC covers known bytes
+    memset(&_block.entries[_block.header.count], 0, sizeof(logBlock_t) - sizeof(logBlockHeader_t) - (_block.header.count * sizeof(logEntry_t)));
+
+    _block.header.magic = LOG_BLOCK_MAGIC;
+    _block.header.reserved = 0;
+    _block.header.bootId = _bootId;
+    _block.header.crc = 0;
+    _block.header.crc = crc32Ieee((const uint8_t *)&_block, sizeof(logBlock_t));
+
+    char path[24];
+    _path(path, _lastSegment);
+
+    File file = _fs->open(path, FILE_APPEND);
+    if (file && file.write((const uint8_t *)&_block, sizeof(logBlock_t)) == sizeof(logBlock_t))
+    {
+        _blocksWritten++;
+    }
+    else
+    {
+        _writeErrors++;
+    }
+    file.close();
+
+    _block.header.count = 0;
+
+    if (++_segmentBlocks >= LOG_SEGMENT_BLOCKS)
+    {
+        _lastSegment++;
+        _segmentBlocks = 0;
+        _rotate();
+    }
+}
+
+uint32_t classLog::replay(logCallback callback)
+{
+    if (_fs == NULL)
+        return 0;
+
+    uint32_t entries = 0;
+    for (uint32_t segment = _firstSegment; segment <= _lastSegment; segment++)
+    {
+        entries += _scanSegment(segment, callback).entries;
+    }
+    return entries;
+}
+
+void classLog::_path(char *buffer, uint32_t segment)
+{
+    sprintf_P(buffer, PSTR(LOG_DIR "/%08x"), segment);
+}
+
+bool classLog::_readBlock(File &file, logBlock_t &block)
+{
+    if (file.read((uint8_t *)&block, sizeof(logBlock_t)) != sizeof(logBlock_t))
+        return false;
+
+    if (block.header.magic != LOG_BLOCK_MAGIC || block.header.count == 0 || block.header.count > LOG_BLOCK_ENTRIES)
+        return false;
+
+    uint32_t crc = block.header.crc;
+    block.header.crc = 0;
+    return crc32Ieee((const uint8_t *)&block, sizeof(logBlock_t)) == crc;
+}
+
+// walks a segment up to its last good block - anything after that is a torn write and is skipped
+classLog::segmentScan_t classLog::_scanSegment(uint32_t segment, logCallback callback)
+{
+    segmentScan_t scan = {0, 0, 0, false};
+
+    char path[24];
+    _path(path, segment);
+
+    File file = _fs->open(path, FILE_READ);
+    if (!file)
+        return scan;
+
+    logBlock_t block;
+    while (_readBlock(file, block))
+    {
+        scan.blocks++;
+        scan.lastBootId = block.header.bootId;
+        scan.entries += block.header.count;
+
+        if (callback)
+        {
+            for (uint8_t i = 0; i < block.header.count; i++)
+            {
+                callback(block.header.bootId, block.entries[i].timeS, block.entries[i].record);
+            }
+        }
+    }
+
+    scan.torn = file.size() > scan.blocks * LOG_BLOCK_SIZE;
+
+    file.close();
+    return scan;
+}
+
+// drops the oldest segments once there are more than we keep
+void classLog::_rotate()
+{
+    char path[24];
+
+    while (_lastSegment - _firstSegment + 1 > LOG_SEGMENT_COUNT)
+    {
+        _path(path, _firstSegment++);
+        _fs->remove(path);
+    }
+}
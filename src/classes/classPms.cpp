@@ -0,0 +1,309 @@
+#include <classPms.h>
+
+classPms::classPms() {};
+
+void classPms::begin(HardwareSerial *serial, uint8_t setPin)
+{
+    Serial.println(F("[PMS] Starting PMS7003 frame parser"));
+
+    _serial = serial;
+    _setPin = setPin;
+    _frame = _queue[_head.load(std::memory_order_relaxed)].raw;
+    _index = 0;
+
+    // let the UART driver wake us once a frame worth of bytes has arrived (or the line goes quiet)
+    // the callback runs in the UART event task, so loop() only ever sees finished frames
+    _serial->setRxFIFOFull(PMS_RX_FIFO_THRESHOLD);
+    _serial->onReceive([this]() { _receive(); });
+}
+
+bool classPms::loop()
+{
+    bool newSample = false;
+
+    const pmsFrame_t *frame;
+    while ((frame = peek()) != NULL)
+    {
+        if (_state == PMS_STATE_CONTINUOUS)
+        {
+            // decoded straight out of the queue slot - the frame itself is never copied
+            for (uint8_t i = 0; i < PMS_FRAME_WORDS; i++)
+            {
+                _sample.words[i] = pmsWord(frame->words[2 + i]);
+            }
+            _lastSampleMs = monotonicMs();
+            newSample = true;
+        }
+        else if (_state == PMS_STATE_SAMPLING && _readRequested)
+        {
+            for (uint8_t i = 0; i < PMS_FRAME_WORDS; i++)
+            {
+                _sum[i] += pmsWord(frame->words[2 + i]);
+            }
+            _sampleCount++;
+            // one frame answers one request
+            _readRequested = false;
+        }
+        // anything received while asleep or warming up isn't trustworthy - drop it, along with
+        // active mode frames still arriving after the switch to passive and anything beyond one
+        // frame per read request (a duplicate reply, or a late active frame)
+
+        pop();
+    }
+
+    uint64_t now = monotonicMs();
+
+    switch (_state)
+    {
+    case PMS_STATE_SLEEPING:
+        if (now - _cycleMs >= _intervalMs)
+        {
+            _wake();
+        }
+        break;
+
+    case PMS_STATE_WARMUP:
+        if (now - _stateMs >= _warmupMs)
+        {
+            // fan and laser have settled - switch to passive so we only get the frames we ask for
+            _sendCommand(PMS_CMD_MODE, PMS_MODE_PASSIVE);
+            memset(_sum, 0, sizeof(_sum));
+            _sampleCount = 0;
+            _readRequested = false;
+            _state = PMS_STATE_SAMPLING;
+            _stateMs = now;
+            _requestMs = now;
+        }
+        break;
+
+    case PMS_STATE_SAMPLING:
+        if (_sampleCount >= _sampleFrames)
+        {
+            _average();
+            newSample = true;
+            _sleep();
+        }
+        else if (now - _stateMs >= (uint32_t)(_sampleFrames * PMS_PASSIVE_READ_MS) + PMS_SAMPLE_TIMEOUT_MS)
+        {
+            // sensor stopped answering - use whatever we got and try again next cycle
+            _sampleTimeouts++;
+            if (_sampleCount > 0)
+            {
+                _average();
+                newSample = true;
+            }
+            _sleep();
+        }
+        else if (now - _requestMs >= PMS_PASSIVE_READ_MS)
+        {
+            _sendCommand(PMS_CMD_READ, 0);
+            _readRequested = true;
+            _requestMs = now;
+        }
+        break;
+    }
+
+    return newSample;
+}
+
+void classPms::setDutyCycle(uint16_t intervalS, uint8_t warmupS, uint8_t frames)
+{
+    _intervalMs = min(intervalS, (uint16_t)PMS_SAMPLE_INTERVAL_S_MAX) * 1000UL;
+    _warmupMs = min(warmupS, (uint8_t)PMS_WARMUP_S_MAX) * 1000UL;
+    _sampleFrames = constrain(frames, 1, PMS_SAMPLE_FRAMES_MAX);
+
+    if (_intervalMs == 0)
+    {
+        // back to streaming frames as fast as the sensor sends them
+        digitalWrite(_setPin, HIGH);
+        _sendCommand(PMS_CMD_MODE, PMS_MODE_ACTIVE);
+        _state = PMS_STATE_CONTINUOUS;
+    }
+    else
+    {
+        // start a fresh cycle from now
+        _wake();
+    }
+}
+
+const char *pmsStateName(uint8_t state)
+{
+    switch (state)
+    {
+    case PMS_STATE_SLEEPING:
+        return "sleeping";
+    case PMS_STATE_WARMUP:
+        return "warmup";
+    case PMS_STATE_SAMPLING:
+        return "sampling";
+    }
+    return "continuous";
+}
+
+void classPms::_sendCommand(uint8_t command, uint16_t data)
+{
+    uint8_t buffer[PMS_COMMAND_SIZE] = {PMS_FRAME_START_1, PMS_FRAME_START_2, command, (uint8_t)(data >> 8), (uint8_t)(data & 0xFF), 0, 0};
+
+    uint16_t checksum = 0;
+    for (uint8_t i = 0; i < PMS_COMMAND_SIZE - 2; i++)
+    {
+        checksum += buffer[i];
+    }
+    buffer[PMS_COMMAND_SIZE - 2] = checksum >> 8;
+    buffer[PMS_COMMAND_SIZE - 1] = checksum & 0xFF;
+
+    _serial->write(buffer, PMS_COMMAND_SIZE);
+}
+
+void classPms::_wake()
+{
+    digitalWrite(_setPin, HIGH);
+    _state = PMS_STATE_WARMUP;
+    _stateMs = monotonicMs();
+    _cycleMs = _stateMs;
+}
+
+void classPms::_sleep()
+{
+    digitalWrite(_setPin, LOW);
+    _state = PMS_STATE_SLEEPING;
+    _stateMs = monotonicMs();
+}
+
+// builds the sample from the averaged data words
+void classPms::_average()
+{
+    for (uint8_t i = 0; i < PMS_FRAME_WORDS; i++)
+    {
+        _sample.words[i] = (_sum[i] + (_sampleCount / 2)) / _sampleCount;
+    }
+
+    _lastSampleMs = monotonicMs();
+}
+
+// drains the UART RX buffer into the parser
+void classPms::_receive()
+{
+    uint8_t buffer[PMS_FRAME_SIZE * 2];
+    int length;
+
+    while ((length = _serial->available()) > 0)
+    {
+        length = _serial->read(buffer, min(length, (int)sizeof(buffer)));
+        feed(buffer, length);
+    }
+}
+
+void classPms::feed(const uint8_t *data, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        _parseByte(data[i]);
+    }
+}
+
+void classPms::_parseByte(uint8_t data)
+{
+    _frame[_index++] = data;
+
+    // hunting for the start of a frame
+    if (_index == 1 && data != PMS_FRAME_START_1)
+    {
+        _index = 0;
+        _skippedBytes++;
+        return;
+    }
+
+    if (_index == 2 && data != PMS_FRAME_START_2)
+    {
+        _resync();
+        return;
+    }
+
+    // frame length is always 28 - anything else means we locked onto a stray 0x42 0x4D
+    if (_index == 4 && ((_frame[2] << 8) | _frame[3]) != PMS_FRAME_LENGTH)
+    {
+        _resync();
+        return;
+    }
+
+    if (_index < PMS_FRAME_SIZE)
+        return;
+
+    // checksum is the sum of every byte before it
+    uint16_t checksum = 0;
+    for (uint8_t i = 0; i < PMS_FRAME_SIZE - 2; i++)
+    {
+        checksum += _frame[i];
+    }
+
+    if (checksum == ((_frame[PMS_FRAME_SIZE - 2] << 8) | _frame[PMS_FRAME_SIZE - 1]))
+    {
+        _frameCount++;
+        _push();
+        _index = 0;
+    }
+    else
+    {
+        _checksumErrors++;
+        _resync();
+    }
+}
+
+// drops the first byte of a bad frame and re-parses the rest, so a real header inside it isn't lost
+void classPms::_resync()
+{
+    uint8_t pending[PMS_FRAME_SIZE];
+    uint8_t count = _index - 1;
+
+    memcpy(pending, &_frame[1], count);
+    _index = 0;
+    _skippedBytes++;
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        _parseByte(pending[i]);
+    }
+}
+
+void classPms::_push()
+{
+    uint8_t head = _head.load(std::memory_order_relaxed);
+    uint8_t next = (head + 1) & (PMS_FRAME_QUEUE_SIZE - 1);
+
+    // loop() has fallen behind - drop the newest frame (its slot is reused) rather than corrupt one being read
+    if (next == _tail.load(std::memory_order_acquire))
+    {
+        _overflows++;
+        return;
+    }
+
+    // publish the slot we just filled and start assembling in the next one
+    _head.store(next, std::memory_order_release);
+    _frame = _queue[next].raw;
+}
+
+const pmsFrame_t *classPms::peek()
+{
+    uint8_t tail = _tail.load(std::memory_order_relaxed);
+
+    if (tail == _head.load(std::memory_order_acquire))
+        return NULL;
+
+    return &_queue[tail];
+}
+
+void classPms::pop()
+{
+    uint8_t tail = _tail.load(std::memory_order_relaxed);
+
+    if (tail == _head.load(std::memory_order_acquire))
+        return;
+
+    _tail.store((tail + 1) & (PMS_FRAME_QUEUE_SIZE - 1), std::memory_order_release);
+}
+
+uint8_t classPms::available()
+{
+    return (_head.load(std::memory_order_acquire) - _tail.load(std::memory_order_relaxed)) & (PMS_FRAME_QUEUE_SIZE - 1);
+}
@@ -0,0 +1,150 @@
+#include <classPublisher.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(BOARD_HAS_PSRAM)
+#include <esp32-hal-psram.h>
+#endif
+
+classPublisher::classPublisher() {};
+
+bool classPublisher::begin(publishCallback callback, uint32_t seed)
+{
+    _callback = callback;
+    _random = seed ? seed : 1;
+
+#if defined(BOARD_HAS_PSRAM)
+    _payloads = (char *)ps_malloc(PUBLISHER_QUEUE_SIZE * PUBLISHER_PAYLOAD_MAX);
+#else
+    _payloads = (char *)malloc(PUBLISHER_QUEUE_SIZE * PUBLISHER_PAYLOAD_MAX);
+#endif
+
+    _head = 0;
+    _count = 0;
+    return _payloads != NULL;
+}
+
+uint8_t classPublisher::publish(const char *payload, size_t length, const char *subtopic, uint64_t now)
+{
+    if (_state == PUBLISHER_STATE_OFFLINE || _callback == NULL)
+    {
+        _rejected++;
+        return PUBLISHER_REJECTED;
+    }
+
+    // keep the order - anything new waits behind what is already queued
+    if (_count > 0)
+    {
+        if (!_enqueue(payload, length, subtopic))
+        {
+            _rejected++;
+            return PUBLISHER_REJECTED;
+        }
+        return PUBLISHER_QUEUED;
+    }
+
+    if (_callback(payload, length, subtopic))
+    {
+        _sent++;
+        return PUBLISHER_SENT;
+    }
+
+    if (!_enqueue(payload, length, subtopic))
+    {
+        _failures++;
+        _rejected++;
+        return PUBLISHER_REJECTED;
+    }
+
+    _failed(now);
+    return PUBLISHER_QUEUED;
+}
+
+void classPublisher::loop(bool online, uint64_t now)
+{
+    if (!online)
+    {
+        _state = PUBLISHER_STATE_OFFLINE;
+        return;
+    }
+
+    // back online - start over with a short (jittered) wait so a fleet doesn't all retry at once
+    if (_state == PUBLISHER_STATE_OFFLINE)
+    {
+        _backoffMs = PUBLISHER_BACKOFF_MIN_MS;
+        _state = _count > 0 ? PUBLISHER_STATE_RETRYING : PUBLISHER_STATE_OK;
+        _retryMs = now + _jitter(_backoffMs);
+        return;
+    }
+
+    if (_count == 0 || now < _retryMs)
+        return;
+
+    // one attempt a pass - the rest of the queue follows on the next ones
+    if (!_callback(&_payloads[_head * PUBLISHER_PAYLOAD_MAX], _slots[_head].length, _slots[_head].subtopic))
+    {
+        _failed(now);
+        return;
+    }
+
+    _sent++;
+    _head = (_head + 1) % PUBLISHER_QUEUE_SIZE;
+    _count--;
+
+    _backoffMs = PUBLISHER_BACKOFF_MIN_MS;
+    _retryMs = now;
+    if (_count == 0)
+    {
+        _state = PUBLISHER_STATE_OK;
+    }
+}
+
+const char *classPublisher::getStateName()
+{
+    switch (_state)
+    {
+    case PUBLISHER_STATE_RETRYING:
+        return "retrying";
+    case PUBLISHER_STATE_OFFLINE:
+        return "offline";
+    }
+    return "ok";
+}
+
+bool classPublisher::_enqueue(const char *payload, size_t length, const char *subtopic)
+{
+    if (_payloads == NULL || _count >= PUBLISHER_QUEUE_SIZE || length > PUBLISHER_PAYLOAD_MAX)
+        return false;
+
+    uint8_t slot = (_head + _count) % PUBLISHER_QUEUE_SIZE;
+    memcpy(&_payloads[slot * PUBLISHER_PAYLOAD_MAX], payload, length);
+    _slots[slot].length = length;
+    _slots[slot].subtopic = subtopic;
+    _count++;
+    return true;
+}
+
+// waits out the current backoff (jittered) before the next attempt, and doubles it for the one after
+void classPublisher::_failed(uint64_t now)
+{
+    _failures++;
+    _state = PUBLISHER_STATE_RETRYING;
+    _retryMs = now + _jitter(_backoffMs);
+
+    _backoffMs *= 2;
+    if (_backoffMs > PUBLISHER_BACKOFF_MAX_MS)
+    {
+        _backoffMs = PUBLISHER_BACKOFF_MAX_MS;
+    }
+}
+
+// delayMs +/- PUBLISHER_JITTER_PERCENT
+uint32_t classPublisher::_jitter(uint32_t delayMs)
+{
+    _random ^= _random << 13;
+    _random ^= _random >> 17;
+    _random ^= _random << 5;
+
+    uint32_t spread = delayMs * PUBLISHER_JITTER_PERCENT / 100;
+    return delayMs - spread + (_random % (2 * spread + 1));
+}
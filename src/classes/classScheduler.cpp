@@ -0,0 +1,69 @@
+#include <classScheduler.h>
+#include <esp_timer.h>
+
+uint64_t monotonicMs()
+{
+    return esp_timer_get_time() / 1000;
+}
+
+int8_t classScheduler::every(uint32_t periodMs, jobCallback callback, uint64_t now)
+{
+    if (_jobCount >= SCHEDULER_MAX_JOBS)
+        return SCHEDULER_NO_JOB;
+
+    int8_t job = _jobCount++;
+    _jobs[job].callback = callback;
+    setPeriod(job, periodMs, now);
+    return job;
+}
+
+void classScheduler::setPeriod(int8_t job, uint32_t periodMs, uint64_t now)
+{
+    if (job < 0 || job >= _jobCount)
+        return;
+
+    _jobs[job].periodMs = periodMs;
+    _jobs[job].dueMs = now + periodMs;
+}
+
+void classScheduler::loop(uint64_t now)
+{
+    for (uint8_t i = 0; i < _jobCount; i++)
+    {
+        if (_jobs[i].periodMs == 0 || now < _jobs[i].dueMs)
+            continue;
+
+        // job wants another go next pass - leave its deadline where it is
+        if (!_jobs[i].callback())
+            continue;
+
+        // keep to the original cadence, but never let a stalled job catch up with a burst of runs
+        _jobs[i].dueMs += _jobs[i].periodMs;
+        if (_jobs[i].dueMs <= now)
+        {
+            _skipped += (now - _jobs[i].dueMs) / _jobs[i].periodMs + 1;
+            _jobs[i].dueMs = now + _jobs[i].periodMs;
+        }
+    }
+}
+
+uint32_t classScheduler::getMsUntilNext(uint64_t now)
+{
+    uint64_t next = UINT64_MAX;
+
+    for (uint8_t i = 0; i < _jobCount; i++)
+    {
+        if (_jobs[i].periodMs != 0 && _jobs[i].dueMs < next)
+        {
+            next = _jobs[i].dueMs;
+        }
+    }
+
+    if (next == UINT64_MAX)
+        return UINT32_MAX;
+
+    if (next <= now)
+        return 0;
+
+    return (next - now) > UINT32_MAX ? UINT32_MAX : (uint32_t)(next - now);
+}
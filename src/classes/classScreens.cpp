@@ -282,4 +282,16 @@ void classScreens::updateInfoScreen(char * xMAC,char * xIP,char * xMQTT)
 
     lv_table_set_cell_value(table, 7, 0, "MQTT:");
     lv_table_set_cell_value(table, 7, 1, xMQTT);
+}
+
+void classScreens::setInfoRowCount(uint8_t count)
+{
+    // drop any extra rows that are no longer in use
+    lv_table_set_row_cnt(_infoTextArea, count ? _INFO_EXTRA_ROW + count : 8);
+}
+
+void classScreens::updateInfoRow(uint8_t row, const char * label, const char * value)
+{
+    lv_table_set_cell_value(_infoTextArea, _INFO_EXTRA_ROW + row, 0, label);
+    lv_table_set_cell_value(_infoTextArea, _INFO_EXTRA_ROW + row, 1, value);
 }
\ No newline at end of file
@@ -0,0 +1,91 @@
+#include <classStateStore.h>
+
+classStateStore::classStateStore() {};
+
+bool classStateStore::begin(const char *name, uint16_t length)
+{
+    _length = length;
+
+    _buffer = (uint8_t *)malloc(sizeof(stateSlotHeader_t) + length);
+    if (_buffer == NULL || !_prefs.begin(name, false))
+        return false;
+
+    for (uint8_t slot = 0; slot < STATE_STORE_SLOTS; slot++)
+    {
+        if (!_readSlot(slot))
+            continue;
+
+        // sequence numbers are compared as a signed difference so they can wrap
+        const stateSlotHeader_t *header = (const stateSlotHeader_t *)_buffer;
+        if (!_valid || (int32_t)(header->sequence - _sequence) > 0)
+        {
+            _valid = true;
+            _slot = slot;
+            _sequence = header->sequence;
+        }
+    }
+    return true;
+}
+
+bool classStateStore::load(uint8_t *data)
+{
+    if (!_valid || !_readSlot(_slot))
+        return false;
+
+    memcpy(data, _buffer + sizeof(stateSlotHeader_t), _length);
+    return true;
+}
+
+bool classStateStore::save(const uint8_t *data)
+{
+    if (_buffer == NULL)
+        return false;
+
+    // never the newest slot - that copy stays intact whatever happens to this one
+    uint8_t slot = (_slot + 1) % STATE_STORE_SLOTS;
+
+    stateSlotHeader_t header;
+    header.magic = STATE_STORE_MAGIC;
+    header.length = _length;
+    header.sequence = _sequence + 1;
+    header.crc = crc32Ieee(data, _length, crc32Ieee((const uint8_t *)&header, offsetof(stateSlotHeader_t, crc)));
+
+    memcpy(_buffer, &header, sizeof(stateSlotHeader_t));
+    memcpy(_buffer + sizeof(stateSlotHeader_t), data, _length);
+
+    char key[8];
+    _key(key, slot);
+    size_t size = sizeof(stateSlotHeader_t) + _length;
+    if (_prefs.putBytes(key, _buffer, size) != size)
+        return false;
+
+    _valid = true;
+    _slot = slot;
+    _sequence = header.sequence;
+    return true;
+}
+
+void classStateStore::_key(char *buffer, uint8_t slot)
+{
+    sprintf_P(buffer, PSTR("slot%u"), slot);
+}
+
+// reads a slot into the buffer - false if it is missing, the wrong size or fails its CRC
+bool classStateStore::_readSlot(uint8_t slot)
+{
+    if (_buffer == NULL)
+        return false;
+
+    char key[8];
+    _key(key, slot);
+    size_t size = sizeof(stateSlotHeader_t) + _length;
+    if (_prefs.getBytesLength(key) != size || _prefs.getBytes(key, _buffer, size) != size)
+        return false;
+
+    const stateSlotHeader_t *header = (const stateSlotHeader_t *)_buffer;
+    if (header->magic != STATE_STORE_MAGIC || header->length != _length)
+        return false;
+
+    uint32_t crc = crc32Ieee(_buffer, offsetof(stateSlotHeader_t, crc));
+    return crc32Ieee(_buffer + sizeof(stateSlotHeader_t), _length, crc) == header->crc;
+}
@@ -0,0 +1,213 @@
+#include <classStats.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(BOARD_HAS_PSRAM)
+#include <esp32-hal-psram.h>
+#endif
+
+static const uint16_t windowS[STATS_WINDOW_COUNT] = STATS_WINDOW_S;
+
+classStats::classStats() {};
+
+bool classStats::begin(classHistory *history)
+{
+    _history = history;
+
+    // each window can hold at most one entry per second in each of its deques
+    size_t entries = 0;
+    for (uint8_t w = 0; w < STATS_WINDOW_COUNT; w++)
+    {
+        entries += windowS[w] * 2 * RECORD_CHANNEL_COUNT;
+    }
+
+#if defined(BOARD_HAS_PSRAM)
+    uint16_t *buffer = (uint16_t *)ps_malloc(entries * sizeof(uint16_t));
+#else
+    uint16_t *buffer = (uint16_t *)malloc(entries * sizeof(uint16_t));
+#endif
+
+    if (buffer == NULL)
+    {
+        _history = NULL;
+        return false;
+    }
+
+    for (uint8_t c = 0; c < RECORD_CHANNEL_COUNT; c++)
+    {
+        for (uint8_t w = 0; w < STATS_WINDOW_COUNT; w++)
+        {
+            _windows[c][w].min.times = buffer;
+            _windows[c][w].min.size = windowS[w];
+            buffer += windowS[w];
+
+            _windows[c][w].max.times = buffer;
+            _windows[c][w].max.size = windowS[w];
+            buffer += windowS[w];
+        }
+    }
+
+    _started = false;
+    return true;
+}
+
+void classStats::update()
+{
+    if (_history == NULL || _history->count() == 0)
+        return;
+
+    uint32_t newest = _history->getNewestTime();
+
+    // first time in, or the history has skipped further than our longest window - start over
+    if (!_started || newest < _lastTimeS || newest - _lastTimeS >= windowS[STATS_WINDOW_COUNT - 1])
+    {
+        _reset(newest);
+        _add(newest);
+        return;
+    }
+
+    while (_lastTimeS < newest)
+    {
+        _add(++_lastTimeS);
+    }
+}
+
+bool classStats::get(uint8_t channel, uint8_t window, statsResult_t &result)
+{
+    if (channel >= RECORD_CHANNEL_COUNT || window >= STATS_WINDOW_COUNT)
+        return false;
+
+    window_t &stats = _windows[channel][window];
+    if (stats.count == 0)
+        return false;
+
+    float scale = recordScale(channel);
+    double mean = (double)stats.sum / stats.count;
+    double variance = ((double)stats.sumSquares / stats.count) - (mean * mean);
+
+    result.count = stats.count;
+    result.mean = mean / scale;
+    result.stddev = variance > 0 ? sqrt(variance) / scale : 0;
+    result.min = _dequeValue(stats.min, stats.min.head, channel) / scale;
+    result.max = _dequeValue(stats.max, stats.max.head, channel) / scale;
+    return true;
+}
+
+uint16_t classStats::getWindowS(uint8_t window)
+{
+    return window < STATS_WINDOW_COUNT ? windowS[window] : 0;
+}
+
+void classStats::_reset(uint32_t timeS)
+{
+    for (uint8_t c = 0; c < RECORD_CHANNEL_COUNT; c++)
+    {
+        for (uint8_t w = 0; w < STATS_WINDOW_COUNT; w++)
+        {
+            window_t &stats = _windows[c][w];
+            stats.sum = 0;
+            stats.sumSquares = 0;
+            stats.count = 0;
+            stats.min.head = stats.min.count = 0;
+            stats.max.head = stats.max.count = 0;
+        }
+    }
+
+    _startTimeS = timeS;
+    _lastTimeS = timeS;
+    _started = true;
+}
+
+// takes in the second at timeS and drops the second sliding out of each window
+void classStats::_add(uint32_t timeS)
+{
+    _remove(timeS);
+
+    const sensorRecord_t *record = _history->getAt(timeS);
+    int32_t value;
+
+    for (uint8_t c = 0; c < RECORD_CHANNEL_COUNT; c++)
+    {
+        if (!recordGet(record, c, value))
+            continue;
+
+        for (uint8_t w = 0; w < STATS_WINDOW_COUNT; w++)
+        {
+            window_t &stats = _windows[c][w];
+            stats.sum += value;
+            stats.sumSquares += (int64_t)value * value;
+            stats.count++;
+
+            _dequePush(stats.min, timeS, value, c, false);
+            _dequePush(stats.max, timeS, value, c, true);
+        }
+    }
+}
+
+void classStats::_remove(uint32_t timeS)
+{
+    for (uint8_t w = 0; w < STATS_WINDOW_COUNT; w++)
+    {
+        // nothing has slid out of this window yet
+        if (timeS - _startTimeS < windowS[w])
+            continue;
+
+        uint32_t leaving = timeS - windowS[w];
+        uint16_t leavingTag = leaving & 0xFFFF;
+        const sensorRecord_t *record = _history->getAt(leaving);
+        int32_t value;
+
+        for (uint8_t c = 0; c < RECORD_CHANNEL_COUNT; c++)
+        {
+            window_t &stats = _windows[c][w];
+
+            if (recordGet(record, c, value))
+            {
+                stats.sum -= value;
+                stats.sumSquares -= (int64_t)value * value;
+                stats.count--;
+            }
+
+            // the leaving second can only ever be at the front of a deque
+            if (stats.min.count > 0 && stats.min.times[stats.min.head] == leavingTag)
+            {
+                stats.min.head = (stats.min.head + 1) % stats.min.size;
+                stats.min.count--;
+            }
+            if (stats.max.count > 0 && stats.max.times[stats.max.head] == leavingTag)
+            {
+                stats.max.head = (stats.max.head + 1) % stats.max.size;
+                stats.max.count--;
+            }
+        }
+    }
+}
+
+// value of the sample a deque entry points at - the newest time is our own, so the 16 bit tag can be widened again
+int32_t classStats::_dequeValue(deque_t &deque, uint16_t position, uint8_t channel)
+{
+    uint32_t timeS = _lastTimeS - (uint16_t)((_lastTimeS & 0xFFFF) - deque.times[position]);
+
+    int32_t value = 0;
+    recordGet(_history->getAt(timeS), channel, value);
+    return value;
+}
+
+// drops every entry the new sample beats (so the front is always the window's min or max) then adds it at the back
+void classStats::_dequePush(deque_t &deque, uint32_t timeS, int32_t value, uint8_t channel, bool isMax)
+{
+    while (deque.count > 0)
+    {
+        uint16_t back = (deque.head + deque.count - 1) % deque.size;
+        int32_t backValue = _dequeValue(deque, back, channel);
+
+        if (isMax ? backValue > value : backValue < value)
+            break;
+
+        deque.count--;
+    }
+
+    deque.times[(deque.head + deque.count) % deque.size] = timeS & 0xFFFF;
+    deque.count++;
+}
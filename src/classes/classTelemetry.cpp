@@ -0,0 +1,360 @@
+#include <classTelemetry.h>
+#include <string.h>
+
+// CBOR major types and simple values
+#define CBOR_UNSIGNED 0
+#define CBOR_NEGATIVE 1
+#define CBOR_TEXT 3
+#define CBOR_ARRAY 4
+#define CBOR_MAP 5
+#define CBOR_TAG 6
+#define CBOR_INDEFINITE 0x1F
+#define CBOR_BREAK 0xFF
+#define CBOR_NULL 0xF6
+#define CBOR_TAG_DECIMAL 4
+
+classTelemetry::classTelemetry() {};
+
+void classTelemetry::clearKeys()
+{
+    _keyCount = 0;
+    _keysUsed = 0;
+}
+
+int8_t classTelemetry::addKey(const char *key)
+{
+    return addKey(key, "");
+}
+
+int8_t classTelemetry::addKey(const char *prefix, const char *suffix)
+{
+    size_t prefixLength = strlen(prefix);
+    size_t suffixLength = strlen(suffix);
+    // "prefixsuffix":
+    size_t length = prefixLength + suffixLength + 3;
+
+    if (_keyCount >= TELEMETRY_KEYS_MAX || length > UINT8_MAX || _keysUsed + length > TELEMETRY_KEY_BUFFER_SIZE)
+        return TELEMETRY_NO_KEY;
+
+    char *key = &_keys[_keysUsed];
+    key[0] = '"';
+    memcpy(&key[1], prefix, prefixLength);
+    memcpy(&key[1 + prefixLength], suffix, suffixLength);
+    key[length - 2] = '"';
+    key[length - 1] = ':';
+
+    _keyOffset[_keyCount] = _keysUsed;
+    _keyLength[_keyCount] = length;
+    _keysUsed += length;
+    return _keyCount++;
+}
+
+void classTelemetry::begin()
+{
+    _format = _nextFormat;
+    _length = 0;
+    _overflow = false;
+    _depth = 0;
+    _first[0] = true;
+
+    if (_format == TELEMETRY_FORMAT_CBOR)
+    {
+        _putChar((CBOR_MAP << 5) | CBOR_INDEFINITE);
+    }
+    else
+    {
+        _putChar('{');
+    }
+}
+
+void classTelemetry::addInt(int8_t key, int64_t value)
+{
+    _key(key);
+
+    if (_format == TELEMETRY_FORMAT_CBOR)
+    {
+        _putCborInt(value);
+        return;
+    }
+
+    if (value < 0)
+    {
+        _putChar('-');
+    }
+    _putUInt(value < 0 ? -(uint64_t)value : value, 1);
+}
+
+void classTelemetry::addFixed(int8_t key, int32_t value, uint8_t decimals)
+{
+    if (decimals == 0)
+    {
+        addInt(key, value);
+        return;
+    }
+
+    _key(key);
+
+    // value x 10^-decimals
+    if (_format == TELEMETRY_FORMAT_CBOR)
+    {
+        _putHead(CBOR_TAG, CBOR_TAG_DECIMAL);
+        _putHead(CBOR_ARRAY, 2);
+        _putCborInt(-(int64_t)decimals);
+        _putCborInt(value);
+        return;
+    }
+
+    uint32_t scale = 1;
+    for (uint8_t i = 0; i < decimals; i++)
+    {
+        scale *= 10;
+    }
+
+    // sign first, so values between -1 and 0 keep it
+    uint32_t magnitude = value < 0 ? -(uint32_t)value : value;
+    if (value < 0)
+    {
+        _putChar('-');
+    }
+    _putUInt(magnitude / scale, 1);
+    _putChar('.');
+    _putUInt(magnitude % scale, decimals);
+}
+
+void classTelemetry::addString(int8_t key, const char *value)
+{
+    size_t length = strlen(value);
+
+    _key(key);
+
+    if (_format == TELEMETRY_FORMAT_CBOR)
+    {
+        _putHead(CBOR_TEXT, length);
+        _put(value, length);
+        return;
+    }
+
+    _putChar('"');
+    _put(value, length);
+    _putChar('"');
+}
+
+void classTelemetry::addNull(int8_t key)
+{
+    _key(key);
+
+    if (_format == TELEMETRY_FORMAT_CBOR)
+    {
+        _putChar(CBOR_NULL);
+        return;
+    }
+
+    _put("null", 4);
+}
+
+void classTelemetry::beginObject(int8_t key)
+{
+    _open(key, '{');
+}
+
+void classTelemetry::endObject()
+{
+    _close('}');
+}
+
+void classTelemetry::beginArray(int8_t key)
+{
+    _open(key, '[');
+}
+
+void classTelemetry::endArray()
+{
+    _close(']');
+}
+
+const char *classTelemetry::end(size_t &length)
+{
+    // anything still open is a bug in the payload - as is closing too often, which _close() catches
+    if (_depth != 0)
+    {
+        _overflow = true;
+    }
+    _putChar(_format == TELEMETRY_FORMAT_CBOR ? (char)CBOR_BREAK : '}');
+
+    if (_overflow)
+        return NULL;
+
+    length = _length;
+    return _buffer;
+}
+
+void classTelemetry::_open(int8_t key, char bracket)
+{
+    _key(key);
+
+    if (_format == TELEMETRY_FORMAT_CBOR)
+    {
+        _putChar(((bracket == '{' ? CBOR_MAP : CBOR_ARRAY) << 5) | CBOR_INDEFINITE);
+    }
+    else
+    {
+        _putChar(bracket);
+    }
+
+    if (_depth < TELEMETRY_DEPTH_MAX)
+    {
+        _first[++_depth] = true;
+    }
+    else
+    {
+        _overflow = true;
+    }
+}
+
+void classTelemetry::_close(char bracket)
+{
+    _putChar(_format == TELEMETRY_FORMAT_CBOR ? (char)CBOR_BREAK : bracket);
+
+    if (_depth > 0)
+    {
+        _depth--;
+    }
+    else
+    {
+        _overflow = true;
+    }
+}
+
+// separator then the pre-rendered key - array items have none
+void classTelemetry::_key(int8_t key)
+{
+    if (key < TELEMETRY_NO_KEY || key >= _keyCount)
+    {
+        _overflow = true;
+        return;
+    }
+
+    if (_format == TELEMETRY_FORMAT_CBOR)
+    {
+        // the key text sits inside the quotes of its JSON form
+        if (key != TELEMETRY_NO_KEY)
+        {
+            _putHead(CBOR_TEXT, _keyLength[key] - 3);
+            _put(&_keys[_keyOffset[key] + 1], _keyLength[key] - 3);
+        }
+        return;
+    }
+
+    if (!_first[_depth])
+    {
+        _putChar(',');
+    }
+    _first[_depth] = false;
+
+    if (key != TELEMETRY_NO_KEY)
+    {
+        _put(&_keys[_keyOffset[key]], _keyLength[key]);
+    }
+}
+
+void classTelemetry::_put(const char *data, size_t length)
+{
+    if (_length + length > TELEMETRY_BUFFER_SIZE)
+    {
+        _overflow = true;
+        return;
+    }
+
+    memcpy(&_buffer[_length], data, length);
+    _length += length;
+}
+
+void classTelemetry::_putChar(char c)
+{
+    if (_length >= TELEMETRY_BUFFER_SIZE)
+    {
+        _overflow = true;
+        return;
+    }
+
+    _buffer[_length++] = c;
+}
+
+// digits are built backwards into a scratch buffer, padded with leading zeros to minDigits
+// 64-bit division is slow on the ESP32, so it drops to 32-bit as soon as the value fits
+void classTelemetry::_putUInt(uint64_t value, uint8_t minDigits)
+{
+    char digits[20];
+    uint8_t count = 0;
+
+    while (value > UINT32_MAX)
+    {
+        digits[sizeof(digits) - ++count] = '0' + (value % 10);
+        value /= 10;
+    }
+
+    uint32_t small = value;
+    do
+    {
+        digits[sizeof(digits) - ++count] = '0' + (small % 10);
+        small /= 10;
+    } while ((small > 0 || count < minDigits) && count < sizeof(digits));
+
+    _put(&digits[sizeof(digits) - count], count);
+}
+
+void classTelemetry::_putHead(uint8_t major, uint64_t argument)
+{
+    char head[9];
+    uint8_t length;
+
+    head[0] = major << 5;
+    if (argument < 24)
+    {
+        head[0] |= argument;
+        length = 1;
+    }
+    else if (argument <= UINT8_MAX)
+    {
+        head[0] |= 24;
+        head[1] = argument;
+        length = 2;
+    }
+    else if (argument <= UINT16_MAX)
+    {
+        head[0] |= 25;
+        length = 3;
+    }
+    else if (argument <= UINT32_MAX)
+    {
+        head[0] |= 26;
+        length = 5;
+    }
+    else
+    {
+        head[0] |= 27;
+        length = 9;
+    }
+
+    // big-endian argument after the initial byte
+    for (uint8_t i = length - 1; i > 0 && length > 2; i--)
+    {
+        head[i] = argument & 0xFF;
+        argument >>= 8;
+    }
+
+    _put(head, length);
+}
+
+void classTelemetry::_putCborInt(int64_t value)
+{
+    // negative integers are stored as -1 - n
+    if (value < 0)
+    {
+        _putHead(CBOR_NEGATIVE, (uint64_t)(-1 - value));
+    }
+    else
+    {
+        _putHead(CBOR_UNSIGNED, value);
+    }
+}
@@ -1,4 +1,5 @@
 #include <classTft.h>
+#include <classScheduler.h>
 
 classTft::classTft() {};
 
@@ -58,23 +59,26 @@ void classTft::begin()
 
     _setBackLight(35);
 
-    delay(1000);
+    // the splash stays up for a minimum time, timed from loop() rather than held here
+    _splashMs = monotonicMs();
 }
 
 // keeps the screen running and updates as needed
 void classTft::loop()
 {
-    if ((millis() - _lastLvgl) > _lvglSpeed)
+    if ((monotonicMs() - _lastLvgl) > _lvglSpeed)
     {
         lv_timer_handler(); /* let the GUI do its work */
-        _lastLvgl = millis();
+        _lastLvgl = monotonicMs();
     }
 
-    // first time loading since boot and we have full network so lets stop showing splash screen
-    if (_wifiState == true && _mqttState == true && _booted == false)
+    // first time loading since boot and we have a reading (or full network) so lets stop showing splash screen
+    // the network carries on connecting in the background - its status shows on the normal screen
+    bool ready = _pmsFound || _bmeFound || (_wifiState == true && _mqttState == true);
+    if (ready && _booted == false && monotonicMs() - _splashMs >= BOOT_SPLASH_MIN_MS)
     {
         _setBackLight(maxBrightness);
-        _lastTftTimeoutIntervalMs = millis();
+        _lastTftTimeoutIntervalMs = monotonicMs();
         // reset the brightness timer
         lv_scr_load(_screen.normalScreen);
         currentScreen = _NORMAL_SCREEN;
@@ -84,7 +88,7 @@ void classTft::loop()
     if (_booted)
     {
         // check brightness and change brightness based on timer
-        if (tftTimeoutIntervalMs != 0 && millis() - _lastTftTimeoutIntervalMs >= tftTimeoutIntervalMs)
+        if (tftTimeoutIntervalMs != 0 && monotonicMs() - _lastTftTimeoutIntervalMs >= tftTimeoutIntervalMs)
         {
             _setBackLight(0);
         }
@@ -109,8 +113,12 @@ void classTft::loop()
             lv_obj_set_style_text_color(_screen.pm1_0Text, lv_color_make(23, 111, 192), 0);
         }
 
-        // check PM2.5 values
-        if (_PM2_5 >= _setPoint_PM2_5_RED)
+        // check PM2.5 values - by AQI category once there is one, otherwise against the warning levels
+        if (warningMode == WARNING_MODE_AQI && _PM2_5Category != AQI_UNKNOWN)
+        {
+            _setAqiColor(_screen.pm2_5Text, _PM2_5Category, &_PM2_5Color);
+        }
+        else if (_PM2_5 >= _setPoint_PM2_5_RED)
         {
             _PM2_5Color = _red;
             lv_obj_set_style_text_color(_screen.pm2_5Text, lv_color_make(255, 0, 0), 0);
@@ -127,7 +135,11 @@ void classTft::loop()
         }
 
         // Check PM10 values
-        if (_PM10 >= _setPoint_PM10_RED)
+        if (warningMode == WARNING_MODE_AQI && _PM10Category != AQI_UNKNOWN)
+        {
+            _setAqiColor(_screen.pm10Text, _PM10Category, &_PM10Color);
+        }
+        else if (_PM10 >= _setPoint_PM10_RED)
         {
             _PM10Color = _red;
             lv_obj_set_style_text_color(_screen.pm10Text, lv_color_make(255, 0, 0), 0);
@@ -192,7 +204,7 @@ void classTft::nextScreen()
             }
         }
     }
-    _lastTftTimeoutIntervalMs = millis();
+    _lastTftTimeoutIntervalMs = monotonicMs();
 }
 
 void classTft::setInfoData(char * xMAC,char * xIP,char * xMQTT)
@@ -201,12 +213,26 @@ void classTft::setInfoData(char * xMAC,char * xIP,char * xMQTT)
     _screen.updateInfoScreen(xMAC,xIP,xMQTT);
 }
 
+void classTft::setInfoRowCount(uint8_t count)
+{
+    _screen.setInfoRowCount(count);
+}
+
+void classTft::setInfoRow(uint8_t row, const char * label, const char * value)
+{
+    _screen.updateInfoRow(row, label, value);
+}
+
 void classTft::sendBmeData(uint8_t xiaqError, uint16_t Xco2e, float Xbvoc, float Xhum, float Xtemp)
 {
     _co2e = Xco2e;
     _bvoc = Xbvoc;
     _hum = Xhum;
-    _temp = Xtemp;
+
+    _bmeFound = true;
+
+    // readings always arrive in celcius - convert to the units shown on screen
+    _temp = _tempUnits ? (Xtemp * 1.8) + 32 : Xtemp;
 
     // sensor values are no good clear data
     if (xiaqError == 0)
@@ -263,6 +289,44 @@ void classTft::sendPmsData(uint16_t xPM1_0, uint16_t xPM2_5, uint16_t xPM10)
     lv_obj_align_to(_screen.pm10Text, _screen.text6, LV_ALIGN_OUT_BOTTOM_MID, 0, 5);
 }
 
+void classTft::updateAqiCategories(uint8_t xPM2_5, uint8_t xPM10)
+{
+    _PM2_5Category = xPM2_5;
+    _PM10Category = xPM10;
+}
+
+// colours a PM reading by its AQI category - good keeps the normal text colour, the rest use the EPA colours
+void classTft::_setAqiColor(lv_obj_t * text, uint8_t category, uint8_t * color)
+{
+    switch (category)
+    {
+    case AQI_GOOD:
+        *color = _green;
+        lv_obj_set_style_text_color(text, lv_color_make(23, 111, 192), 0);
+        break;
+    case AQI_MODERATE:
+        *color = _yellow;
+        lv_obj_set_style_text_color(text, lv_color_make(255, 255, 0), 0);
+        break;
+    case AQI_USG:
+        *color = _red;
+        lv_obj_set_style_text_color(text, lv_color_make(255, 126, 0), 0);
+        break;
+    case AQI_UNHEALTHY:
+        *color = _red;
+        lv_obj_set_style_text_color(text, lv_color_make(255, 0, 0), 0);
+        break;
+    case AQI_VERY_UNHEALTHY:
+        *color = _red;
+        lv_obj_set_style_text_color(text, lv_color_make(143, 63, 151), 0);
+        break;
+    default:
+        *color = _red;
+        lv_obj_set_style_text_color(text, lv_color_make(126, 0, 35), 0);
+        break;
+    }
+}
+
 void classTft::updateWarnLevels(uint16_t xPM1_0_YELLOW, uint16_t xPM1_0_RED, uint16_t xPM2_5_YELLOW, uint16_t xPM2_5_RED, uint16_t xPM10_YELLOW, uint16_t xPM10_RED)
 {
     _setPoint_PM1_0_YELLOW = xPM1_0_YELLOW;
@@ -325,7 +389,7 @@ void classTft::backLightWake()
 {
     _setBackLight(maxBrightness);
     _backLight = maxBrightness;
-    _lastTftTimeoutIntervalMs = millis();
+    _lastTftTimeoutIntervalMs = monotonicMs();
 }
 
 void classTft::_setBackLight(int val)
@@ -0,0 +1,216 @@
+#include <classTiers.h>
+#include <math.h>
+
+static const uint32_t tierStepS[TIER_COUNT] = {1, TIER_MINUTE_STEP_S, TIER_HOUR_STEP_S};
+static const uint32_t tierCapacity[TIER_COUNT] = {HISTORY_CAPACITY, TIER_MINUTE_CAPACITY, TIER_HOUR_CAPACITY};
+
+classTiers::classTiers() {};
+
+bool classTiers::begin(classHistory *history)
+{
+    for (uint8_t i = 0; i < TIER_COUNT - 1; i++)
+    {
+        tier_t &tier = _tiers[i];
+        tier.stepS = tierStepS[i + 1];
+
+        if (!tier.min.begin(tierCapacity[i + 1]) || !tier.mean.begin(tierCapacity[i + 1]) || !tier.max.begin(tierCapacity[i + 1]))
+            return false;
+    }
+
+    _history = history;
+    _started = false;
+    return true;
+}
+
+void classTiers::update()
+{
+    if (_history == NULL || _history->count() == 0)
+        return;
+
+    uint32_t newest = _history->getNewestTime();
+
+    if (!_started)
+    {
+        for (uint8_t i = 0; i < TIER_COUNT - 1; i++)
+        {
+            _start(_tiers[i], newest / _tiers[i].stepS);
+        }
+        _lastTimeS = newest - 1;
+        _started = true;
+    }
+
+    // a long gap is all empty seconds anyway - no need to walk every one of them
+    if (newest - _lastTimeS > TIER_HOUR_STEP_S)
+    {
+        _lastTimeS = newest - TIER_HOUR_STEP_S;
+    }
+
+    while (_lastTimeS < newest)
+    {
+        _add(++_lastTimeS);
+    }
+}
+
+uint8_t classTiers::selectTier(uint32_t fromS, uint32_t toS, uint16_t maxPoints)
+{
+    uint32_t oldest;
+
+    for (uint8_t tier = 0; tier < TIER_COUNT; tier++)
+    {
+        if ((toS - fromS) / tierStepS[tier] + 1 <= maxPoints && getOldestTime(tier, oldest) && oldest <= fromS)
+            return tier;
+    }
+
+    // nothing reaches back that far yet - settle for the most detail that fits
+    for (uint8_t tier = 0; tier < TIER_COUNT; tier++)
+    {
+        if ((toS - fromS) / tierStepS[tier] + 1 <= maxPoints)
+            return tier;
+    }
+
+    return TIER_COUNT - 1;
+}
+
+uint32_t classTiers::getStepS(uint8_t tier)
+{
+    return tier < TIER_COUNT ? tierStepS[tier] : 0;
+}
+
+bool classTiers::getOldestTime(uint8_t tier, uint32_t &timeS)
+{
+    if (tier == TIER_RAW)
+    {
+        if (_history == NULL || _history->count() == 0)
+            return false;
+
+        timeS = _history->getOldestTime();
+        return true;
+    }
+
+    if (tier >= TIER_COUNT || _tiers[tier - 1].mean.count() == 0)
+        return false;
+
+    timeS = _tiers[tier - 1].mean.getOldestTime() * tierStepS[tier];
+    return true;
+}
+
+bool classTiers::get(uint8_t tier, uint32_t timeS, uint8_t channel, tierPoint_t &point)
+{
+    if (_history == NULL || tier >= TIER_COUNT)
+        return false;
+
+    float scale = recordScale(channel);
+    int32_t value;
+
+    if (tier == TIER_RAW)
+    {
+        if (!recordGet(_history->getAt(timeS), channel, value))
+            return false;
+
+        point.min = point.mean = point.max = value / scale;
+        return true;
+    }
+
+    tier_t &t = _tiers[tier - 1];
+    uint32_t bucket = timeS / t.stepS;
+
+    if (!recordGet(t.mean.getAt(bucket), channel, value))
+        return false;
+    point.mean = value / scale;
+
+    recordGet(t.min.getAt(bucket), channel, value);
+    point.min = value / scale;
+
+    recordGet(t.max.getAt(bucket), channel, value);
+    point.max = value / scale;
+
+    return true;
+}
+
+const sensorRecord_t *classTiers::getMean(uint8_t tier, uint32_t timeS)
+{
+    if (_history == NULL || tier == TIER_RAW || tier >= TIER_COUNT)
+        return NULL;
+
+    tier_t &t = _tiers[tier - 1];
+    const sensorRecord_t *record = t.mean.getAt(timeS / t.stepS);
+
+    if (record == NULL || record->valid == 0)
+        return NULL;
+    return record;
+}
+
+// feeds one second into the bucket it belongs to in every tier, closing any bucket it has moved past
+void classTiers::_add(uint32_t timeS)
+{
+    const sensorRecord_t *record = _history->getAt(timeS);
+    int32_t value;
+
+    for (uint8_t i = 0; i < TIER_COUNT - 1; i++)
+    {
+        tier_t &tier = _tiers[i];
+
+        uint32_t bucket = timeS / tier.stepS;
+        if (bucket != tier.bucket)
+        {
+            _close(tier);
+            _start(tier, bucket);
+        }
+
+        for (uint8_t c = 0; c < RECORD_CHANNEL_COUNT; c++)
+        {
+            if (!recordGet(record, c, value))
+                continue;
+
+            if (tier.count[c] == 0 || value < tier.low[c])
+                tier.low[c] = value;
+            if (tier.count[c] == 0 || value > tier.high[c])
+                tier.high[c] = value;
+
+            tier.sum[c] += value;
+            tier.count[c]++;
+        }
+    }
+}
+
+void classTiers::_start(tier_t &tier, uint32_t bucket)
+{
+    tier.bucket = bucket;
+    for (uint8_t c = 0; c < RECORD_CHANNEL_COUNT; c++)
+    {
+        tier.sum[c] = 0;
+        tier.count[c] = 0;
+    }
+}
+
+// stores the finished bucket - a bucket with no readings at all is left as a gap
+void classTiers::_close(tier_t &tier)
+{
+    sensorRecord_t low = {};
+    sensorRecord_t mean = {};
+    sensorRecord_t high = {};
+
+    for (uint8_t c = 0; c < RECORD_CHANNEL_COUNT; c++)
+    {
+        if (tier.count[c] == 0)
+            continue;
+
+        recordSet(low, c, tier.low[c]);
+        recordSet(mean, c, lround((double)tier.sum[c] / tier.count[c]));
+        recordSet(high, c, tier.high[c]);
+    }
+
+    uint8_t valid = 0;
+    if (tier.count[RECORD_PM2_5] > 0)
+        valid |= RECORD_VALID_PMS;
+    if (tier.count[RECORD_TEMP] > 0)
+        valid |= RECORD_VALID_BME;
+
+    if (valid == 0)
+        return;
+
+    low.valid = mean.valid = high.valid = valid;
+    tier.min.append(tier.bucket, low);
+    tier.mean.append(tier.bucket, mean);
+    tier.max.append(tier.bucket, high);
+}
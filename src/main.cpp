@@ -21,12 +21,23 @@ OXRS_S3 oxrs;
 
 #include <SPI.h>  // For SPI
 #include <Wire.h> // For I2C
-
-#include <EEPROM.h>
-#include <bsec.h> // Library for the BME680 sensor
-
-#include <Plantower_PMS7003.h> // Library for the AQS sensor
-
+#include <LittleFS.h> // For the sample log
+
+#include "classQueue.h" // lock-free queues between the sensor, network and UI tasks
+#include "classScheduler.h" // 64-bit clock and periodic jobs
+#include "classHistory.h" // per-second sensor history
+#include "classStats.h" // rolling statistics over the history
+#include "classTiers.h" // per-minute and per-hour downsampled history
+#include "classAqi.h" // US-EPA AQI and NowCast
+#include "classLog.h" // crash-safe sample log on flash
+#include "classBackfill.h" // telemetry held through MQTT outages
+#include "classPublisher.h" // publish retries with backoff
+#include "classTelemetry.h" // allocation free telemetry payloads
+#include "classDeadband.h" // change driven telemetry
+#include "classBme.h" // custom library with the BME680 / BSEC handling
+#include "classPms.h" // custom library with the PMS7003 frame handling
+#include "classFilter.h" // median / Hampel spike filter
+#include "classHumidity.h" // hygroscopic growth correction for the PM readings
 #include "classTft.h" // custom library with the Tft handling
 
 /*--------------------------- Constants -------------------------------*/
@@ -41,33 +52,45 @@ OXRS_S3 oxrs;
 #define DEFAULT_TFT_INTERVAL_MS 1000
 #define TFT_INTERVAL_MS_MAX 60000
 
+// default pace of publishing telemetry held during an outage, once MQTT is back
+#define DEFAULT_BACKFILL_INTERVAL_MS 1000
+#define BACKFILL_INTERVAL_MS_MAX 60000
+
+// how often the latest readings are added to the history
+#define HISTORY_INTERVAL_MS 1000
+
+// points returned by the history REST endpoint
+#define DEFAULT_HISTORY_POINTS 120
+#define HISTORY_POINTS_MAX 240
+
 // Temperature units
 #define TEMP_C 0
 #define TEMP_F 1
 
+// Tasks - sensor acquisition on the PRO core, LVGL rendering next to the Arduino loop (networking) on the APP core
+#define SENSOR_TASK_CORE 0
+#define SENSOR_TASK_PRIORITY 2
+#define SENSOR_TASK_STACK_SIZE 8192
+#define UI_TASK_CORE 1
+#define UI_TASK_PRIORITY 1
+#define UI_TASK_STACK_SIZE 8192
+
+// longest the sensor task will sleep for when no sensor work is due
+#define SENSOR_TASK_IDLE_MAX_MS 10
+// how often the UI task checks for new commands and samples
+#define UI_TASK_PERIOD_MS 10
+// yield between network loop passes so the UI task on the same core gets a look in
+#define NETWORK_LOOP_IDLE_MS 5
+
+// task queue sizes - must be a power of 2
+#define SAMPLE_QUEUE_SIZE 16
+#define COMMAND_QUEUE_SIZE 16
+// the info screen refresh sends a command per row, so the UI gets more room
+#define UI_COMMAND_QUEUE_SIZE 32
+
 // ESP efuse ID
 uint32_t chipId = 0;
 
-/*--------------------------- BME Bosch Helpers -------------------------------*/
-
-const uint8_t bsec_config_iaq[] =
-    {
-#include "resources/bsec_iaq.txt"
-};
-
-bsec_virtual_sensor_t sensorList[5] = {
-    BSEC_OUTPUT_IAQ,
-    BSEC_OUTPUT_CO2_EQUIVALENT,
-    BSEC_OUTPUT_BREATH_VOC_EQUIVALENT,
-    BSEC_OUTPUT_SENSOR_HEAT_COMPENSATED_TEMPERATURE,
-    BSEC_OUTPUT_SENSOR_HEAT_COMPENSATED_HUMIDITY,
-};
-
-uint8_t bsecState[BSEC_MAX_STATE_BLOB_SIZE] = {0};
-uint16_t stateUpdateCounter = 0;
-
-#define STATE_SAVE_PERIOD UINT32_C(360 * 60 * 1000) // 360 minutes - 4 times a day
-
 /*--------------------------- Global Variables ------------------------*/
 // How often to send sensor data to MQTT
 uint32_t telemetryIntervalMs = DEFAULT_TELEMETRY_INTERVAL_MS;
@@ -75,39 +98,217 @@ uint32_t telemetryIntervalMs = DEFAULT_TELEMETRY_INTERVAL_MS;
 // How often to send sensor data to TFT
 uint32_t tftIntervalMs = DEFAULT_TFT_INTERVAL_MS;
 
-// Last time sensor data was sent to MQTT
-uint32_t lastTelemetryMs = 0L;
-
-// Last time sensor data was sent to TFT
-uint32_t lastTftMs = 0L;
-
-// Publish Home Assistant self-discovery config for each sensor
-bool hassDiscoveryPublished[8];
-
-// Saving gathered sensor data from PMS sensor
-uint16_t PM1_0 = 0;
-uint16_t PM2_5 = 0;
-uint16_t PM10 = 0;
-
-// Saving gathered sensor data from BME sensor
-uint8_t iaqAccuracy = 0;
-uint16_t co2e = 0;
-float bvoc = 0.0;
-float temp = 0.0;
-float hum = 0.0;
+// How often to publish a backfill batch
+uint32_t backfillIntervalMs = DEFAULT_BACKFILL_INTERVAL_MS;
+
+// Periodic jobs run from loop()
+classScheduler scheduler;
+int8_t telemetryJob = SCHEDULER_NO_JOB;
+int8_t backfillJob = SCHEDULER_NO_JOB;
+
+// Home Assistant self-discovery config for each sensor - serialised once, then announced one sensor a tick
+#define HASS_SENSOR_COUNT 8
+#define HASS_DISCOVERY_INTERVAL_MS 250
+#define HASS_STATE_REBUILD 0  // payloads out of date - rebuild them, then announce them all
+#define HASS_STATE_ANNOUNCE 1 // announcing, from hassNext on
+#define HASS_STATE_DONE 2     // everything announced, until the config changes or MQTT reconnects
+uint8_t hassState = HASS_STATE_REBUILD;
+uint8_t hassNext = 0;
+uint32_t hassConnects = 0;
+
+// every sensor's serialised config back to back - a payload that didn't fit has a length of 0 and is skipped
+#define HASS_PAYLOAD_BUFFER_SIZE 6144
+char hassPayloads[HASS_PAYLOAD_BUFFER_SIZE];
+uint16_t hassPayloadOffset[HASS_SENSOR_COUNT];
+uint16_t hassPayloadLength[HASS_SENSOR_COUNT];
+
+// the units the payloads were built with and the last discovery prefix configured - a config update only rebuilds when one changes
+// (the prefix starts as the Home Assistant default, same as OXRS_HASS)
+uint8_t hassTempUnits = 0xFF;
+char hassTopicPrefix[64] = "homeassistant";
+
+// Latest readings from both sensors (valid bits say which have reported)
+sensorRecord_t current = {};
+
+// The last 24 hours of readings, one record per second
+classHistory history;
+
+// Rolling mean/stddev/min/max of each reading - indexed by RECORD_xxx and STATS_WINDOW_xxx
+classStats stats;
+const char *recordChannelName[RECORD_CHANNEL_COUNT] = {"PM1_0", "PM2_5", "PM10", "temperature", "humidity", "co2e", "bvoc"};
+const char *statsWindowName[STATS_WINDOW_COUNT] = {"1m", "15m", "1h"};
+
+// bitmask of stats windows to publish in telemetry and show on the info screen (bit n = statsWindowName[n])
+uint8_t statsWindows = 0;
+
+// A day of per-minute and a month of per-hour min/mean/max
+classTiers tiers;
+
+// Telemetry encoder - keys are rendered once by buildTelemetryTemplate(), the fixed ones first in TELE_KEY_xxx order
+classTelemetry telemetry;
+#define TELE_KEY_AQI 0
+#define TELE_KEY_AQI_CATEGORY 1
+#define TELE_KEY_AQI_POLLUTANT 2
+#define TELE_KEY_PMS_REJECTED 3
+#define TELE_KEY_PMS_STATE 4
+#define TELE_KEY_PMS_SAMPLE_AGE 5
+#define TELE_KEY_IAQ_ACCURACY 6
+#define TELE_KEY_BSEC_JITTER 7
+#define TELE_KEY_STATS 8
+#define TELE_KEY_MEAN 9
+#define TELE_KEY_SD 10
+#define TELE_KEY_MIN 11
+#define TELE_KEY_MAX 12
+#define TELE_KEY_SENT 13
+#define TELE_KEY_SUPPRESSED 14
+#define TELE_KEY_BOOT 15
+#define TELE_KEY_UPTIME 16
+#define TELE_KEY_OFFSETS 17
+#define TELE_KEY_AGE 18
+#define TELE_KEY_PUBLISH_QUEUE 19
+#define TELE_KEY_PUBLISH_FAILURES 20
+#define TELE_KEY_FIXED_COUNT 21
+const char *teleKeyName[TELE_KEY_FIXED_COUNT] = {"aqi", "aqiCategory", "aqiPollutant", "pmsRejected", "pmsState", "pmsSampleAgeS", "iaqAccuracy", "bsecJitterMs", "stats", "mean", "sd", "min", "max", "telemetrySent", "telemetrySuppressed", "boot", "uptimeMs", "offsetsMs", "ageMs", "publishQueue", "publishFailures"};
+
+// first key of each group built from a channel list - the rest follow in channel order
+int8_t teleKeyRecord;
+int8_t teleKeyCorrected;
+int8_t teleKeyPmsChannel;
+int8_t teleKeyBmeOutput;
+int8_t teleKeyNowCast;
+int8_t teleKey24h;
+int8_t teleKeyStatsWindow;
+
+// Which readings have moved enough to publish - indexed by RECORD_xxx
+classDeadband deadband;
+
+// Batched telemetry - samples taken each telemetry interval and published together on tele/.../batch
+#define TELEMETRY_BATCH_MAX 30 // what fits in the telemetry encoder's buffer with every reading
+#define TELEMETRY_BATCH_S_MAX 3600
+#define TELEMETRY_BATCH_SUBTOPIC "batch"
+uint8_t telemetryBatchSize = 1; // 1 publishes every sample on its own, as normal
+uint16_t telemetryBatchS = 0;   // zero sends a batch only once it is full
+sensorRecord_t batchRecord[TELEMETRY_BATCH_MAX];
+uint32_t batchOffsetMs[TELEMETRY_BATCH_MAX];
+uint64_t batchStartMs = 0;
+uint8_t batchCount = 0;
+
+// Telemetry wire formats - JSON on tele/..., CBOR (RFC 8949) on tele/.../cbor, or both
+#define TELEMETRY_WIRE_JSON (1 << TELEMETRY_FORMAT_JSON)
+#define TELEMETRY_WIRE_CBOR (1 << TELEMETRY_FORMAT_CBOR)
+#define TELEMETRY_CBOR_SUBTOPIC "cbor"
+#define TELEMETRY_BATCH_CBOR_SUBTOPIC "batch/cbor"
+uint8_t telemetryWire = TELEMETRY_WIRE_JSON;
+
+// Telemetry taken while MQTT was down - published afterwards, a batch every backfillIntervalMs, on tele/.../backfill
+#define BACKFILL_BATCH_MAX 10
+#define BACKFILL_SUBTOPIC "backfill"
+#define BACKFILL_CBOR_SUBTOPIC "backfill/cbor"
+classBackfill backfill;
+sensorRecord_t backfillRecord[BACKFILL_BATCH_MAX];
+uint32_t backfillOffsetMs[BACKFILL_BATCH_MAX];
+uint64_t backfillStartMs = 0;
+uint8_t backfillCount = 0;
+
+// Every telemetry payload goes out through here - failed publishes are held and retried with backoff
+classPublisher publisher;
+
+// outcome of publishing a payload
+#define PUBLISH_FAILED 0
+#define PUBLISH_SENT 1    // sent, or queued in the publisher for retry
+#define PUBLISH_SKIPPED 2 // nothing to publish, or it would never fit
+
+// Per-minute means kept on flash across reboots
+classLog sampleLog;
+uint32_t sampleLogMinute = 0;
+
+// US-EPA AQI from the PM readings
+classAqi aqi;
+const char *aqiPollutantName[AQI_POLLUTANT_COUNT] = {"PM2_5", "PM10"};
+
+// Optional PMS channels - the rest of each sample (CF=1 values and particle count bins), live only and not kept in the history
+#define PMS_CHANNEL_COUNT 9
+const char *pmsChannelName[PMS_CHANNEL_COUNT] = {"PM1_0_CF1", "PM2_5_CF1", "PM10_CF1", "N0_3", "N0_5", "N1_0", "N2_5", "N5_0", "N10"};
+const char *pmsChannelLabel[PMS_CHANNEL_COUNT] = {"CF1 1.0:", "CF1 2.5:", "CF1 10:", ">0.3um:", ">0.5um:", ">1.0um:", ">2.5um:", ">5.0um:", ">10um:"};
+// data word in the PMS frame for each channel
+const uint8_t pmsChannelWord[PMS_CHANNEL_COUNT] = {0, 1, 2, 6, 7, 8, 9, 10, 11};
+uint16_t pmsChannelValue[PMS_CHANNEL_COUNT];
+
+// bitmask of enabled optional PMS channels (bit n = pmsChannelName[n])
+uint16_t pmsChannels = 0;
+
+// PMS duty cycle
+uint16_t pmsSampleIntervalS = DEFAULT_PMS_SAMPLE_INTERVAL_S;
+uint8_t pmsWarmupS = DEFAULT_PMS_WARMUP_S;
+uint8_t pmsSampleFrames = DEFAULT_PMS_SAMPLE_FRAMES;
+
+// PMS spike filter - indexed by PMS_FILTER_xxx
+#define PMS_FILTER_PM1_0 0
+#define PMS_FILTER_PM2_5 1
+#define PMS_FILTER_PM10 2
+#define PMS_FILTER_COUNT 3
+const char *pmsFilterName[PMS_FILTER_COUNT] = {"PM1_0", "PM2_5", "PM10"};
+
+// bitmask of filtered PMS readings (bit n = pmsFilterName[n]) and the filter settings
+uint8_t pmsFilterChannels = 0;
+uint8_t pmsFilterMode = FILTER_MODE_HAMPEL;
+uint8_t pmsFilterWindow = DEFAULT_FILTER_WINDOW;
+float pmsFilterThreshold = DEFAULT_FILTER_THRESHOLD;
+
+// the filters themselves belong to the sensor task - the settings above reach it as a command
+classFilter pmsFilter[PMS_FILTER_COUNT];
+uint8_t pmsFilterEnabled = 0;
+uint32_t pmsFilterRejected = 0;
+
+// PMS readings replaced as spikes since boot (as last reported by the sensor task)
+uint32_t pmsRejected = 0;
+
+// PMS duty cycle state and when the latest sample was taken (as last reported by the sensor task)
+uint8_t pmsState = PMS_STATE_CONTINUOUS;
+uint64_t pmsSampleMs = 0;
+
+// PM readings corrected to dry-equivalent with the BME humidity - published next to the raw ones
+classHumidity humidity;
+float humidityKappa = DEFAULT_HUMIDITY_KAPPA;
+float humidityDensity = DEFAULT_HUMIDITY_DENSITY;
+
+// Subscribed optional BSEC outputs and their latest values
+uint8_t bmeExtraOutputs = 0;
+float bmeExtraOutputValue[BME_EXTRA_OUTPUT_COUNT];
+
+// worst lateness of a BSEC call since the last telemetry report
+uint32_t bsecJitterMaxMs = 0;
 
 // Variable for mode that the button is in - true means button directly controls screen
 bool buttonControl = true;
 
-// BME IC Found
+// BME IC Found - set from the first BME sample, as the network loop never reads the sensor task's state
 bool bmeFound = false;
 
 // PMS IC Found
 bool pmsFound = false;
 
+// Boot phases - each is timed from whichever task runs it, indexed by BOOT_PHASE_xxx
+#define BOOT_PHASE_ESP_INFO 0
+#define BOOT_PHASE_DISPLAY 1
+#define BOOT_PHASE_PMS_UART 2
+#define BOOT_PHASE_I2C_SCAN 3
+#define BOOT_PHASE_BSEC 4
+#define BOOT_PHASE_NETWORK 5
+#define BOOT_PHASE_FIRST_READING 6 // a milestone rather than a phase - starts and ends together
+#define BOOT_PHASE_COUNT 7
+const char *bootPhaseName[BOOT_PHASE_COUNT] = {"espInfo", "display", "pmsUart", "i2cScan", "bsec", "network", "firstReading"};
+
+// start and end of each phase in us since power on - zero until it has happened
+uint32_t bootPhaseUs[BOOT_PHASE_COUNT][2];
+bool bootTimesPublished = false;
+
 // unit used for BME sensor output
 uint8_t tempUnits = TEMP_C;
 
+// optional BSEC outputs - indexed by BME_OUTPUT_xxx
+const char *bmeOutputName[BME_EXTRA_OUTPUT_COUNT] = {"staticIaq", "gasResistance", "stabStatus", "runInStatus"};
+
 // used to build Home assitant auto discovery
 const char *name[8] = {"Temperature", "Humidity", "CO2 Equivalent", "Breath VOC", "AQI Accuracy", "PM1.0", "PM2.5", "PM10"};
 const char *nameClass[8] = {"temperature", "humidity", "aqi", "aqi", "aqi", "PM1", "PM25", "PM10"};
@@ -117,6 +318,113 @@ const char *nameUnits[8] = {"0", "%", "PPM", "PPM", "#", "µg/m³", "µg/m³", "
 // used for the button library mqtt message
 char mqttMessageBuffer[64];
 
+/*--------------------------- Task Messages ---------------------------*/
+// Sensor readings - sensor task to the network loop and the UI task
+#define SAMPLE_PMS 0
+#define SAMPLE_BME 1
+#define SAMPLE_PMS_STATE 2 // duty cycle change with no new reading - network loop only
+
+typedef struct
+{
+  uint8_t source;
+  union
+  {
+    struct
+    {
+      uint16_t pm1_0;
+      uint16_t pm2_5;
+      uint16_t pm10;
+      uint16_t channels[PMS_CHANNEL_COUNT];
+      uint32_t rejected;
+      uint8_t state;     // PMS_STATE_xxx
+      uint64_t sampleMs; // when the reading was taken
+    } pms;
+    struct
+    {
+      uint8_t iaqAccuracy;
+      float co2e;
+      float bvoc;
+      float temp; // always celcius
+      float hum;
+      uint8_t extraOutputs;
+      float extra[BME_EXTRA_OUTPUT_COUNT];
+      uint32_t jitterMs;
+    } bme;
+  };
+} sensorSample_t;
+
+// Screen updates - network loop to the UI task (the only task allowed to touch LVGL)
+#define UI_CMD_BACKLIGHT_WAKE 0
+#define UI_CMD_NEXT_SCREEN 1
+#define UI_CMD_WIFI_STATUS 2
+#define UI_CMD_INFO_DATA 3
+#define UI_CMD_INFO_ROW 4
+#define UI_CMD_INFO_ROW_COUNT 5
+#define UI_CMD_TEMP_UNITS 6
+#define UI_CMD_WARN_LEVELS 7
+#define UI_CMD_SLEEP_TIMEOUT 8
+#define UI_CMD_MAX_BRIGHTNESS 9
+#define UI_CMD_AQI_CATEGORIES 10
+#define UI_CMD_WARNING_MODE 11
+
+typedef struct
+{
+  uint8_t type;
+  union
+  {
+    struct
+    {
+      bool wifi;
+      bool mqtt;
+    } wifiStatus;
+    struct
+    {
+      char mac[40];
+      char ip[40];
+      char mqtt[40];
+    } infoData;
+    struct
+    {
+      uint8_t row;
+      char label[16];
+      char value[24];
+    } infoRow;
+    uint16_t warnLevels[6];
+    uint8_t aqiCategories[AQI_POLLUTANT_COUNT];
+    uint32_t value;
+  };
+} uiCommand_t;
+
+// Sensor settings - network loop to the sensor task
+#define SENSOR_CMD_TEMP_OFFSET 0
+#define SENSOR_CMD_BME_RATE 1
+#define SENSOR_CMD_BME_OUTPUTS 2
+#define SENSOR_CMD_PMS_DUTY_CYCLE 3
+#define SENSOR_CMD_PMS_FILTER 4
+
+typedef struct
+{
+  uint8_t type;
+  union
+  {
+    float tempOffset;
+    struct
+    {
+      uint16_t intervalS;
+      uint8_t warmupS;
+      uint8_t frames;
+    } dutyCycle;
+    struct
+    {
+      uint8_t channels;
+      uint8_t mode;
+      uint8_t window;
+      float threshold;
+    } filter;
+    uint8_t value;
+  };
+} sensorCommand_t;
+
 /*--------------------------- Instantiate Globals ---------------------*/
 // home assistant discovery config
 OXRS_HASS hass(oxrs.getMQTT());
@@ -128,81 +436,37 @@ OXRS_Input oxrsInput;
 HardwareSerial &comm = Serial1;
 
 // BME680
-Bsec bme;
+classBme bme = classBme();
 
 // PMS7003
-Plantower_PMS7003 pms7003 = Plantower_PMS7003();
+classPms pms = classPms();
 
 // TFT
 classTft display = classTft();
 
-/*--------------------------- Bosch BME helpers ---------------------------------*/
-
-void bmeLoadState(void)
-{
-  if (EEPROM.read(0) == BSEC_MAX_STATE_BLOB_SIZE)
-  {
-    // Existing state in EEPROM
-    Serial.println("Reading state from EEPROM");
-
-    for (uint8_t i = 0; i < BSEC_MAX_STATE_BLOB_SIZE; i++)
-    {
-      bsecState[i] = EEPROM.read(i + 1);
-    }
+// Task queues - each has exactly one producer and one consumer task
+classQueue<sensorSample_t, SAMPLE_QUEUE_SIZE> netSampleQueue;
+classQueue<sensorSample_t, SAMPLE_QUEUE_SIZE> uiSampleQueue;
+classQueue<uiCommand_t, UI_COMMAND_QUEUE_SIZE> uiCommandQueue;
+classQueue<sensorCommand_t, COMMAND_QUEUE_SIZE> sensorCommandQueue;
 
-    bme.setState(bsecState);
-  }
-  else
-  {
-    // Erase the EEPROM with zeroes
-    Serial.println("Erasing EEPROM");
+TaskHandle_t sensorTaskHandle = NULL;
+TaskHandle_t uiTaskHandle = NULL;
 
-    for (uint8_t i = 0; i < BSEC_MAX_STATE_BLOB_SIZE + 1; i++)
-      EEPROM.write(i, 0);
+/*--------------------------- Task helpers ---------------------------------*/
 
-    EEPROM.commit();
-  }
+void sendUiCommand(uint8_t type, uint32_t value = 0)
+{
+  uiCommand_t command;
+  command.type = type;
+  command.value = value;
+  uiCommandQueue.push(command);
 }
 
-void bmeUpdateState(void)
+void sendSensorCommand(sensorCommand_t &command, uint8_t type)
 {
-  bool update = false;
-  if (stateUpdateCounter == 0)
-  {
-    /* First state update when IAQ accuracy is >= 3 */
-    if (bme.iaqAccuracy >= 3)
-    {
-      update = true;
-      stateUpdateCounter++;
-    }
-  }
-  else
-  {
-    /* Update every STATE_SAVE_PERIOD minutes */
-    if ((stateUpdateCounter * STATE_SAVE_PERIOD) < millis())
-    {
-      update = true;
-      stateUpdateCounter++;
-    }
-  }
-
-  if (update)
-  {
-    bme.getState(bsecState);
-
-    if (bme.bsecStatus == BSEC_OK && bme.bme68xStatus == BME68X_OK)
-    {
-      Serial.println("Writing state to EEPROM");
-
-      for (uint8_t i = 0; i < BSEC_MAX_STATE_BLOB_SIZE; i++)
-      {
-        EEPROM.write(i + 1, bsecState[i]);
-      }
-
-      EEPROM.write(0, BSEC_MAX_STATE_BLOB_SIZE);
-      EEPROM.commit();
-    }
-  }
+  command.type = type;
+  sensorCommandQueue.push(command);
 }
 
 /*--------------------------- MQTT ---------------------------------*/
@@ -228,13 +492,13 @@ void jsonCommand(JsonVariant json)
 {
   if (json["backLight"].is<bool>())
   {
-    display.backLightWake();
+    sendUiCommand(UI_CMD_BACKLIGHT_WAKE);
   }
 
   if (json["nextScreen"].is<bool>())
   {
-    display.backLightWake();
-    display.nextScreen();
+    sendUiCommand(UI_CMD_BACKLIGHT_WAKE);
+    sendUiCommand(UI_CMD_NEXT_SCREEN);
   }
 }
 
@@ -250,6 +514,78 @@ void setConfigSchema()
   telemetryIntervalMs["minimum"] = 1;
   telemetryIntervalMs["maximum"] = TELEMETRY_INTERVAL_MS_MAX;
 
+  JsonObject telemetryDeadbands = json["telemetryDeadbands"].to<JsonObject>();
+  telemetryDeadbands["title"] = "Telemetry Deadbands";
+  telemetryDeadbands["description"] = "Only publish a reading once it has moved more than this (an absolute step or a percentage of the last value sent, whichever is larger) - readings without a deadband are published every interval. Temperature steps are in Celsius.";
+  telemetryDeadbands["type"] = "array";
+  JsonObject telemetryDeadbandsItems = telemetryDeadbands["items"].to<JsonObject>();
+  telemetryDeadbandsItems["type"] = "object";
+  JsonObject telemetryDeadbandsProperties = telemetryDeadbandsItems["properties"].to<JsonObject>();
+
+  JsonObject deadbandChannel = telemetryDeadbandsProperties["channel"].to<JsonObject>();
+  deadbandChannel["title"] = "Reading";
+  deadbandChannel["type"] = "string";
+  JsonArray deadbandChannelEnum = deadbandChannel["enum"].to<JsonArray>();
+  for (uint8_t c = 0; c < RECORD_CHANNEL_COUNT; c++)
+  {
+    deadbandChannelEnum.add(recordChannelName[c]);
+  }
+
+  JsonObject deadbandAbsolute = telemetryDeadbandsProperties["absolute"].to<JsonObject>();
+  deadbandAbsolute["title"] = "Absolute Step";
+  deadbandAbsolute["type"] = "number";
+  deadbandAbsolute["minimum"] = 0;
+
+  JsonObject deadbandPercent = telemetryDeadbandsProperties["percent"].to<JsonObject>();
+  deadbandPercent["title"] = "Relative Step (%)";
+  deadbandPercent["type"] = "number";
+  deadbandPercent["minimum"] = 0;
+  deadbandPercent["maximum"] = 100;
+
+  JsonArray telemetryDeadbandsRequired = telemetryDeadbandsItems["required"].to<JsonArray>();
+  telemetryDeadbandsRequired.add("channel");
+
+  JsonObject telemetryHeartbeatS = json["telemetryHeartbeatS"].to<JsonObject>();
+  telemetryHeartbeatS["title"] = "Telemetry Heartbeat (s)";
+  telemetryHeartbeatS["description"] = "Longest time telemetry is held back when no reading has moved beyond its deadband - every reading is published then (defaults to 60s)";
+  telemetryHeartbeatS["type"] = "integer";
+  telemetryHeartbeatS["minimum"] = 1;
+  telemetryHeartbeatS["maximum"] = DEADBAND_HEARTBEAT_S_MAX;
+
+  JsonObject telemetryBatchSize = json["telemetryBatchSize"].to<JsonObject>();
+  telemetryBatchSize["title"] = "Telemetry Batch Size";
+  telemetryBatchSize["description"] = "Collect this many samples (one per telemetry interval) and publish them together as columns of values on the tele/.../batch topic, for high rate logging. The normal telemetry (and Home Assistant) isn't updated while batching (defaults to 1, no batching).";
+  telemetryBatchSize["type"] = "integer";
+  telemetryBatchSize["minimum"] = 1;
+  telemetryBatchSize["maximum"] = TELEMETRY_BATCH_MAX;
+
+  JsonObject telemetryBatchS = json["telemetryBatchS"].to<JsonObject>();
+  telemetryBatchS["title"] = "Telemetry Batch Age (s)";
+  telemetryBatchS["description"] = "Publish a batch once its first sample is this old, even if it isn't full (defaults to 0, only when full)";
+  telemetryBatchS["type"] = "integer";
+  telemetryBatchS["minimum"] = 0;
+  telemetryBatchS["maximum"] = TELEMETRY_BATCH_S_MAX;
+
+  JsonObject telemetryFormat = json["telemetryFormat"].to<JsonObject>();
+  telemetryFormat["title"] = "Telemetry Format";
+  telemetryFormat["description"] = "Publish telemetry as JSON (default), as CBOR on the tele/.../cbor topic (about half the size, for constrained links and binary-aware consumers), or both. Home Assistant needs the JSON.";
+  telemetryFormat["type"] = "string";
+  JsonArray telemetryFormatEnum = telemetryFormat["enum"].to<JsonArray>();
+  telemetryFormatEnum.add("json");
+  telemetryFormatEnum.add("cbor");
+  telemetryFormatEnum.add("both");
+  JsonArray telemetryFormatEnumNames = telemetryFormat["enumNames"].to<JsonArray>();
+  telemetryFormatEnumNames.add("JSON");
+  telemetryFormatEnumNames.add("CBOR");
+  telemetryFormatEnumNames.add("JSON and CBOR");
+
+  JsonObject backfillIntervalMs = json["backfillIntervalMs"].to<JsonObject>();
+  backfillIntervalMs["title"] = "Backfill Interval (ms)";
+  backfillIntervalMs["description"] = "Telemetry taken while MQTT was down is published afterwards on the tele/.../backfill topic, up to 10 samples at a time - this is how often (defaults to 1000ms, i.e. 1 second)";
+  backfillIntervalMs["type"] = "integer";
+  backfillIntervalMs["minimum"] = 1;
+  backfillIntervalMs["maximum"] = BACKFILL_INTERVAL_MS_MAX;
+
   JsonObject tftIntervalMs = json["tftIntervalMs"].to<JsonObject>();
   tftIntervalMs["title"] = "Tft Interval (ms)";
   tftIntervalMs["description"] = "How often to update the screen data (defaults to 1000ms, i.e. 1 second)";
@@ -276,6 +612,128 @@ void setConfigSchema()
   tempUnitsEnumNames.add("celcius");
   tempUnitsEnumNames.add("farenhite");
 
+  JsonObject bmeSampleRate = json["bmeSampleRate"].to<JsonObject>();
+  bmeSampleRate["title"] = "BME Sample Rate";
+  bmeSampleRate["description"] = "How often BSEC measures - ultra low power (every 5 minutes), low power (every 3 seconds, default) or continuous (every second). Trades latency against power, applied without a restart.";
+  bmeSampleRate["type"] = "string";
+  JsonArray bmeSampleRateEnum = bmeSampleRate["enum"].to<JsonArray>();
+  bmeSampleRateEnum.add("ulp");
+  bmeSampleRateEnum.add("lp");
+  bmeSampleRateEnum.add("cont");
+  JsonArray bmeSampleRateEnumNames = bmeSampleRate["enumNames"].to<JsonArray>();
+  bmeSampleRateEnumNames.add("ultra low power");
+  bmeSampleRateEnumNames.add("low power");
+  bmeSampleRateEnumNames.add("continuous");
+
+  JsonObject bmeOutputs = json["bmeOutputs"].to<JsonObject>();
+  bmeOutputs["title"] = "BME Extra Outputs";
+  bmeOutputs["description"] = "Extra BSEC outputs to subscribe to and publish - static IAQ, raw gas resistance (ohms), stabilization and run-in status (defaults to none)";
+  bmeOutputs["type"] = "array";
+  bmeOutputs["uniqueItems"] = true;
+  JsonObject bmeOutputsItems = bmeOutputs["items"].to<JsonObject>();
+  bmeOutputsItems["type"] = "string";
+  JsonArray bmeOutputsEnum = bmeOutputsItems["enum"].to<JsonArray>();
+  for (uint8_t i = 0; i < BME_EXTRA_OUTPUT_COUNT; i++)
+  {
+    bmeOutputsEnum.add(bmeOutputName[i]);
+  }
+
+  JsonObject pmsChannels = json["pmsChannels"].to<JsonObject>();
+  pmsChannels["title"] = "PMS Extra Channels";
+  pmsChannels["description"] = "Extra PMS7003 values to publish and show on the info screen - CF=1 concentrations (ug/m^3) and particle counts beyond each size (per 0.1L of air). Live values only, they are not kept in the on-device history or log (defaults to none)";
+  pmsChannels["type"] = "array";
+  pmsChannels["uniqueItems"] = true;
+  JsonObject pmsChannelsItems = pmsChannels["items"].to<JsonObject>();
+  pmsChannelsItems["type"] = "string";
+  JsonArray pmsChannelsEnum = pmsChannelsItems["enum"].to<JsonArray>();
+  for (uint8_t i = 0; i < PMS_CHANNEL_COUNT; i++)
+  {
+    pmsChannelsEnum.add(pmsChannelName[i]);
+  }
+
+  JsonObject pmsSampleIntervalS = json["pmsSampleIntervalS"].to<JsonObject>();
+  pmsSampleIntervalS["title"] = "PMS Sample Interval (seconds)";
+  pmsSampleIntervalS["description"] = "Sleep the PMS sensor between readings, waking it every this many seconds to take one averaged sample (defaults to 0 which keeps the sensor running continuously). Should be longer than the warm up plus sample time.";
+  pmsSampleIntervalS["type"] = "integer";
+  pmsSampleIntervalS["minimum"] = 0;
+  pmsSampleIntervalS["maximum"] = PMS_SAMPLE_INTERVAL_S_MAX;
+
+  JsonObject pmsWarmupS = json["pmsWarmupS"].to<JsonObject>();
+  pmsWarmupS["title"] = "PMS Warm Up (seconds)";
+  pmsWarmupS["description"] = "How long to let the PMS fan and laser settle after waking before sampling (defaults to 30 seconds)";
+  pmsWarmupS["type"] = "integer";
+  pmsWarmupS["minimum"] = 0;
+  pmsWarmupS["maximum"] = PMS_WARMUP_S_MAX;
+
+  JsonObject pmsSampleFrames = json["pmsSampleFrames"].to<JsonObject>();
+  pmsSampleFrames["title"] = "PMS Frames Per Sample";
+  pmsSampleFrames["description"] = "How many frames to average into each sample when the PMS is duty cycled (defaults to 5)";
+  pmsSampleFrames["type"] = "integer";
+  pmsSampleFrames["minimum"] = 1;
+  pmsSampleFrames["maximum"] = PMS_SAMPLE_FRAMES_MAX;
+
+  JsonObject pmsFilter = json["pmsFilter"].to<JsonObject>();
+  pmsFilter["title"] = "PMS Spike Filter";
+  pmsFilter["description"] = "PMS readings to pass through the spike filter before they are published or shown (defaults to none)";
+  pmsFilter["type"] = "array";
+  pmsFilter["uniqueItems"] = true;
+  JsonObject pmsFilterItems = pmsFilter["items"].to<JsonObject>();
+  pmsFilterItems["type"] = "string";
+  JsonArray pmsFilterEnum = pmsFilterItems["enum"].to<JsonArray>();
+  for (uint8_t i = 0; i < PMS_FILTER_COUNT; i++)
+  {
+    pmsFilterEnum.add(pmsFilterName[i]);
+  }
+
+  JsonObject pmsFilterMode = json["pmsFilterMode"].to<JsonObject>();
+  pmsFilterMode["title"] = "PMS Spike Filter Mode";
+  pmsFilterMode["description"] = "hampel only replaces readings that stand out from the recent ones, median smooths every reading (defaults to hampel)";
+  pmsFilterMode["type"] = "string";
+  JsonArray pmsFilterModeEnum = pmsFilterMode["enum"].to<JsonArray>();
+  pmsFilterModeEnum.add("hampel");
+  pmsFilterModeEnum.add("median");
+
+  JsonObject pmsFilterWindow = json["pmsFilterWindow"].to<JsonObject>();
+  pmsFilterWindow["title"] = "PMS Spike Filter Window";
+  pmsFilterWindow["description"] = "How many of the latest readings the filter looks at (defaults to 5)";
+  pmsFilterWindow["type"] = "integer";
+  pmsFilterWindow["minimum"] = 1;
+  pmsFilterWindow["maximum"] = FILTER_WINDOW_MAX;
+
+  JsonObject pmsFilterThreshold = json["pmsFilterThreshold"].to<JsonObject>();
+  pmsFilterThreshold["title"] = "PMS Spike Filter Threshold";
+  pmsFilterThreshold["description"] = "How many standard deviations (estimated from the median absolute deviation) a reading must be from the median to count as a spike in hampel mode (defaults to 3)";
+  pmsFilterThreshold["type"] = "number";
+  pmsFilterThreshold["minimum"] = 1;
+  pmsFilterThreshold["maximum"] = 10;
+
+  JsonObject humidityKappa = json["humidityKappa"].to<JsonObject>();
+  humidityKappa["title"] = "PM Humidity Correction (kappa)";
+  humidityKappa["description"] = "Hygroscopicity of the local aerosol, used to correct the PM readings for particle growth in humid air (kappa-Kohler). Corrected values are published alongside the raw ones and used for the AQI. Around 0.2-0.4 for typical urban air (defaults to 0 which disables the correction).";
+  humidityKappa["type"] = "number";
+  humidityKappa["minimum"] = 0;
+  humidityKappa["maximum"] = 1;
+
+  JsonObject humidityDensity = json["humidityDensity"].to<JsonObject>();
+  humidityDensity["title"] = "PM Humidity Correction Density (g/cm3)";
+  humidityDensity["description"] = "Dry particle density used by the humidity correction (defaults to 1.65)";
+  humidityDensity["type"] = "number";
+  humidityDensity["minimum"] = 0.5;
+  humidityDensity["maximum"] = 3;
+
+  JsonObject statsWindows = json["statsWindows"].to<JsonObject>();
+  statsWindows["title"] = "Rolling Statistics";
+  statsWindows["description"] = "Publish the mean, standard deviation, min and max of each reading over these sliding windows, and show the PM2.5 averages on the info screen (defaults to none). All windows are always available from the /stats REST endpoint.";
+  statsWindows["type"] = "array";
+  statsWindows["uniqueItems"] = true;
+  JsonObject statsWindowsItems = statsWindows["items"].to<JsonObject>();
+  statsWindowsItems["type"] = "string";
+  JsonArray statsWindowsEnum = statsWindowsItems["enum"].to<JsonArray>();
+  for (uint8_t i = 0; i < STATS_WINDOW_COUNT; i++)
+  {
+    statsWindowsEnum.add(statsWindowName[i]);
+  }
+
   // noActivity timeout
   JsonObject noActivitySecondsToSleep = json["noActivitySecondsToSleep"].to<JsonObject>();
   noActivitySecondsToSleep["title"] = "Screen Sleep Timeout (seconds)";
@@ -304,6 +762,14 @@ void setConfigSchema()
   buttonEnumNames.add("enable");
   buttonEnumNames.add("disable");
 
+  JsonObject warningMode = json["warningMode"].to<JsonObject>();
+  warningMode["title"] = "PM Warning Colours";
+  warningMode["description"] = "Colour PM2.5 and PM10 by their US-EPA AQI category, or against the warning levels below (defaults to aqi). The warning levels are still used for PM1.0, and until there is enough data for an AQI.";
+  warningMode["type"] = "string";
+  JsonArray warningModeEnum = warningMode["enum"].to<JsonArray>();
+  warningModeEnum.add("aqi");
+  warningModeEnum.add("levels");
+
   JsonObject warningLevels = json["warningLevels"].to<JsonObject>();
   warningLevels["type"] = "array";
   warningLevels["description"] = "Set the levels for PM warning color change";
@@ -373,9 +839,67 @@ void setConfigSchema()
 
 void jsonConfig(JsonVariant json)
 {
+  sensorCommand_t sensorCommand;
+
   if (json["telemetryIntervalMs"].is<int>())
   {
-    telemetryIntervalMs = min(json["telemetryIntervalMs"].as<int>(), TELEMETRY_INTERVAL_MS_MAX);
+    telemetryIntervalMs = constrain(json["telemetryIntervalMs"].as<int>(), 1, TELEMETRY_INTERVAL_MS_MAX);
+    scheduler.setPeriod(telemetryJob, telemetryIntervalMs);
+  }
+
+  if (json["backfillIntervalMs"].is<int>())
+  {
+    backfillIntervalMs = constrain(json["backfillIntervalMs"].as<int>(), 1, BACKFILL_INTERVAL_MS_MAX);
+    scheduler.setPeriod(backfillJob, backfillIntervalMs);
+  }
+
+  if (json["telemetryDeadbands"].is<JsonArray>())
+  {
+    // the list replaces every deadband - anything left out is published every interval again
+    deadband.clearDeadbands();
+    for (JsonObject item : json["telemetryDeadbands"].as<JsonArray>())
+    {
+      for (uint8_t c = 0; c < RECORD_CHANNEL_COUNT; c++)
+      {
+        if (strcmp(item["channel"] | "", recordChannelName[c]) == 0)
+        {
+          deadband.setDeadband(c, lroundf((item["absolute"] | 0.0f) * recordScale(c)), item["percent"] | 0.0f);
+        }
+      }
+    }
+  }
+
+  if (json["telemetryBatchSize"].is<int>())
+  {
+    telemetryBatchSize = constrain(json["telemetryBatchSize"].as<int>(), 1, TELEMETRY_BATCH_MAX);
+    // start afresh - a partial batch would otherwise mix in with the new size
+    batchCount = 0;
+  }
+
+  if (json["telemetryBatchS"].is<int>())
+  {
+    telemetryBatchS = constrain(json["telemetryBatchS"].as<int>(), 0, TELEMETRY_BATCH_S_MAX);
+  }
+
+  if (json["telemetryFormat"].is<const char *>())
+  {
+    if (strcmp(json["telemetryFormat"], "cbor") == 0)
+    {
+      telemetryWire = TELEMETRY_WIRE_CBOR;
+    }
+    else if (strcmp(json["telemetryFormat"], "both") == 0)
+    {
+      telemetryWire = TELEMETRY_WIRE_JSON | TELEMETRY_WIRE_CBOR;
+    }
+    else
+    {
+      telemetryWire = TELEMETRY_WIRE_JSON;
+    }
+  }
+
+  if (json["telemetryHeartbeatS"].is<int>())
+  {
+    deadband.setHeartbeatMs(constrain(json["telemetryHeartbeatS"].as<int>(), 1, DEADBAND_HEARTBEAT_S_MAX) * 1000UL);
   }
 
   if (json["sensorTempUnits"].is<const char *>())
@@ -383,27 +907,159 @@ void jsonConfig(JsonVariant json)
     if (strcmp(json["sensorTempUnits"], "c") == 0)
     {
       tempUnits = TEMP_C;
-      display.updateTempUnits(tempUnits);
+      sendUiCommand(UI_CMD_TEMP_UNITS, tempUnits);
     }
     else if (strcmp(json["sensorTempUnits"], "f") == 0)
     {
       tempUnits = TEMP_F;
-      display.updateTempUnits(tempUnits);
+      sendUiCommand(UI_CMD_TEMP_UNITS, tempUnits);
+    }
+  }
+
+  if (json["bmeSampleRate"].is<const char *>())
+  {
+    if (strcmp(json["bmeSampleRate"], "ulp") == 0)
+    {
+      sensorCommand.value = BME_RATE_ULP;
+      sendSensorCommand(sensorCommand, SENSOR_CMD_BME_RATE);
+    }
+    else if (strcmp(json["bmeSampleRate"], "lp") == 0)
+    {
+      sensorCommand.value = BME_RATE_LP;
+      sendSensorCommand(sensorCommand, SENSOR_CMD_BME_RATE);
+    }
+    else if (strcmp(json["bmeSampleRate"], "cont") == 0)
+    {
+      sensorCommand.value = BME_RATE_CONT;
+      sendSensorCommand(sensorCommand, SENSOR_CMD_BME_RATE);
+    }
+  }
+
+  if (json["bmeOutputs"].is<JsonArray>())
+  {
+    sensorCommand.value = 0;
+    for (JsonVariant output : json["bmeOutputs"].as<JsonArray>())
+    {
+      for (uint8_t i = 0; i < BME_EXTRA_OUTPUT_COUNT; i++)
+      {
+        if (strcmp(output | "", bmeOutputName[i]) == 0)
+        {
+          sensorCommand.value |= (1 << i);
+        }
+      }
+    }
+    sendSensorCommand(sensorCommand, SENSOR_CMD_BME_OUTPUTS);
+  }
+
+  if (json["statsWindows"].is<JsonArray>())
+  {
+    statsWindows = 0;
+    for (JsonVariant window : json["statsWindows"].as<JsonArray>())
+    {
+      for (uint8_t i = 0; i < STATS_WINDOW_COUNT; i++)
+      {
+        if (strcmp(window | "", statsWindowName[i]) == 0)
+        {
+          statsWindows |= (1 << i);
+        }
+      }
+    }
+  }
+
+  if (json["pmsChannels"].is<JsonArray>())
+  {
+    pmsChannels = 0;
+    for (JsonVariant channel : json["pmsChannels"].as<JsonArray>())
+    {
+      for (uint8_t i = 0; i < PMS_CHANNEL_COUNT; i++)
+      {
+        if (strcmp(channel | "", pmsChannelName[i]) == 0)
+        {
+          pmsChannels |= (1 << i);
+        }
+      }
+    }
+  }
+
+  if (json["pmsSampleIntervalS"].is<int>() || json["pmsWarmupS"].is<int>() || json["pmsSampleFrames"].is<int>())
+  {
+    pmsSampleIntervalS = json["pmsSampleIntervalS"] | pmsSampleIntervalS;
+    pmsWarmupS = json["pmsWarmupS"] | pmsWarmupS;
+    pmsSampleFrames = json["pmsSampleFrames"] | pmsSampleFrames;
+    sensorCommand.dutyCycle.intervalS = pmsSampleIntervalS;
+    sensorCommand.dutyCycle.warmupS = pmsWarmupS;
+    sensorCommand.dutyCycle.frames = pmsSampleFrames;
+    sendSensorCommand(sensorCommand, SENSOR_CMD_PMS_DUTY_CYCLE);
+  }
+
+  if (json["pmsFilter"].is<JsonArray>() || json["pmsFilterMode"].is<const char *>() || json["pmsFilterWindow"].is<int>() || json["pmsFilterThreshold"].is<float>())
+  {
+    if (json["pmsFilter"].is<JsonArray>())
+    {
+      pmsFilterChannels = 0;
+      for (JsonVariant channel : json["pmsFilter"].as<JsonArray>())
+      {
+        for (uint8_t i = 0; i < PMS_FILTER_COUNT; i++)
+        {
+          if (strcmp(channel | "", pmsFilterName[i]) == 0)
+          {
+            pmsFilterChannels |= (1 << i);
+          }
+        }
+      }
+    }
+
+    if (json["pmsFilterMode"].is<const char *>())
+    {
+      pmsFilterMode = strcmp(json["pmsFilterMode"], "median") == 0 ? FILTER_MODE_MEDIAN : FILTER_MODE_HAMPEL;
+    }
+
+    pmsFilterWindow = json["pmsFilterWindow"] | pmsFilterWindow;
+    pmsFilterThreshold = json["pmsFilterThreshold"] | pmsFilterThreshold;
+    sensorCommand.filter.channels = pmsFilterChannels;
+    sensorCommand.filter.mode = pmsFilterMode;
+    sensorCommand.filter.window = pmsFilterWindow;
+    sensorCommand.filter.threshold = pmsFilterThreshold;
+    sendSensorCommand(sensorCommand, SENSOR_CMD_PMS_FILTER);
+  }
+
+  if (json["humidityKappa"].is<float>() || json["humidityDensity"].is<float>())
+  {
+    humidityKappa = json["humidityKappa"] | humidityKappa;
+    humidityDensity = json["humidityDensity"] | humidityDensity;
+    humidity.begin(humidityKappa, humidityDensity);
+  }
+
+  if (json["warningMode"].is<const char *>())
+  {
+    if (strcmp(json["warningMode"], "aqi") == 0)
+    {
+      sendUiCommand(UI_CMD_WARNING_MODE, WARNING_MODE_AQI);
+    }
+    else if (strcmp(json["warningMode"], "levels") == 0)
+    {
+      sendUiCommand(UI_CMD_WARNING_MODE, WARNING_MODE_LEVELS);
     }
   }
 
   if (json["warningLevels"].is<JsonVariant>())
   {
     JsonObject warningLevels_0 = json["warningLevels"][0];
-    display.updateWarnLevels(warningLevels_0["yellowWarn1_0"], warningLevels_0["redWarn1_0"], warningLevels_0["yellowWarn2_5"], warningLevels_0["redWarn2_5"], warningLevels_0["yellowWarn10"], warningLevels_0["redWarn10"]);
+    uiCommand_t uiCommand;
+    uiCommand.type = UI_CMD_WARN_LEVELS;
+    uiCommand.warnLevels[0] = warningLevels_0["yellowWarn1_0"];
+    uiCommand.warnLevels[1] = warningLevels_0["redWarn1_0"];
+    uiCommand.warnLevels[2] = warningLevels_0["yellowWarn2_5"];
+    uiCommand.warnLevels[3] = warningLevels_0["redWarn2_5"];
+    uiCommand.warnLevels[4] = warningLevels_0["yellowWarn10"];
+    uiCommand.warnLevels[5] = warningLevels_0["redWarn10"];
+    uiCommandQueue.push(uiCommand);
   }
 
   if (json["tempOffset"].is<float>())
   {
-    if (bmeFound)
-    {
-      bme.setTemperatureOffset(json["tempOffset"].as<float>());
-    }
+    sensorCommand.tempOffset = json["tempOffset"].as<float>();
+    sendSensorCommand(sensorCommand, SENSOR_CMD_TEMP_OFFSET);
   }
 
   if (json["button"].is<const char *>())
@@ -420,39 +1076,51 @@ void jsonConfig(JsonVariant json)
 
   if (json["noActivitySecondsToSleep"].is<int>())
   {
-    display.backLightWake();
-    display.tftTimeoutIntervalMs = (json["noActivitySecondsToSleep"].as<int>() * 1000);
-    display.backLightWake();
+    sendUiCommand(UI_CMD_SLEEP_TIMEOUT, json["noActivitySecondsToSleep"].as<int>() * 1000);
   }
 
   if (json["maxBrightness"].is<uint8_t>())
   {
-    display.maxBrightness = json["maxBrightness"].as<uint8_t>();
-    display.backLightWake();
+    sendUiCommand(UI_CMD_MAX_BRIGHTNESS, json["maxBrightness"].as<uint8_t>());
   }
 
   // Handle any Home Assistant config
+  bool hassEnabled = hass.isDiscoveryEnabled();
   hass.parseConfig(json);
+
+  // only rebuild and re-announce when the units, the topic prefix or discovery itself changed -
+  // the config is sent again on every reconnect, and most updates have nothing to do with discovery
+  bool hassChanged = hass.isDiscoveryEnabled() != hassEnabled || tempUnits != hassTempUnits;
+
+  if (json["hassDiscoveryTopicPrefix"].is<const char *>() && strcmp(json["hassDiscoveryTopicPrefix"], hassTopicPrefix) != 0)
+  {
+    strlcpy(hassTopicPrefix, json["hassDiscoveryTopicPrefix"], sizeof(hassTopicPrefix));
+    hassChanged = true;
+  }
+
+  if (hassChanged)
+  {
+    hassState = HASS_STATE_REBUILD;
+  }
 }
 
-void publishHassDiscovery()
+void buildHassDiscovery()
 {
   char topic[64];
-
-  char component[8];
-  sprintf_P(component, PSTR("sensor"));
-
   char id[8];
   char valueTemplate[128];
+  size_t used = 0;
 
-  for (int x = 0; x < 8; x++)
-  {
-    if (hassDiscoveryPublished[x])
-      return;
+  hassTempUnits = tempUnits;
+
+  // one document, only for as long as it takes to serialise each sensor's config
+  JsonDocument json;
 
+  for (uint8_t x = 0; x < HASS_SENSOR_COUNT; x++)
+  {
     sprintf_P(id, PSTR("AQS_%d"), x);
 
-    JsonDocument json;
+    json.clear();
     hass.getDiscoveryJson(json, id);
 
     if (x == 0) // temp sensor change the units if needed
@@ -471,7 +1139,8 @@ void publishHassDiscovery()
       json["unit_of_meas"] = nameUnits[x];
     }
 
-    sprintf_P(valueTemplate, PSTR("{{value_json.%s }}"), nameMqtt[x]);
+    // readings inside their deadband are left out of the payload, so keep the last state rather than going unknown
+    sprintf_P(valueTemplate, PSTR("{{ value_json.%s | default(this.state) }}"), nameMqtt[x]);
 
     json["name"] = name[x];
     json["dev_cla"] = nameClass[x];
@@ -479,8 +1148,58 @@ void publishHassDiscovery()
     json["stat_t"] = oxrs.getMQTT()->getTelemetryTopic(topic);
     json["frc_upd"] = true;
 
-    hassDiscoveryPublished[x] = hass.publishDiscoveryJson(json, component, id);
+    // room for the terminator serializeJson() adds
+    size_t length = measureJson(json);
+    if (used + length >= HASS_PAYLOAD_BUFFER_SIZE)
+    {
+      Serial.printf("[AQS] no room for the %s discovery payload (%u bytes)\n", id, (unsigned)length);
+      hassPayloadLength[x] = 0;
+      continue;
+    }
+
+    hassPayloadOffset[x] = used;
+    hassPayloadLength[x] = serializeJson(json, &hassPayloads[used], HASS_PAYLOAD_BUFFER_SIZE - used);
+    used += hassPayloadLength[x];
+  }
+}
+
+// announces the next sensor - a periodic job, so discovery never takes more than one publish a tick
+bool sendHassDiscovery()
+{
+  // discovery is retained, but a broker restart may have lost it - start again on every (re)connect
+  // (rebuilt as well, since the MQTT topics only ever change across a reconnect)
+  uint32_t connects = oxrs.getMqttConnects();
+  if (connects != hassConnects)
+  {
+    hassConnects = connects;
+    hassState = HASS_STATE_REBUILD;
+  }
+
+  if (hassState == HASS_STATE_DONE || !hass.isDiscoveryEnabled() || !oxrs.mqttConnected)
+    return true;
+
+  if (hassState == HASS_STATE_REBUILD)
+  {
+    buildHassDiscovery();
+    hassState = HASS_STATE_ANNOUNCE;
+    hassNext = 0;
+  }
+
+  // the same topic OXRS_HASS::publishDiscoveryJson() uses - <prefix>/<component>/<client id>/<id>/config
+  char topic[128];
+  snprintf_P(topic, sizeof(topic), PSTR("%s/sensor/%s/AQS_%d/config"), hassTopicPrefix, oxrs.getMQTT()->getClientId(), hassNext);
+
+  // the stored bytes go out as they are - a failed one is tried again next tick, one that never fitted is skipped
+  if (hassPayloadLength[hassNext] == 0 || oxrs.publishRaw(topic, &hassPayloads[hassPayloadOffset[hassNext]], hassPayloadLength[hassNext], true))
+  {
+    hassNext++;
+  }
+
+  if (hassNext >= HASS_SENSOR_COUNT)
+  {
+    hassState = HASS_STATE_DONE;
   }
+  return true;
 }
 
 /*--------------------------- Button helpers ---------------------------------*/
@@ -534,7 +1253,7 @@ void publishEvent(uint8_t index, uint8_t type, uint8_t state)
 
   if (buttonControl && strcmp(eventType, "single") == 0)
   {
-    display.nextScreen();
+    sendUiCommand(UI_CMD_NEXT_SCREEN);
   }
   else
   {
@@ -561,6 +1280,12 @@ double roundTo1Dp(double value)
   return (int)(value * 10.0) / 10.0;
 }
 
+// the same cut off as roundTo1Dp(), in tenths for the telemetry encoder
+int32_t toTenths(double value)
+{
+  return (int32_t)(value * 10.0);
+}
+
 // scans an I2C address for a valid device
 bool scanI2CAddress(byte address, const char *name)
 {
@@ -599,192 +1324,1156 @@ void printEspInfo()
   Serial.printf("Ram Size: %d \n", ESP.getHeapSize());
 }
 
-/**
-  Setup
-*/
-void setup()
+/*--------------------------- Boot Timing -----------------------------*/
+// each entry is only ever written by the task running that phase, and read once it has ended
+void bootPhaseStart(uint8_t phase)
 {
-  // Start serial and let settle
-  delay(5000);
-  Serial.begin(SERIAL_BAUD_RATE);
-  delay(1000);
-  Serial.println(F("[AQS] starting up..."));
+  bootPhaseUs[phase][0] = esp_timer_get_time();
+}
 
-  EEPROM.begin(BSEC_MAX_STATE_BLOB_SIZE + 1);
+void bootPhaseEnd(uint8_t phase)
+{
+  bootPhaseUs[phase][1] = esp_timer_get_time();
+}
 
-  // Prints out the ESP Chip Information
-  printEspInfo();
+bool isBootPhaseDone(uint8_t phase)
+{
+  return bootPhaseUs[phase][1] != 0;
+}
 
-  // Starts up LVGL + TFT
-  display.begin();
+// {"espInfo": {"startUs":..,"us":..}, ..} for every phase that has finished
+void getBootTimesJson(JsonVariant json)
+{
+  for (uint8_t phase = 0; phase < BOOT_PHASE_COUNT; phase++)
+  {
+    if (!isBootPhaseDone(phase))
+      continue;
 
-  // // add control for the PMS sensor pins
-  pinMode(PMS_SET, OUTPUT);   // sleep control - low is sleep
-  pinMode(PMS_RESET, OUTPUT); // Reset control - low is reset
+    JsonObject times = json[bootPhaseName[phase]].to<JsonObject>();
+    times["startUs"] = bootPhaseUs[phase][0];
+    times["us"] = bootPhaseUs[phase][1] - bootPhaseUs[phase][0];
+  }
+}
 
-  // //Turn the PMS sensor ON
-  digitalWrite(PMS_SET, HIGH);
-  digitalWrite(PMS_RESET, HIGH);
-  delay(500);
+// sent once per boot, as soon as MQTT is up - by then every phase bar the first reading has run
+// (as "bootTimes", since "boot" in the telemetry payloads is the boot id)
+void publishBootTimes()
+{
+  JsonDocument json;
+  getBootTimesJson(json["bootTimes"].to<JsonVariant>());
 
-  comm.begin(PMS_BAUD, SERIAL_8N1, PMS_TX, PMS_RX);
-  delay(250);
-  pms7003.init(&comm);
+  bootTimesPublished = oxrs.publishTelemetry(json);
+}
 
-  // Start the I2C bus
-  Wire.begin(I2C_SDA, I2C_SCL);
+/*--------------------------- Sensor task ---------------------------------*/
 
-  if (scanI2CAddress(BME_I2C_ADDRESS, "BME680"))
+void sensorCommand(sensorCommand_t &command)
+{
+  switch (command.type)
   {
-    bme.begin(BME_I2C_ADDRESS, Wire);
-
-    if (bme.bsecStatus == BSEC_OK && bme.bme68xStatus == BME68X_OK)
+  case SENSOR_CMD_TEMP_OFFSET:
+    bme.setTemperatureOffset(command.tempOffset);
+    break;
+  case SENSOR_CMD_BME_RATE:
+    bme.setSampleRate(command.value);
+    break;
+  case SENSOR_CMD_BME_OUTPUTS:
+    bme.setExtraOutputs(command.value);
+    break;
+  case SENSOR_CMD_PMS_DUTY_CYCLE:
+    pms.setDutyCycle(command.dutyCycle.intervalS, command.dutyCycle.warmupS, command.dutyCycle.frames);
+    break;
+  case SENSOR_CMD_PMS_FILTER:
+    // new settings start every filter afresh
+    pmsFilterEnabled = command.filter.channels;
+    for (uint8_t i = 0; i < PMS_FILTER_COUNT; i++)
     {
-      bmeFound = true;
-      bme.setConfig(bsec_config_iaq);
-      bmeLoadState();
-      // bme.updateSubscription(sensorList, 5, BSEC_SAMPLE_RATE_CONT);
-      bme.updateSubscription(sensorList, 5, BSEC_SAMPLE_RATE_LP);
-      // bme.updateSubscription(sensorList, 5, BSEC_SAMPLE_RATE_ULP);
-      if (bme.bsecStatus != BSEC_OK && bme.bme68xStatus != BME68X_OK)
-      {
-        bmeFound = false;
-      }
+      pmsFilter[i].begin(command.filter.mode, command.filter.window, command.filter.threshold);
     }
+    break;
   }
+}
 
-  // uses oxrs input handler
-  pinMode(MODE_BUTTON, INPUT_PULLUP);
-  // Initialise input handlers (default to BUTTON)
-  oxrsInput.begin(inputEvent, BUTTON);
+// runs a PMS reading through its spike filter if it has one enabled
+uint16_t filterPms(uint8_t filter, uint16_t value)
+{
+  if (!(pmsFilterEnabled & (1 << filter)))
+    return value;
 
-  // // Start S3 hardware
-  oxrs.begin(jsonConfig, jsonCommand);
+  uint32_t rejected = pmsFilter[filter].getRejected();
+  value = pmsFilter[filter].update(value);
+  pmsFilterRejected += pmsFilter[filter].getRejected() - rejected;
+  return value;
+}
 
-  // Set up schema (for self-discovery and adoption)
-  setConfigSchema();
-  setCommandSchema();
+// hands a reading to both consumers - a full queue just means that consumer skips a sample
+void publishSample(sensorSample_t &sample)
+{
+  netSampleQueue.push(sample);
+  uiSampleQueue.push(sample);
 }
 
-/**
-  Main processing loop
-*/
-void loop()
+// brings up and then owns the PMS and BME (and the I2C bus)
+void sensorTask(void *parameter)
 {
-  // Let S3 hardware handle any events etc
-  oxrs.loop();
+  sensorCommand_t command;
+  sensorSample_t sample;
 
-  // Check for any input events
-  bool inputState = digitalRead(MODE_BUTTON);
-  oxrsInput.processInput(0, 0, inputState);
+  // started here rather than in setup() so BSEC init runs alongside the display and network bring up
+  // the PMS parser resyncs on its own, so there is no need to wait for the sensor before opening the UART
+  bootPhaseStart(BOOT_PHASE_PMS_UART);
+  comm.begin(PMS_BAUD, SERIAL_8N1, PMS_TX, PMS_RX);
+  pms.begin(&comm, PMS_SET);
+  bootPhaseEnd(BOOT_PHASE_PMS_UART);
 
-  // looks for updated information from PMS sensor - when complete hasNewData() == true
-  pms7003.updateFrame();
+  bootPhaseStart(BOOT_PHASE_I2C_SCAN);
+  Wire.begin(I2C_SDA, I2C_SCL);
+  bool bmePresent = scanI2CAddress(BME_I2C_ADDRESS, "BME680");
+  bootPhaseEnd(BOOT_PHASE_I2C_SCAN);
 
-  // we have new PMS data - update variables
-  if (pms7003.hasNewData())
+  if (bmePresent)
   {
-    pmsFound = true;
-    PM1_0 = pms7003.getPM_1_0();
-    PM2_5 = pms7003.getPM_2_5();
-    PM10 = pms7003.getPM_10_0();
+    bootPhaseStart(BOOT_PHASE_BSEC);
+    bme.begin(BME_I2C_ADDRESS, Wire);
+    bootPhaseEnd(BOOT_PHASE_BSEC);
   }
 
-  if (bmeFound) // bme was found and initilized
+  // the last duty cycle state the network loop was told about
+  uint8_t pmsStateSent = PMS_STATE_CONTINUOUS;
+
+  for (;;)
   {
-    if (bme.run()) // bme has new data
+    while (sensorCommandQueue.pop(command))
     {
-      bmeUpdateState();
-      co2e = int(trunc(bme.co2Equivalent));
-      bvoc = roundTo1Dp(bme.breathVocEquivalent);
-      hum = roundTo1Dp(bme.humidity);
-      iaqAccuracy = bme.iaqAccuracy;
+      sensorCommand(command);
+    }
 
-      if (tempUnits == TEMP_F)
+    // frames are parsed as they arrive on the UART - this just runs the duty cycle and picks up finished samples
+    if (pms.loop())
+    {
+      const pmsSample_t *pmsSample = pms.getSample();
+
+      sample.source = SAMPLE_PMS;
+      sample.pms.pm1_0 = filterPms(PMS_FILTER_PM1_0, pmsSample->pm1_0);
+      sample.pms.pm2_5 = filterPms(PMS_FILTER_PM2_5, pmsSample->pm2_5);
+      sample.pms.pm10 = filterPms(PMS_FILTER_PM10, pmsSample->pm10);
+      sample.pms.rejected = pmsFilterRejected;
+      for (uint8_t i = 0; i < PMS_CHANNEL_COUNT; i++)
+      {
+        sample.pms.channels[i] = pmsSample->words[pmsChannelWord[i]];
+      }
+      sample.pms.state = pms.getState();
+      sample.pms.sampleMs = pms.getSampleMs();
+
+      publishSample(sample);
+      pmsStateSent = sample.pms.state;
+    }
+    else if (pms.getState() != pmsStateSent)
+    {
+      // warm up and sampling don't produce a reading, but telemetry still reports them
+      sample.source = SAMPLE_PMS_STATE;
+      sample.pms.state = pms.getState();
+      sample.pms.sampleMs = pms.getSampleMs();
+
+      // a full queue is tried again on the next pass
+      if (netSampleQueue.push(sample))
+      {
+        pmsStateSent = sample.pms.state;
+      }
+    }
+
+    // only enters BSEC when a measurement is due
+    if (bme.loop()) // bme has new data
+    {
+      sample.source = SAMPLE_BME;
+      sample.bme.iaqAccuracy = bme.getIaqAccuracy();
+      sample.bme.co2e = bme.getCo2Equivalent();
+      sample.bme.bvoc = bme.getBreathVocEquivalent();
+      sample.bme.temp = bme.getTemperature();
+      sample.bme.hum = bme.getHumidity();
+      sample.bme.extraOutputs = bme.getExtraOutputs();
+      for (uint8_t i = 0; i < BME_EXTRA_OUTPUT_COUNT; i++)
+      {
+        sample.bme.extra[i] = bme.getExtraOutput(i);
+      }
+      sample.bme.jitterMs = bme.getLastJitterMs();
+
+      publishSample(sample);
+    }
+
+    // nothing left to do until BSEC needs us - sleep rather than spin (always at least a tick to feed the idle task)
+    vTaskDelay(max(pdMS_TO_TICKS(min(bme.getMsUntilNextCall(), (uint32_t)SENSOR_TASK_IDLE_MAX_MS)), (TickType_t)1));
+  }
+}
+
+/*--------------------------- UI task ---------------------------------*/
+
+void uiCommand(uiCommand_t &command)
+{
+  switch (command.type)
+  {
+  case UI_CMD_BACKLIGHT_WAKE:
+    display.backLightWake();
+    break;
+  case UI_CMD_NEXT_SCREEN:
+    display.nextScreen();
+    break;
+  case UI_CMD_WIFI_STATUS:
+    display.setWifiStatus(command.wifiStatus.wifi, command.wifiStatus.mqtt);
+    break;
+  case UI_CMD_INFO_DATA:
+    display.setInfoData(command.infoData.mac, command.infoData.ip, command.infoData.mqtt);
+    break;
+  case UI_CMD_INFO_ROW:
+    display.setInfoRow(command.infoRow.row, command.infoRow.label, command.infoRow.value);
+    break;
+  case UI_CMD_INFO_ROW_COUNT:
+    display.setInfoRowCount(command.value);
+    break;
+  case UI_CMD_TEMP_UNITS:
+    display.updateTempUnits(command.value);
+    break;
+  case UI_CMD_WARN_LEVELS:
+    display.updateWarnLevels(command.warnLevels[0], command.warnLevels[1], command.warnLevels[2], command.warnLevels[3], command.warnLevels[4], command.warnLevels[5]);
+    break;
+  case UI_CMD_SLEEP_TIMEOUT:
+    display.backLightWake();
+    display.tftTimeoutIntervalMs = command.value;
+    display.backLightWake();
+    break;
+  case UI_CMD_MAX_BRIGHTNESS:
+    display.maxBrightness = command.value;
+    display.backLightWake();
+    break;
+  case UI_CMD_AQI_CATEGORIES:
+    display.updateAqiCategories(command.aqiCategories[AQI_PM2_5], command.aqiCategories[AQI_PM10]);
+    break;
+  case UI_CMD_WARNING_MODE:
+    display.warningMode = command.value;
+    break;
+  }
+}
+
+// brings up and then owns LVGL and the TFT
+void uiTask(void *parameter)
+{
+  // Starts up LVGL + TFT (shows the splash screen until the first reading or the network is up)
+  bootPhaseStart(BOOT_PHASE_DISPLAY);
+  display.begin();
+  bootPhaseEnd(BOOT_PHASE_DISPLAY);
+
+  // Last time sensor data was sent to TFT
+  uint64_t lastRenderMs = 0L;
+
+  uiCommand_t command;
+  sensorSample_t sample;
+  sensorSample_t pmsSample;
+  sensorSample_t bmeSample;
+  bool havePms = false;
+  bool haveBme = false;
+
+  for (;;)
+  {
+    while (uiCommandQueue.pop(command))
+    {
+      uiCommand(command);
+    }
+
+    // only the latest reading from each sensor matters to the screen
+    while (uiSampleQueue.pop(sample))
+    {
+      if (sample.source == SAMPLE_PMS)
       {
-        temp = roundTo1Dp((bme.temperature * 1.8) + 32);
+        pmsSample = sample;
+        havePms = true;
       }
       else
       {
-        temp = roundTo1Dp(bme.temperature);
+        bmeSample = sample;
+        haveBme = true;
+      }
+    }
+
+    // Check if we need to update Tft
+    if (monotonicMs() - lastRenderMs >= tftIntervalMs)
+    {
+      if (haveBme)
+      {
+        display.sendBmeData(bmeSample.bme.iaqAccuracy, int(trunc(bmeSample.bme.co2e)), roundTo1Dp(bmeSample.bme.bvoc), roundTo1Dp(bmeSample.bme.hum), bmeSample.bme.temp);
       }
+      if (havePms)
+      {
+        display.sendPmsData(pmsSample.pms.pm1_0, pmsSample.pms.pm2_5, pmsSample.pms.pm10);
+      }
+
+      display.loop();
+      lastRenderMs = monotonicMs();
     }
+
+    vTaskDelay(pdMS_TO_TICKS(UI_TASK_PERIOD_MS));
+  }
+}
+
+// true when the PM readings can be corrected for humidity - enabled and both sensors have reported
+bool isHumidityCorrected()
+{
+  return humidity.isEnabled() && (current.valid & RECORD_VALID_PMS) && (current.valid & RECORD_VALID_BME);
+}
+
+/*--------------------------- Rolling Statistics ----------------------*/
+// stats for one channel and window, with temperature in the configured units like the instantaneous reading
+bool getStats(uint8_t channel, uint8_t window, statsResult_t &result)
+{
+  if (!stats.get(channel, window, result))
+    return false;
+
+  if (channel == RECORD_TEMP && tempUnits == TEMP_F)
+  {
+    result.mean = (result.mean * 1.8) + 32;
+    result.min = (result.min * 1.8) + 32;
+    result.max = (result.max * 1.8) + 32;
+    result.stddev = result.stddev * 1.8;
   }
+  return true;
+}
+
+// adds the stats for each window in the bitmask - {"15m": {"PM2_5": {"mean":..,"sd":..,"min":..,"max":..}, ..}, ..}
+void getStatsJson(JsonVariant json, uint8_t windows)
+{
+  statsResult_t result;
 
-  // Check if we need to update Tft
-  if (millis() - lastTftMs >= tftIntervalMs)
+  for (uint8_t w = 0; w < STATS_WINDOW_COUNT; w++)
   {
-    display.setWifiStatus(oxrs.networkConnected, oxrs.mqttConnected);
-    char buffer0[40];
-    char buffer1[40];
-    char buffer2[40];
-    oxrs.getMACAddressTxt(buffer0);
-    oxrs.getIPAddressTxt(buffer1);
-    oxrs.getMQTTTopicTxt(buffer2);
-    display.setInfoData(buffer0,buffer1,buffer2);
-    if (bmeFound)
+    if (!(windows & (1 << w)))
+      continue;
+
+    JsonObject window = json[statsWindowName[w]].to<JsonObject>();
+    for (uint8_t c = 0; c < RECORD_CHANNEL_COUNT; c++)
     {
-      display.sendBmeData(iaqAccuracy, co2e, bvoc, hum, temp);
+      if (!getStats(c, w, result))
+        continue;
+
+      JsonObject channel = window[recordChannelName[c]].to<JsonObject>();
+      channel["mean"] = roundTo1Dp(result.mean);
+      channel["sd"] = roundTo1Dp(result.stddev);
+      channel["min"] = roundTo1Dp(result.min);
+      channel["max"] = roundTo1Dp(result.max);
     }
-    if (pmsFound)
+  }
+}
+
+// the same stats as getStatsJson(), written as "stats" by the telemetry encoder
+void addStatsTelemetry(uint8_t windows)
+{
+  statsResult_t result;
+
+  telemetry.beginObject(TELE_KEY_STATS);
+  for (uint8_t w = 0; w < STATS_WINDOW_COUNT; w++)
+  {
+    if (!(windows & (1 << w)))
+      continue;
+
+    telemetry.beginObject(teleKeyStatsWindow + w);
+    for (uint8_t c = 0; c < RECORD_CHANNEL_COUNT; c++)
     {
-      display.sendPmsData(PM1_0, PM2_5, PM10);
+      if (!getStats(c, w, result))
+        continue;
+
+      telemetry.beginObject(teleKeyRecord + c);
+      telemetry.addFixed(TELE_KEY_MEAN, toTenths(result.mean), 1);
+      telemetry.addFixed(TELE_KEY_SD, toTenths(result.stddev), 1);
+      telemetry.addFixed(TELE_KEY_MIN, toTenths(result.min), 1);
+      telemetry.addFixed(TELE_KEY_MAX, toTenths(result.max), 1);
+      telemetry.endObject();
     }
+    telemetry.endObject();
+  }
+  telemetry.endObject();
+}
+
+// renders every key the telemetry can use - the channel lists are fixed, so this only runs once
+void buildTelemetryTemplate()
+{
+  telemetry.clearKeys();
+
+  for (uint8_t i = 0; i < TELE_KEY_FIXED_COUNT; i++)
+  {
+    telemetry.addKey(teleKeyName[i]);
+  }
+
+  teleKeyRecord = telemetry.addKey(recordChannelName[0]);
+  for (uint8_t c = 1; c < RECORD_CHANNEL_COUNT; c++)
+  {
+    telemetry.addKey(recordChannelName[c]);
+  }
+
+  // only the PM channels have a corrected reading
+  teleKeyCorrected = telemetry.addKey(recordChannelName[RECORD_PM1_0], "_corrected");
+  telemetry.addKey(recordChannelName[RECORD_PM2_5], "_corrected");
+  telemetry.addKey(recordChannelName[RECORD_PM10], "_corrected");
+
+  teleKeyPmsChannel = telemetry.addKey(pmsChannelName[0]);
+  for (uint8_t i = 1; i < PMS_CHANNEL_COUNT; i++)
+  {
+    telemetry.addKey(pmsChannelName[i]);
+  }
 
-    display.loop();
-    lastTftMs = millis();
+  teleKeyBmeOutput = telemetry.addKey(bmeOutputName[0]);
+  for (uint8_t i = 1; i < BME_EXTRA_OUTPUT_COUNT; i++)
+  {
+    telemetry.addKey(bmeOutputName[i]);
+  }
+
+  teleKeyNowCast = telemetry.addKey(aqiPollutantName[0], "_nowcast");
+  for (uint8_t i = 1; i < AQI_POLLUTANT_COUNT; i++)
+  {
+    telemetry.addKey(aqiPollutantName[i], "_nowcast");
+  }
+
+  teleKey24h = telemetry.addKey(aqiPollutantName[0], "_24h");
+  for (uint8_t i = 1; i < AQI_POLLUTANT_COUNT; i++)
+  {
+    telemetry.addKey(aqiPollutantName[i], "_24h");
   }
 
-  // Check if we need to send telemetry
-  if (millis() - lastTelemetryMs >= telemetryIntervalMs)
+  teleKeyStatsWindow = telemetry.addKey(statsWindowName[0]);
+  for (uint8_t w = 1; w < STATS_WINDOW_COUNT; w++)
   {
-    // Build telemetry payload
-    JsonDocument json;
+    telemetry.addKey(statsWindowName[w]);
+  }
+}
+
+// GET /stats - every window, so dashboards don't need to pull the raw readings to average them
+void apiStats(Request &req, Response &res)
+{
+  JsonDocument json;
+  getStatsJson(json.to<JsonVariant>(), (1 << STATS_WINDOW_COUNT) - 1);
+
+  res.set("Content-Type", "application/json");
+  serializeJson(json, res);
+}
+
+// GET /history?channel=PM2_5&range=86400&points=120 - min/mean/max of a reading over the last range seconds,
+// taken from whichever tier covers it in no more than the requested number of points
+void apiHistory(Request &req, Response &res)
+{
+  char buffer[16];
 
-    if (pmsFound)
+  uint8_t channel = RECORD_PM2_5;
+  if (req.query("channel", buffer, sizeof(buffer)))
+  {
+    for (uint8_t c = 0; c < RECORD_CHANNEL_COUNT; c++)
     {
-      json["PM1_0"] = PM1_0;
-      json["PM2_5"] = PM2_5;
-      json["PM10"] = PM10;
+      if (strcmp(buffer, recordChannelName[c]) == 0)
+      {
+        channel = c;
+      }
     }
+  }
+
+  uint32_t range = 3600;
+  if (req.query("range", buffer, sizeof(buffer)))
+  {
+    range = max(atol(buffer), 1L);
+  }
+
+  uint16_t points = DEFAULT_HISTORY_POINTS;
+  if (req.query("points", buffer, sizeof(buffer)))
+  {
+    points = constrain(atoi(buffer), 1, HISTORY_POINTS_MAX);
+  }
 
-    if (bmeFound)
+  uint32_t to = history.getNewestTime();
+  uint32_t from = range > to ? 0 : to - range;
+  uint8_t tier = tiers.selectTier(from, to, points);
+  uint32_t step = tiers.getStepS(tier);
+
+  JsonDocument json;
+  json["channel"] = recordChannelName[channel];
+  json["stepS"] = step;
+  json["now"] = to;
+
+  // [time, min, mean, max] for every bucket in the range that has readings
+  JsonArray data = json["points"].to<JsonArray>();
+  tierPoint_t point;
+  for (uint32_t time = (from / step) * step; time <= to; time += step)
+  {
+    if (!tiers.get(tier, time, channel, point))
+      continue;
+
+    if (channel == RECORD_TEMP && tempUnits == TEMP_F)
     {
-      json["temperature"] = temp;
-      json["humidity"] = hum;
-      // if accuracy is considered too low don't send data
-      if (iaqAccuracy > 0)
+      point.min = (point.min * 1.8) + 32;
+      point.mean = (point.mean * 1.8) + 32;
+      point.max = (point.max * 1.8) + 32;
+    }
+
+    JsonArray values = data.add<JsonArray>();
+    values.add(time);
+    values.add(roundTo1Dp(point.min));
+    values.add(roundTo1Dp(point.mean));
+    values.add(roundTo1Dp(point.max));
+  }
+
+  res.set("Content-Type", "application/json");
+  serializeJson(json, res);
+}
+
+// the response the log is being streamed to
+Response *logResponse = NULL;
+
+void printLogEntry(uint32_t bootId, uint32_t timeS, const sensorRecord_t &record)
+{
+  logResponse->print(bootId);
+  logResponse->print(',');
+  logResponse->print(timeS);
+
+  int32_t value;
+  for (uint8_t channel = 0; channel < RECORD_CHANNEL_COUNT; channel++)
+  {
+    logResponse->print(',');
+    if (!recordGet(&record, channel, value))
+      continue;
+
+    float reading = value / recordScale(channel);
+    if (channel == RECORD_TEMP && tempUnits == TEMP_F)
+    {
+      reading = (reading * 1.8) + 32;
+    }
+    logResponse->print(roundTo1Dp(reading));
+  }
+  logResponse->print('\n');
+}
+
+// GET /log - every per-minute mean still on flash as CSV, oldest first
+// times are seconds since that boot (there is no wall clock), so rows are keyed by boot and time
+void apiLog(Request &req, Response &res)
+{
+  res.set("Content-Type", "text/csv");
+
+  res.print("boot,time");
+  for (uint8_t channel = 0; channel < RECORD_CHANNEL_COUNT; channel++)
+  {
+    res.print(',');
+    res.print(recordChannelName[channel]);
+  }
+  res.print('\n');
+
+  logResponse = &res;
+  sampleLog.replay(printLogEntry);
+  logResponse = NULL;
+}
+
+/*--------------------------- Periodic Jobs ---------------------------*/
+// keep the connection info on the Tft up to date
+bool sendTftInfo()
+{
+  uiCommand_t command;
+
+  command.type = UI_CMD_WIFI_STATUS;
+  command.wifiStatus.wifi = oxrs.networkConnected;
+  command.wifiStatus.mqtt = oxrs.mqttConnected;
+  uiCommandQueue.push(command);
+
+  command.type = UI_CMD_INFO_DATA;
+  oxrs.getMACAddressTxt(command.infoData.mac);
+  oxrs.getIPAddressTxt(command.infoData.ip);
+  oxrs.getMQTTTopicTxt(command.infoData.mqtt);
+  uiCommandQueue.push(command);
+
+  // show any extra PMS channels on the info screen
+  uint8_t row = 0;
+  if (pmsFound)
+  {
+    for (uint8_t i = 0; i < PMS_CHANNEL_COUNT; i++)
+    {
+      if (pmsChannels & (1 << i))
       {
-        json["co2e"] = co2e;
-        json["bvoc"] = bvoc;
-        json["iaqAccuracy"] = iaqAccuracy;
+        command.type = UI_CMD_INFO_ROW;
+        command.infoRow.row = row++;
+        strcpy(command.infoRow.label, pmsChannelLabel[i]);
+        sprintf_P(command.infoRow.value, PSTR("%u"), pmsChannelValue[i]);
+        uiCommandQueue.push(command);
+      }
+    }
+
+    // and the rolling PM2.5 averages
+    statsResult_t result;
+    for (uint8_t w = 0; w < STATS_WINDOW_COUNT; w++)
+    {
+      if ((statsWindows & (1 << w)) && stats.get(RECORD_PM2_5, w, result))
+      {
+        command.type = UI_CMD_INFO_ROW;
+        command.infoRow.row = row++;
+        sprintf_P(command.infoRow.label, PSTR("PM2.5 %s:"), statsWindowName[w]);
+        sprintf_P(command.infoRow.value, PSTR("%.1f"), result.mean);
+        uiCommandQueue.push(command);
+      }
+    }
+  }
+
+  // and how long each part of the boot took
+  for (uint8_t phase = 0; phase < BOOT_PHASE_COUNT; phase++)
+  {
+    if (isBootPhaseDone(phase))
+    {
+      command.type = UI_CMD_INFO_ROW;
+      command.infoRow.row = row++;
+      sprintf_P(command.infoRow.label, PSTR("%.14s:"), bootPhaseName[phase]);
+      sprintf_P(command.infoRow.value, PSTR("%.1f ms @%.1f s"), (bootPhaseUs[phase][1] - bootPhaseUs[phase][0]) / 1000.0, bootPhaseUs[phase][0] / 1000000.0);
+      uiCommandQueue.push(command);
+    }
+  }
+  sendUiCommand(UI_CMD_INFO_ROW_COUNT, row);
+
+  // AQI categories for colouring the PM readings
+  command.type = UI_CMD_AQI_CATEGORIES;
+  command.aqiCategories[AQI_PM2_5] = aqi.getCategory(AQI_PM2_5);
+  command.aqiCategories[AQI_PM10] = aqi.getCategory(AQI_PM10);
+  uiCommandQueue.push(command);
+  return true;
+}
+
+// decimal places a record channel holds - 0.01 for temperature and humidity, 0.1 for bvoc
+uint8_t recordDecimals(uint8_t channel)
+{
+  float scale = recordScale(channel);
+  return scale >= 100 ? 2 : scale >= 10 ? 1 : 0;
+}
+
+// the publisher's way out to the broker
+bool publishRaw(const char *payload, size_t length, const char *subtopic)
+{
+  return oxrs.publishTelemetryRaw(payload, length, subtopic);
+}
+
+// builds the payload in each selected wire format and hands it to the publisher (build returns false when there is nothing to send)
+// once the first format has been taken the rest are best effort - retrying would only repeat it
+uint8_t publishTelemetry(bool (*build)(), const char *jsonSubtopic, const char *cborSubtopic)
+{
+  uint8_t result = PUBLISH_SKIPPED;
+
+  for (uint8_t format = TELEMETRY_FORMAT_JSON; format <= TELEMETRY_FORMAT_CBOR; format++)
+  {
+    if (!(telemetryWire & (1 << format)))
+      continue;
+
+    telemetry.setFormat(format);
+    if (!build())
+      return result;
+
+    size_t length;
+    const char *payload = telemetry.end(length);
+    if (payload == NULL)
+    {
+      // would never fit - retrying won't help
+      Serial.println(F("[AQS] telemetry payload too large"));
+      return result;
+    }
+
+    if (publisher.publish(payload, length, format == TELEMETRY_FORMAT_CBOR ? cborSubtopic : jsonSubtopic, monotonicMs()) == PUBLISHER_REJECTED)
+      return result == PUBLISH_SENT ? PUBLISH_SENT : PUBLISH_FAILED;
+
+    result = PUBLISH_SENT;
+  }
+
+  return result;
+}
+
+// "boot":n,"uptimeMs":first sample,"offsetsMs":[..],"PM1_0":[..],.. - one column of values per reading
+void addTelemetryColumns(const sensorRecord_t *records, const uint32_t *offsetsMs, uint8_t count, uint64_t startMs)
+{
+  telemetry.addInt(TELE_KEY_BOOT, sampleLog.getBootId());
+  telemetry.addInt(TELE_KEY_UPTIME, startMs);
+
+  telemetry.beginArray(TELE_KEY_OFFSETS);
+  for (uint8_t i = 0; i < count; i++)
+  {
+    telemetry.addInt(TELEMETRY_NO_KEY, offsetsMs[i]);
+  }
+  telemetry.endArray();
+
+  int32_t value;
+  for (uint8_t c = 0; c < RECORD_CHANNEL_COUNT; c++)
+  {
+    // only the readings of sensors we have
+    if ((c <= RECORD_PM10 && !pmsFound) || (c > RECORD_PM10 && !bmeFound))
+      continue;
+
+    uint8_t decimals = recordDecimals(c);
+    telemetry.beginArray(teleKeyRecord + c);
+    for (uint8_t i = 0; i < count; i++)
+    {
+      // a sensor that hadn't reported yet
+      if (!recordGet(&records[i], c, value))
+      {
+        telemetry.addNull(TELEMETRY_NO_KEY);
+        continue;
+      }
+
+      // F = C * 9/5 + 32, kept in the record's hundredths
+      if (c == RECORD_TEMP && tempUnits == TEMP_F)
+      {
+        value = ((value * 9) / 5) + 3200;
+      }
+      telemetry.addFixed(TELEMETRY_NO_KEY, value, decimals);
+    }
+    telemetry.endArray();
+  }
+}
+
+bool buildTelemetryBatch()
+{
+  telemetry.begin();
+  addTelemetryColumns(batchRecord, batchOffsetMs, batchCount, batchStartMs);
+  return true;
+}
+
+// the same columns for samples held through an outage, plus how long ago the first was taken
+// (there is no wall clock, so consumers place them from that)
+bool buildTelemetryBackfill()
+{
+  telemetry.begin();
+  addTelemetryColumns(backfillRecord, backfillOffsetMs, backfillCount, backfillStartMs);
+  telemetry.addInt(TELE_KEY_AGE, monotonicMs() - backfillStartMs);
+  return true;
+}
+
+// adds the latest readings to the batch, then publishes it once full (or old enough)
+bool sendTelemetryBatch()
+{
+  // a batch that failed to publish is held (and retried) rather than added to
+  uint64_t now = monotonicMs();
+  if (batchCount < telemetryBatchSize)
+  {
+    if (batchCount == 0)
+    {
+      batchStartMs = now;
+    }
+    batchOffsetMs[batchCount] = now - batchStartMs;
+    batchRecord[batchCount++] = current;
+  }
+
+  bool full = batchCount >= telemetryBatchSize;
+  bool old = telemetryBatchS > 0 && now - batchStartMs >= telemetryBatchS * 1000UL;
+  if (!full && !old)
+    return true;
+
+  // the publisher is backed up - keep the batch and try again next interval
+  if (publishTelemetry(buildTelemetryBatch, TELEMETRY_BATCH_SUBTOPIC, TELEMETRY_BATCH_CBOR_SUBTOPIC) == PUBLISH_FAILED)
+    return true;
+
+  batchCount = 0;
+  return true;
+}
+
+// builds the telemetry payload - written straight into the encoder's buffer from the pre-rendered keys
+// returns false if there is nothing worth publishing
+bool buildTelemetry()
+{
+  telemetry.begin();
+
+  // readings still inside their deadband are left out (all of them go out when the heartbeat is due)
+  deadband.begin(monotonicMs());
+
+  if (pmsFound)
+  {
+    bool pm1_0 = deadband.check(RECORD_PM1_0, current.pm1_0);
+    bool pm2_5 = deadband.check(RECORD_PM2_5, current.pm2_5);
+    bool pm10 = deadband.check(RECORD_PM10, current.pm10);
+
+    if (pm1_0)
+      telemetry.addInt(teleKeyRecord + RECORD_PM1_0, current.pm1_0);
+    if (pm2_5)
+      telemetry.addInt(teleKeyRecord + RECORD_PM2_5, current.pm2_5);
+    if (pm10)
+      telemetry.addInt(teleKeyRecord + RECORD_PM10, current.pm10);
+
+    for (uint8_t i = 0; i < PMS_CHANNEL_COUNT; i++)
+    {
+      if (pmsChannels & (1 << i))
+      {
+        telemetry.addInt(teleKeyPmsChannel + i, pmsChannelValue[i]);
+      }
+    }
+
+    // US-EPA AQI from the NowCast of each pollutant, once there is enough data
+    if (aqi.isAvailable())
+    {
+      uint8_t dominant = aqi.getDominant();
+      telemetry.addInt(TELE_KEY_AQI, aqi.getIndex());
+      telemetry.addString(TELE_KEY_AQI_CATEGORY, aqiCategoryName(aqi.getCategory()));
+      telemetry.addString(TELE_KEY_AQI_POLLUTANT, aqiPollutantName[dominant]);
+
+      float concentration;
+      for (uint8_t i = 0; i < AQI_POLLUTANT_COUNT; i++)
+      {
+        if (aqi.getNowCast(i, concentration))
+        {
+          telemetry.addFixed(teleKeyNowCast + i, toTenths(concentration), 1);
+        }
+        if (aqi.getMean(i, concentration))
+        {
+          telemetry.addFixed(teleKey24h + i, toTenths(concentration), 1);
+        }
+      }
+    }
+
+    // dry-equivalent readings next to the raw ones (a table lookup and a multiply each)
+    // (they follow their raw reading's deadband)
+    if (isHumidityCorrected())
+    {
+      if (pm1_0)
+        telemetry.addInt(teleKeyCorrected + RECORD_PM1_0, humidity.correct(current.pm1_0, current.hum));
+      if (pm2_5)
+        telemetry.addInt(teleKeyCorrected + RECORD_PM2_5, humidity.correct(current.pm2_5, current.hum));
+      if (pm10)
+        telemetry.addInt(teleKeyCorrected + RECORD_PM10, humidity.correct(current.pm10, current.hum));
+    }
+
+    // how many spikes the filter has taken out
+    if (pmsFilterChannels)
+    {
+      telemetry.addInt(TELE_KEY_PMS_REJECTED, pmsRejected);
+    }
+
+    // let consumers know if these are fresh readings or held from the last duty cycle
+    if (pmsState != PMS_STATE_CONTINUOUS)
+    {
+      telemetry.addString(TELE_KEY_PMS_STATE, pmsStateName(pmsState));
+      telemetry.addInt(TELE_KEY_PMS_SAMPLE_AGE, (monotonicMs() - pmsSampleMs) / 1000);
+    }
+  }
+
+  if (bmeFound)
+  {
+    if (deadband.check(RECORD_TEMP, current.temp))
+    {
+      if (tempUnits == TEMP_F)
+      {
+        telemetry.addFixed(teleKeyRecord + RECORD_TEMP, toTenths((recordTemp(current) * 1.8) + 32), 1);
       }
       else
       {
-        json["co2e"] = 0;
-        json["bvoc"] = 0;
-        json["iaqAccuracy"] = 0;
+        telemetry.addFixed(teleKeyRecord + RECORD_TEMP, toTenths(recordTemp(current)), 1);
       }
     }
+    if (deadband.check(RECORD_HUM, current.hum))
+    {
+      telemetry.addFixed(teleKeyRecord + RECORD_HUM, toTenths(recordHum(current)), 1);
+    }
+    // if accuracy is considered too low don't send data
+    if (current.iaqAccuracy > 0)
+    {
+      if (deadband.check(RECORD_CO2E, current.co2e))
+        telemetry.addInt(teleKeyRecord + RECORD_CO2E, current.co2e);
+      if (deadband.check(RECORD_BVOC, current.bvoc))
+        telemetry.addFixed(teleKeyRecord + RECORD_BVOC, toTenths(recordBvoc(current)), 1);
+      telemetry.addInt(TELE_KEY_IAQ_ACCURACY, current.iaqAccuracy);
+    }
+    else
+    {
+      if (deadband.check(RECORD_CO2E, 0))
+        telemetry.addInt(teleKeyRecord + RECORD_CO2E, 0);
+      if (deadband.check(RECORD_BVOC, 0))
+        telemetry.addInt(teleKeyRecord + RECORD_BVOC, 0);
+      telemetry.addInt(TELE_KEY_IAQ_ACCURACY, 0);
+    }
 
-    // Publish telemetry and reset loop variables if successful
-    bool haveData = !json.isNull();
-    if (haveData)
+    for (uint8_t i = 0; i < BME_EXTRA_OUTPUT_COUNT; i++)
     {
-      if (oxrs.publishTelemetry(json))
+      if (bmeExtraOutputs & (1 << i))
       {
-        lastTelemetryMs = millis();
+        telemetry.addFixed(teleKeyBmeOutput + i, toTenths(bmeExtraOutputValue[i]), 1);
       }
     }
+
+    // worst lateness of a BSEC call against its schedule since the last report
+    telemetry.addInt(TELE_KEY_BSEC_JITTER, bsecJitterMaxMs);
+  }
+
+  if (statsWindows && (pmsFound || bmeFound))
+  {
+    addStatsTelemetry(statsWindows);
+  }
+
+  if (telemetry.isEmpty())
+    return false;
+
+  // nothing has moved beyond its deadband and the heartbeat isn't due - skip this one
+  if (!deadband.isDue())
+    return false;
+
+  if (deadband.isEnabled())
+  {
+    telemetry.addInt(TELE_KEY_SENT, deadband.getSent());
+    telemetry.addInt(TELE_KEY_SUPPRESSED, deadband.getSuppressed());
+  }
+
+  // only once there has been trouble getting payloads out
+  if (publisher.getFailures() > 0)
+  {
+    telemetry.addInt(TELE_KEY_PUBLISH_QUEUE, publisher.getDepth());
+    telemetry.addInt(TELE_KEY_PUBLISH_FAILURES, publisher.getFailures());
+  }
+
+  return true;
+}
+
+// Publish telemetry and reset loop variables if successful - a failed publish is retried on the next pass
+bool sendTelemetry()
+{
+  if (!pmsFound && !bmeFound)
+    return true;
+
+  // broker is out of reach - hold the readings until it is back
+  if (!oxrs.mqttConnected)
+  {
+    backfill.push(monotonicMs(), current);
+    return true;
+  }
+
+  if (telemetryBatchSize > 1)
+    return sendTelemetryBatch();
+
+  // the publisher is backed up - hold the readings with the backfill rather than retry them on every pass
+  uint8_t result = publishTelemetry(buildTelemetry, NULL, TELEMETRY_CBOR_SUBTOPIC);
+  if (result == PUBLISH_FAILED)
+  {
+    backfill.push(monotonicMs(), current);
+    return true;
+  }
+  if (result == PUBLISH_SKIPPED)
+    return true;
+
+  deadband.sent(monotonicMs());
+  bsecJitterMaxMs = 0;
+  return true;
+}
+
+// publishes the oldest samples held through an outage - one batch a run, so reconnecting doesn't flood the broker
+bool sendBackfill()
+{
+  // live telemetry comes first - only backfill while the publisher is keeping up
+  if (!publisher.isIdle() || backfill.count() == 0)
+    return true;
+
+  backfillEntry_t entries[BACKFILL_BATCH_MAX];
+  backfillCount = backfill.peek(entries, BACKFILL_BATCH_MAX);
+  if (backfillCount == 0)
+    return true;
+
+  backfillStartMs = entries[0].timeMs;
+  for (uint8_t i = 0; i < backfillCount; i++)
+  {
+    backfillRecord[i] = entries[i].record;
+    backfillOffsetMs[i] = entries[i].timeMs - backfillStartMs;
+  }
+
+  // still held if the publisher wouldn't take it - tried again next run
+  if (publishTelemetry(buildTelemetryBackfill, BACKFILL_SUBTOPIC, BACKFILL_CBOR_SUBTOPIC) == PUBLISH_FAILED)
+    return true;
+
+  backfill.pop(backfillCount);
+  if (backfill.count() == 0)
+  {
+    Serial.printf("[AQS] backfill complete, %u sample(s) dropped while offline\n", backfill.getDropped());
+  }
+  return true;
+}
+
+// add the latest readings to the history
+bool recordHistory()
+{
+  uint32_t now = monotonicMs() / 1000;
+
+  history.append(now, current);
+  stats.update();
+  tiers.update();
+
+  // once a minute has closed, log its mean to flash (the log batches these into page sized writes)
+  uint32_t minute = now / TIER_MINUTE_STEP_S;
+  if (minute != sampleLogMinute)
+  {
+    uint32_t timeS = (minute - 1) * TIER_MINUTE_STEP_S;
+    const sensorRecord_t *record = tiers.getMean(TIER_MINUTE, timeS);
+    if (record)
+    {
+      sampleLog.append(timeS, *record);
+    }
+    sampleLogMinute = minute;
+  }
+
+  // the AQI breakpoints are for dry mass, so use the humidity corrected readings when we have them
+  if (isHumidityCorrected())
+  {
+    aqi.add(now, humidity.correct(current.pm2_5, current.hum), humidity.correct(current.pm10, current.hum));
+  }
+  else if (current.valid & RECORD_VALID_PMS)
+  {
+    aqi.add(now, current.pm2_5, current.pm10);
+  }
+  return true;
+}
+
+// write out the part filled log block, so a power cut loses at most LOG_FLUSH_INTERVAL_MS of it
+bool flushSampleLog()
+{
+  sampleLog.flush();
+  return true;
+}
+
+/**
+  Setup
+*/
+void setup()
+{
+  // Start serial - no settling delay, anything printed before a monitor attaches is simply missed
+  Serial.begin(SERIAL_BAUD_RATE);
+  Serial.println(F("[AQS] starting up..."));
+
+  // Prints out the ESP Chip Information
+  bootPhaseStart(BOOT_PHASE_ESP_INFO);
+  printEspInfo();
+  bootPhaseEnd(BOOT_PHASE_ESP_INFO);
+
+  // add control for the PMS sensor pins and turn the sensor on - it warms up while everything else starts
+  pinMode(PMS_SET, OUTPUT);   // sleep control - low is sleep
+  pinMode(PMS_RESET, OUTPUT); // Reset control - low is reset
+  digitalWrite(PMS_SET, HIGH);
+  digitalWrite(PMS_RESET, HIGH);
+
+  // boot the sensors and screen in their own tasks, so they come up alongside the network rather than before it
+  xTaskCreatePinnedToCore(sensorTask, "sensors", SENSOR_TASK_STACK_SIZE, NULL, SENSOR_TASK_PRIORITY, &sensorTaskHandle, SENSOR_TASK_CORE);
+  xTaskCreatePinnedToCore(uiTask, "ui", UI_TASK_STACK_SIZE, NULL, UI_TASK_PRIORITY, &uiTaskHandle, UI_TASK_CORE);
+
+  // uses oxrs input handler
+  pinMode(MODE_BUTTON, INPUT_PULLUP);
+  // Initialise input handlers (default to BUTTON)
+  oxrsInput.begin(inputEvent, BUTTON);
+
+  // // Start S3 hardware
+  bootPhaseStart(BOOT_PHASE_NETWORK);
+  oxrs.begin(jsonConfig, jsonCommand);
+  bootPhaseEnd(BOOT_PHASE_NETWORK);
+
+  // Rolling statistics and history for dashboards
+  oxrs.getAPI()->get("/stats", &apiStats);
+  oxrs.getAPI()->get("/history", &apiHistory);
+  oxrs.getAPI()->get("/log", &apiLog);
+
+  // Set up schema (for self-discovery and adoption)
+  setConfigSchema();
+  setCommandSchema();
+
+  // Keep a day of readings in PSRAM
+  if (!history.begin() || !stats.begin(&history) || !tiers.begin(&history))
+  {
+    Serial.println(F("[AQS] not enough memory for sensor history"));
+  }
+
+  // Pick up the sample log where the last boot left it
+  bool fsMounted = LittleFS.begin();
+  if (!fsMounted || !sampleLog.begin(LittleFS))
+  {
+    Serial.println(F("[AQS] unable to open the sample log"));
+  }
+
+  // Queue failed publishes for retry rather than rebuilding them
+  if (!publisher.begin(publishRaw, esp_random()))
+  {
+    Serial.println(F("[AQS] not enough memory for the publish queue"));
+  }
+
+  // Hold telemetry through MQTT outages, spilling to flash once PSRAM is full
+  if (!backfill.begin())
+  {
+    Serial.println(F("[AQS] not enough memory for the backfill queue"));
+  }
+  else if (fsMounted)
+  {
+    backfill.setSpill(LittleFS);
+  }
+
+  // Pre-render the telemetry keys
+  buildTelemetryTemplate();
+
+  // Register the periodic jobs run from loop()
+  scheduler.every(HISTORY_INTERVAL_MS, recordHistory);
+  scheduler.every(tftIntervalMs, sendTftInfo);
+  telemetryJob = scheduler.every(telemetryIntervalMs, sendTelemetry);
+  backfillJob = scheduler.every(backfillIntervalMs, sendBackfill);
+  scheduler.every(HASS_DISCOVERY_INTERVAL_MS, sendHassDiscovery);
+  scheduler.every(LOG_FLUSH_INTERVAL_MS, flushSampleLog);
+}
+
+/**
+  Main processing loop
+*/
+void loop()
+{
+  // Let S3 hardware handle any events etc
+  oxrs.loop();
+
+  // Retry any held telemetry whose backoff is up
+  publisher.loop(oxrs.mqttConnected, monotonicMs());
+
+  // Check for any input events
+  bool inputState = digitalRead(MODE_BUTTON);
+  oxrsInput.processInput(0, 0, inputState);
+
+  // pick up any readings from the sensor task
+  sensorSample_t sample;
+  while (netSampleQueue.pop(sample))
+  {
+    if (!isBootPhaseDone(BOOT_PHASE_FIRST_READING))
+    {
+      bootPhaseStart(BOOT_PHASE_FIRST_READING);
+      bootPhaseEnd(BOOT_PHASE_FIRST_READING);
+    }
+
+    if (sample.source == SAMPLE_PMS_STATE)
+    {
+      pmsState = sample.pms.state;
+      pmsSampleMs = sample.pms.sampleMs;
+    }
+    else if (sample.source == SAMPLE_PMS)
+    {
+      pmsFound = true;
+      pmsState = sample.pms.state;
+      pmsSampleMs = sample.pms.sampleMs;
+      current.pm1_0 = sample.pms.pm1_0;
+      current.pm2_5 = sample.pms.pm2_5;
+      current.pm10 = sample.pms.pm10;
+      current.valid |= RECORD_VALID_PMS;
+      pmsRejected = sample.pms.rejected;
+      memcpy(pmsChannelValue, sample.pms.channels, sizeof(pmsChannelValue));
+    }
     else
     {
-      lastTelemetryMs = millis();
+      bmeFound = true;
+      current.co2e = int(trunc(sample.bme.co2e));
+      current.bvoc = lroundf(sample.bme.bvoc * RECORD_BVOC_SCALE);
+      current.hum = lroundf(sample.bme.hum * RECORD_HUM_SCALE);
+      current.temp = lroundf(sample.bme.temp * RECORD_TEMP_SCALE);
+      current.iaqAccuracy = sample.bme.iaqAccuracy;
+      current.valid |= RECORD_VALID_BME;
+
+      bmeExtraOutputs = sample.bme.extraOutputs;
+      memcpy(bmeExtraOutputValue, sample.bme.extra, sizeof(bmeExtraOutputValue));
+      bsecJitterMaxMs = max(bsecJitterMaxMs, sample.bme.jitterMs);
     }
   }
 
-  // Check if we need to publish any Home Assistant discovery payloads
-  if (hass.isDiscoveryEnabled())
+  // Run any periodic jobs that are due (connection info to the Tft, telemetry, discovery)
+  scheduler.loop();
+
+  // Let the fleet see where this boot's time went
+  if (!bootTimesPublished && oxrs.mqttConnected)
   {
-    publishHassDiscovery();
+    publishBootTimes();
   }
+
+  // sensors and screen run in their own tasks - give the rest of the time back
+  delay(NETWORK_LOOP_IDLE_MS);
 }
@@ -0,0 +1,36 @@
+#include <Arduino.h>
+
+StubConsole Serial;
+HardwareSerial Serial1;
+
+uint8_t stubPinState[STUB_PIN_COUNT];
+int64_t stubTimeUs = 0;
+
+int64_t esp_timer_get_time()
+{
+    return stubTimeUs;
+}
+
+void pinMode(uint8_t, uint8_t) {}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+    if (pin < STUB_PIN_COUNT)
+        stubPinState[pin] = value;
+}
+
+int digitalRead(uint8_t pin)
+{
+    return pin < STUB_PIN_COUNT ? stubPinState[pin] : LOW;
+}
+
+unsigned long millis()
+{
+    // 32 bits like the ESP32, so it wraps after 49.7 days
+    return (uint32_t)(stubTimeUs / 1000);
+}
+
+void delay(uint32_t ms)
+{
+    stubAdvanceMs(ms);
+}
@@ -0,0 +1,142 @@
+#pragma once
+// Host stand-in for the parts of the Arduino core the firmware classes use
+//
+// Serial prints to stdout, Serial1 is a scriptable UART (see HardwareSerial), pins just hold
+// the last value written and time comes from the fake clock in esp_timer.h.
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <vector>
+
+#include "esp_timer.h"
+
+using std::max;
+using std::min;
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+#define F(string) (string)
+#define PSTR(string) (string)
+#define sprintf_P sprintf
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 1
+#define SERIAL_8N1 0
+
+#define STUB_PIN_COUNT 64
+
+// last value written to each pin
+extern uint8_t stubPinState[STUB_PIN_COUNT];
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+unsigned long millis();
+void delay(uint32_t ms);
+
+class Print
+{
+public:
+    virtual ~Print() {}
+
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size)
+    {
+        for (size_t i = 0; i < size; i++)
+            write(buffer[i]);
+        return size;
+    }
+
+    size_t print(const char *text) { return write((const uint8_t *)text, strlen(text)); }
+    size_t print(long value) { return printf("%ld", value); }
+    size_t println(const char *text) { return print(text) + println(); }
+    size_t println(long value) { return print(value) + println(); }
+    size_t println() { return print("\n"); }
+
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)))
+    {
+        char buffer[256];
+        va_list args;
+        va_start(args, format);
+        int length = vsnprintf(buffer, sizeof(buffer), format, args);
+        va_end(args);
+        return length > 0 ? write((const uint8_t *)buffer, min((size_t)length, sizeof(buffer) - 1)) : 0;
+    }
+};
+
+// the USB console - straight to stdout
+class StubConsole : public Print
+{
+public:
+    void begin(unsigned long) {}
+    size_t write(uint8_t c) override { return fputc(c, stdout) == EOF ? 0 : 1; }
+    using Print::write;
+};
+
+// A UART with a scriptable device on the other end
+//
+// inject() queues bytes as if the device sent them and fires the receive callback, the way the
+// UART event task would. Bytes the firmware writes are passed to onTransmit (and kept in tx).
+class HardwareSerial : public Print
+{
+public:
+    void begin(unsigned long, uint32_t = SERIAL_8N1, int8_t = -1, int8_t = -1) {}
+    void setRxFIFOFull(uint8_t) {}
+    void onReceive(std::function<void(void)> callback, bool = false) { _onReceive = callback; }
+
+    int available() { return _rx.size(); }
+    int read()
+    {
+        if (_rx.empty())
+            return -1;
+        uint8_t c = _rx.front();
+        _rx.pop_front();
+        return c;
+    }
+    size_t read(uint8_t *buffer, size_t size)
+    {
+        size_t count = min(size, _rx.size());
+        for (size_t i = 0; i < count; i++)
+            buffer[i] = read();
+        return count;
+    }
+
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t *buffer, size_t size) override
+    {
+        tx.insert(tx.end(), buffer, buffer + size);
+        if (onTransmit)
+            onTransmit(buffer, size);
+        return size;
+    }
+
+    // test side
+    void inject(const uint8_t *data, size_t length)
+    {
+        _rx.insert(_rx.end(), data, data + length);
+        if (_onReceive)
+            _onReceive();
+    }
+    std::function<void(const uint8_t *, size_t)> onTransmit;
+    std::vector<uint8_t> tx;
+
+private:
+    std::deque<uint8_t> _rx;
+    std::function<void(void)> _onReceive;
+};
+
+extern StubConsole Serial;
+extern HardwareSerial Serial1;
@@ -0,0 +1,144 @@
+#include <FS.h>
+
+#include <algorithm>
+#include <filesystem>
+
+int64_t stubFsWriteBudget = -1;
+
+namespace fs
+{
+    File::File(FILE *file, const std::string &name) : _file(file, fclose), _name(name) {}
+
+    File::File(const std::vector<std::string> &entries, const std::string &path)
+        : _name(std::filesystem::path(path).filename().string()), _entries(std::make_shared<std::vector<std::string>>(entries))
+    {
+    }
+
+    size_t File::read(uint8_t *buffer, size_t size)
+    {
+        return _file ? fread(buffer, 1, size, _file.get()) : 0;
+    }
+
+    int File::read()
+    {
+        uint8_t c;
+        return read(&c, 1) == 1 ? c : -1;
+    }
+
+    size_t File::write(const uint8_t *buffer, size_t size)
+    {
+        if (!_file)
+            return 0;
+
+        if (stubFsWriteBudget >= 0 && (int64_t)size > stubFsWriteBudget)
+        {
+            size = stubFsWriteBudget;
+        }
+
+        size_t written = fwrite(buffer, 1, size, _file.get());
+        if (stubFsWriteBudget >= 0)
+        {
+            stubFsWriteBudget -= written;
+        }
+
+        // nothing is buffered on the host that the device would not have written
+        fflush(_file.get());
+        return written;
+    }
+
+    bool File::seek(uint32_t position, SeekMode mode)
+    {
+        return _file && fseek(_file.get(), position, mode) == 0;
+    }
+
+    size_t File::position()
+    {
+        return _file ? ftell(_file.get()) : 0;
+    }
+
+    size_t File::size()
+    {
+        if (!_file)
+            return 0;
+
+        long current = ftell(_file.get());
+        fseek(_file.get(), 0, SEEK_END);
+        long end = ftell(_file.get());
+        fseek(_file.get(), current, SEEK_SET);
+        return end;
+    }
+
+    void File::flush()
+    {
+        if (_file)
+            fflush(_file.get());
+    }
+
+    void File::close()
+    {
+        _file.reset();
+        _entries.reset();
+    }
+
+    File File::openNextFile(const char *mode)
+    {
+        if (!_entries || _next >= _entries->size())
+            return File();
+
+        std::string path = (*_entries)[_next++];
+        if (std::filesystem::is_directory(path))
+            return File(std::vector<std::string>(), path);
+
+        FILE *file = fopen(path.c_str(), mode[0] == 'a' ? "ab+" : (mode[0] == 'w' ? "wb+" : "rb"));
+        return file ? File(file, std::filesystem::path(path).filename().string()) : File();
+    }
+
+    File FS::open(const char *path, const char *mode, bool)
+    {
+        std::string host = hostPath(path);
+
+        if (std::filesystem::is_directory(host))
+        {
+            std::vector<std::string> entries;
+            for (const auto &entry : std::filesystem::directory_iterator(host))
+            {
+                entries.push_back(entry.path().string());
+            }
+            std::sort(entries.begin(), entries.end());
+            return File(entries, host);
+        }
+
+        FILE *file = fopen(host.c_str(), mode[0] == 'a' ? "ab+" : (mode[0] == 'w' ? "wb+" : "rb"));
+        return file ? File(file, std::filesystem::path(host).filename().string()) : File();
+    }
+
+    bool FS::exists(const char *path)
+    {
+        return std::filesystem::exists(hostPath(path));
+    }
+
+    bool FS::remove(const char *path)
+    {
+        std::error_code error;
+        return std::filesystem::remove(hostPath(path), error);
+    }
+
+    bool FS::rename(const char *from, const char *to)
+    {
+        std::error_code error;
+        std::filesystem::rename(hostPath(from), hostPath(to), error);
+        return !error;
+    }
+
+    bool FS::mkdir(const char *path)
+    {
+        std::error_code error;
+        return std::filesystem::create_directory(hostPath(path), error);
+    }
+
+    bool FS::rmdir(const char *path)
+    {
+        std::error_code error;
+        return std::filesystem::is_directory(hostPath(path)) && std::filesystem::remove(hostPath(path), error);
+    }
+}
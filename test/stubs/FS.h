@@ -0,0 +1,86 @@
+#pragma once
+// Host stand-in for the Arduino file system API, backed by a directory on the host
+//
+// Paths are taken relative to the directory given to the FS, so a test can mount a scratch
+// directory as LittleFS and look at (or damage) the files afterwards. stubFsWriteBudget
+// simulates the power going mid-write - once that many more bytes have been written every
+// write comes up short, leaving whatever made it out on "flash".
+#include <stdint.h>
+#include <stdio.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+// bytes that can still be written before writes start failing - negative for no limit
+extern int64_t stubFsWriteBudget;
+
+namespace fs
+{
+    enum SeekMode
+    {
+        SeekSet = SEEK_SET,
+        SeekCur = SEEK_CUR,
+        SeekEnd = SEEK_END,
+    };
+
+    // copies share the open file, like the ESP32 core's File
+    class File
+    {
+    public:
+        File() {}
+        File(FILE *file, const std::string &name);
+        File(const std::vector<std::string> &entries, const std::string &path);
+
+        explicit operator bool() const { return _file || _entries; }
+
+        size_t read(uint8_t *buffer, size_t size);
+        int read();
+        size_t write(const uint8_t *buffer, size_t size);
+        size_t write(uint8_t c) { return write(&c, 1); }
+        bool seek(uint32_t position, SeekMode mode = SeekSet);
+        size_t position();
+        size_t size();
+        int available() { return _file ? size() - position() : 0; }
+        void flush();
+        void close();
+
+        const char *name() { return _name.c_str(); }
+        bool isDirectory() { return _entries != nullptr; }
+        File openNextFile(const char *mode = FILE_READ);
+
+    private:
+        std::shared_ptr<FILE> _file;
+        std::string _name;
+
+        // directories - the host paths of the entries and the next one to open
+        std::shared_ptr<std::vector<std::string>> _entries;
+        size_t _next = 0;
+    };
+
+    class FS
+    {
+    public:
+        FS(const std::string &root) : _root(root) {}
+
+        File open(const char *path, const char *mode = FILE_READ, bool create = false);
+        bool exists(const char *path);
+        bool remove(const char *path);
+        bool rename(const char *from, const char *to);
+        bool mkdir(const char *path);
+        bool rmdir(const char *path);
+
+        // the host path a firmware path maps to
+        std::string hostPath(const char *path) { return _root + path; }
+
+    private:
+        std::string _root;
+    };
+}
+
+using fs::File;
+using fs::FS;
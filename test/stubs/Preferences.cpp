@@ -0,0 +1,62 @@
+#include <Preferences.h>
+
+#include <string.h>
+
+std::map<std::string, stubNvsNamespace_t> stubNvs;
+bool stubNvsPowerCut = false;
+uint32_t stubNvsBytesWritten = 0;
+
+bool Preferences::begin(const char *name, bool readOnly)
+{
+    // NVS namespaces are limited to 15 characters
+    if (strlen(name) > 15)
+        return false;
+
+    _namespace = &stubNvs[name];
+    _readOnly = readOnly;
+    return true;
+}
+
+size_t Preferences::putBytes(const char *key, const void *value, size_t length)
+{
+    if (_namespace == NULL || _readOnly || stubNvsPowerCut)
+        return 0;
+
+    (*_namespace)[key].assign((const uint8_t *)value, (const uint8_t *)value + length);
+    stubNvsBytesWritten += length;
+    return length;
+}
+
+size_t Preferences::getBytesLength(const char *key)
+{
+    return isKey(key) ? (*_namespace)[key].size() : 0;
+}
+
+size_t Preferences::getBytes(const char *key, void *buffer, size_t maxLength)
+{
+    size_t length = getBytesLength(key);
+    if (length == 0 || length > maxLength)
+        return 0;
+
+    memcpy(buffer, (*_namespace)[key].data(), length);
+    return length;
+}
+
+bool Preferences::isKey(const char *key)
+{
+    return _namespace && _namespace->count(key);
+}
+
+bool Preferences::remove(const char *key)
+{
+    return _namespace && !_readOnly && _namespace->erase(key);
+}
+
+bool Preferences::clear()
+{
+    if (_namespace == NULL || _readOnly)
+        return false;
+
+    _namespace->clear();
+    return true;
+}
@@ -0,0 +1,36 @@
+#pragma once
+// Host stand-in for the ESP32 Preferences (NVS) library
+//
+// Every namespace lives in stubNvs, which survives a "reboot" (a new Preferences object) so
+// tests can look at and damage what was stored. Like NVS each putBytes() either lands whole
+// or not at all - stubNvsPowerCut makes writes fail, leaving the old value in place.
+#include <stddef.h>
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+typedef std::map<std::string, std::vector<uint8_t>> stubNvsNamespace_t;
+
+extern std::map<std::string, stubNvsNamespace_t> stubNvs;
+extern bool stubNvsPowerCut;
+extern uint32_t stubNvsBytesWritten;
+
+class Preferences
+{
+public:
+    bool begin(const char *name, bool readOnly = false);
+    void end() { _namespace = NULL; }
+
+    size_t putBytes(const char *key, const void *value, size_t length);
+    size_t getBytesLength(const char *key);
+    size_t getBytes(const char *key, void *buffer, size_t maxLength);
+    bool isKey(const char *key);
+    bool remove(const char *key);
+    bool clear();
+
+private:
+    stubNvsNamespace_t *_namespace = NULL;
+    bool _readOnly = false;
+};
@@ -0,0 +1,9 @@
+#pragma once
+#include <stdint.h>
+
+// Fake esp_timer - time only moves when a test moves it
+extern int64_t stubTimeUs;
+
+int64_t esp_timer_get_time();
+
+static inline void stubAdvanceMs(uint64_t ms) { stubTimeUs += ms * 1000; }
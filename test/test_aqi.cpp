@@ -0,0 +1,155 @@
+// classAqi against the US-EPA breakpoint tables (2024 PM2.5 revision) and the NowCast method
+#include <classAqi.h>
+
+#include <string.h>
+
+#include "testing.h"
+
+#define CHECK_NEAR(expected, actual, tolerance) CHECK((actual) >= (expected) - (tolerance) && (actual) <= (expected) + (tolerance))
+
+// both ends of every category land on its index range, and nothing falls in the gaps between them
+static void testBreakpoints()
+{
+    const float pm2_5[][2] = {{0.0, 0}, {9.0, 50}, {9.1, 51}, {35.4, 100}, {35.5, 101}, {55.4, 150}, {55.5, 151}, {125.4, 200}, {125.5, 201}, {225.4, 300}, {225.5, 301}, {325.4, 500}};
+    for (auto &bp : pm2_5)
+    {
+        CHECK_EQUAL(bp[1], aqiIndex(AQI_PM2_5, bp[0]));
+    }
+
+    const float pm10[][2] = {{0, 0}, {54, 50}, {55, 51}, {154, 100}, {155, 101}, {254, 150}, {255, 151}, {354, 200}, {355, 201}, {424, 300}, {425, 301}, {604, 500}};
+    for (auto &bp : pm10)
+    {
+        CHECK_EQUAL(bp[1], aqiIndex(AQI_PM10, bp[0]));
+    }
+}
+
+// EPA truncates rather than rounds before the lookup
+static void testTruncation()
+{
+    CHECK_EQUAL(50, aqiIndex(AQI_PM2_5, 9.09));
+    CHECK_EQUAL(100, aqiIndex(AQI_PM2_5, 35.49));
+    CHECK_EQUAL(50, aqiIndex(AQI_PM10, 54.9));
+    CHECK_EQUAL(100, aqiIndex(AQI_PM10, 154.99));
+}
+
+static void testInterpolation()
+{
+    // 49 / 26.3 * (12.0 - 9.1) + 51 = 56.4
+    CHECK_EQUAL(56, aqiIndex(AQI_PM2_5, 12.0));
+    // 50 / 9.0 * 4.5 = 25
+    CHECK_EQUAL(25, aqiIndex(AQI_PM2_5, 4.5));
+    // 49 / 99 * (100 - 55) + 51 = 73.3
+    CHECK_EQUAL(73, aqiIndex(AQI_PM10, 100));
+    // 199 / 99.9 * (300.0 - 225.5) + 301 = 449.4
+    CHECK_EQUAL(449, aqiIndex(AQI_PM2_5, 300.0));
+}
+
+static void testLimits()
+{
+    CHECK_EQUAL(0, aqiIndex(AQI_PM2_5, -3));
+    CHECK_EQUAL(0, aqiIndex(AQI_PM2_5, 0.09));
+    CHECK_EQUAL(500, aqiIndex(AQI_PM2_5, 325.5));
+    CHECK_EQUAL(500, aqiIndex(AQI_PM2_5, 1000));
+    CHECK_EQUAL(500, aqiIndex(AQI_PM10, 605));
+}
+
+static void testCategories()
+{
+    const uint16_t edges[][2] = {{0, AQI_GOOD}, {50, AQI_GOOD}, {51, AQI_MODERATE}, {100, AQI_MODERATE}, {101, AQI_USG}, {150, AQI_USG}, {151, AQI_UNHEALTHY}, {200, AQI_UNHEALTHY}, {201, AQI_VERY_UNHEALTHY}, {300, AQI_VERY_UNHEALTHY}, {301, AQI_HAZARDOUS}, {500, AQI_HAZARDOUS}};
+    for (auto &edge : edges)
+    {
+        CHECK_EQUAL(edge[1], aqiCategory(edge[0]));
+    }
+
+    CHECK(strcmp("unhealthySensitive", aqiCategoryName(AQI_USG)) == 0);
+    CHECK(strcmp("unknown", aqiCategoryName(AQI_UNKNOWN)) == 0);
+}
+
+// a reading a minute for each hour in turn, the last hour being the one in progress
+static void addHours(classAqi &aqi, uint32_t &timeS, const float *pm2_5, const float *pm10, uint8_t hours)
+{
+    for (uint8_t h = 0; h < hours; h++)
+    {
+        for (uint8_t m = 0; m < 60; m++, timeS += 60)
+        {
+            aqi.add(timeS, pm2_5[h], pm10[h]);
+        }
+    }
+}
+
+static void testNowCast()
+{
+    classAqi aqi;
+    uint32_t timeS = 0;
+    float concentration;
+
+    CHECK(!aqi.isAvailable());
+    CHECK(!aqi.getNowCast(AQI_PM2_5, concentration));
+    CHECK_EQUAL(AQI_UNKNOWN, aqi.getCategory());
+
+    // one hour is not enough
+    const float first[] = {8};
+    const float firstPm10[] = {20};
+    addHours(aqi, timeS, first, firstPm10, 1);
+    CHECK(!aqi.isAvailable());
+
+    // rising 8, 10, 12: weight = 8 / 12, so (12 + 10w + 8w^2) / (1 + w + w^2) = 10.53
+    const float rising[] = {10, 12};
+    const float risingPm10[] = {20, 200};
+    addHours(aqi, timeS, rising, risingPm10, 2);
+    CHECK(aqi.isAvailable());
+    CHECK(aqi.getNowCast(AQI_PM2_5, concentration));
+    CHECK_NEAR(10.53f, concentration, 0.01f);
+    CHECK_EQUAL(54, aqi.getIndex(AQI_PM2_5));
+
+    // PM10 swung from 20 to 200, so the weight bottoms out at 0.5: (200 + 10 + 5) / 1.75
+    CHECK(aqi.getNowCast(AQI_PM10, concentration));
+    CHECK_NEAR(122.86f, concentration, 0.01f);
+    CHECK_EQUAL(AQI_PM10, aqi.getDominant());
+    CHECK_EQUAL(aqi.getIndex(AQI_PM10), aqi.getIndex());
+    CHECK_EQUAL(AQI_MODERATE, aqi.getCategory());
+
+    CHECK(aqi.getMean(AQI_PM2_5, concentration));
+    CHECK_NEAR(10.0f, concentration, 0.01f);
+}
+
+// two of the three most recent hours are needed, and older gaps simply drop out of the average
+static void testMissingHours()
+{
+    classAqi aqi;
+    float concentration;
+
+    aqi.add(0, 20, 0);
+    aqi.add(3 * 3600, 10, 0);
+    CHECK(!aqi.isAvailable());
+
+    aqi.add(4 * 3600, 10, 0);
+    CHECK(aqi.isAvailable());
+    CHECK(aqi.getNowCast(AQI_PM2_5, concentration));
+    // 10, 10, gap, gap, 20: weight 0.5 so (10 + 5 + 1.25) / (1 + 0.5 + 0.0625)
+    CHECK_NEAR(10.4f, concentration, 0.01f);
+
+    // a day without readings forgets everything
+    aqi.add(30 * 3600, 5, 0);
+    CHECK(!aqi.isAvailable());
+    CHECK(aqi.getMean(AQI_PM2_5, concentration));
+    CHECK_NEAR(5.0f, concentration, 0.001f);
+
+    // readings from an hour already passed are ignored
+    aqi.add(29 * 3600, 500, 0);
+    CHECK(aqi.getMean(AQI_PM2_5, concentration));
+    CHECK_NEAR(5.0f, concentration, 0.001f);
+}
+
+int main()
+{
+    testBreakpoints();
+    testTruncation();
+    testInterpolation();
+    testLimits();
+    testCategories();
+    testNowCast();
+    testMissingHours();
+
+    return testResult("test_aqi");
+}
@@ -0,0 +1,143 @@
+// classDeadband - which channels go out in each payload, and the heartbeats that bound how long
+// any channel (or the payload as a whole) can stay silent
+#include <classDeadband.h>
+
+#include <vector>
+
+#include "testing.h"
+
+#define HEARTBEAT_MS 10000
+#define INTERVAL_MS 1000
+
+#define CHANNEL_BUSY 0
+#define CHANNEL_FLAT 1
+
+// one telemetry pass - the channels included, and whether the payload went at all
+static uint8_t pass(classDeadband &deadband, uint64_t nowMs, const int32_t *values, uint8_t count, bool &due)
+{
+    uint8_t included = 0;
+    deadband.begin(nowMs);
+    for (uint8_t c = 0; c < count; c++)
+    {
+        if (deadband.check(c, values[c]))
+        {
+            included |= 1 << c;
+        }
+    }
+
+    due = deadband.isDue();
+    if (due)
+    {
+        deadband.sent(nowMs);
+    }
+    return included;
+}
+
+// moves inside the band are held back, moves beyond it (absolute or percent) go out
+static void testBands()
+{
+    classDeadband deadband;
+    deadband.setHeartbeatMs(HEARTBEAT_MS);
+    deadband.setDeadband(0, 5, 0);
+    deadband.setDeadband(1, 0, 10);
+    CHECK(deadband.isEnabled());
+
+    bool due;
+    int32_t values[3] = {100, 1000, 7};
+    CHECK_EQUAL(0x7, pass(deadband, 0, values, 3, due));
+    CHECK(due);
+
+    // inside both bands - only the channel with no deadband is in, and it keeps the payload going
+    values[0] = 105;
+    values[1] = 1100;
+    CHECK_EQUAL(0x4, pass(deadband, 1000, values, 3, due));
+    CHECK(due);
+
+    // just beyond each band, measured from the last value sent rather than the last seen
+    values[0] = 94;
+    values[1] = 899;
+    CHECK_EQUAL(0x7, pass(deadband, 2000, values, 3, due));
+
+    // with the always-on channel gone quiet nothing needs to go
+    classDeadband quiet;
+    quiet.setHeartbeatMs(HEARTBEAT_MS);
+    quiet.setDeadband(0, 5, 0);
+    values[0] = 100;
+    pass(quiet, 0, values, 1, due);
+    values[0] = 103;
+    CHECK_EQUAL(0, pass(quiet, 1000, values, 1, due));
+    CHECK(!due);
+    CHECK_EQUAL(1, quiet.getSuppressed());
+    CHECK_EQUAL(1, quiet.getSent());
+
+    deadband.clearDeadbands();
+    CHECK(!deadband.isEnabled());
+}
+
+// a flat channel next to one changing every pass still goes out on its own heartbeat - the
+// payloads never stop, so the payload heartbeat alone would hold it back indefinitely
+static void testBusyNeighbour()
+{
+    classDeadband deadband;
+    deadband.setHeartbeatMs(HEARTBEAT_MS);
+    deadband.setDeadband(CHANNEL_BUSY, 5, 0);
+    deadband.setDeadband(CHANNEL_FLAT, 5, 0);
+
+    std::vector<uint64_t> flatSentMs;
+    uint32_t payloads = 0;
+    for (uint64_t nowMs = 0; nowMs <= 10 * HEARTBEAT_MS; nowMs += INTERVAL_MS)
+    {
+        int32_t values[2] = {(int32_t)(nowMs / INTERVAL_MS) * 10, 100};
+
+        bool due;
+        uint8_t included = pass(deadband, nowMs, values, 2, due);
+        CHECK(due && (included & (1 << CHANNEL_BUSY)));
+        payloads += due;
+
+        if (included & (1 << CHANNEL_FLAT))
+        {
+            flatSentMs.push_back(nowMs);
+        }
+    }
+
+    CHECK_EQUAL(101, payloads);
+    CHECK_EQUAL(11, flatSentMs.size());
+    for (size_t i = 1; i < flatSentMs.size(); i++)
+    {
+        CHECK_EQUAL(HEARTBEAT_MS, flatSentMs[i] - flatSentMs[i - 1]);
+    }
+}
+
+// with nothing moving at all the payload heartbeat still sends everything
+static void testPayloadHeartbeat()
+{
+    classDeadband deadband;
+    deadband.setHeartbeatMs(HEARTBEAT_MS);
+    deadband.setDeadband(0, 5, 0);
+    deadband.setDeadband(1, 5, 0);
+
+    std::vector<uint64_t> sentMs;
+    for (uint64_t nowMs = 0; nowMs <= 3 * HEARTBEAT_MS; nowMs += INTERVAL_MS)
+    {
+        int32_t values[2] = {100, 200};
+
+        bool due;
+        uint8_t included = pass(deadband, nowMs, values, 2, due);
+        if (due)
+        {
+            CHECK_EQUAL(0x3, included);
+            sentMs.push_back(nowMs);
+        }
+    }
+
+    CHECK(sentMs.size() == 4 && sentMs[1] == HEARTBEAT_MS && sentMs[3] == 3 * HEARTBEAT_MS);
+    CHECK_EQUAL(27, deadband.getSuppressed());
+}
+
+int main()
+{
+    testBands();
+    testBusyNeighbour();
+    testPayloadHeartbeat();
+    return testResult("test_deadband");
+}
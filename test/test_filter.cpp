@@ -0,0 +1,245 @@
+// classFilter - hand-made spike streams, a brute-force (sort the window every time) reference
+// run against long random streams for every window length, and the cost per reading of each
+#include <classFilter.h>
+
+#include <algorithm>
+#include <deque>
+#include <math.h>
+#include <random>
+#include <vector>
+
+#include "testing.h"
+
+// the textbook version - copy the window, sort it, take the median (and the median of the deviations)
+class referenceFilter
+{
+public:
+    referenceFilter(uint8_t mode, uint8_t window, float threshold) : _mode(mode), _size(window), _threshold(threshold) {}
+
+    uint16_t update(uint16_t value)
+    {
+        _window.push_back(value);
+        if (_window.size() > _size)
+        {
+            _window.pop_front();
+        }
+
+        std::vector<uint16_t> sorted(_window.begin(), _window.end());
+        std::sort(sorted.begin(), sorted.end());
+        float median = _median(sorted);
+
+        if (_mode == FILTER_MODE_MEDIAN)
+            return lroundf(median);
+
+        if (sorted.size() < 3)
+            return value;
+
+        std::vector<float> deviations;
+        for (uint16_t reading : sorted)
+        {
+            deviations.push_back(fabsf(reading - median));
+        }
+        std::sort(deviations.begin(), deviations.end());
+        float deviation = 1.4826 * _median(deviations);
+        if (deviation < FILTER_MIN_DEVIATION)
+            deviation = FILTER_MIN_DEVIATION;
+
+        if (fabsf(value - median) > _threshold * deviation)
+            return lroundf(median);
+
+        return value;
+    }
+
+private:
+    template <typename T>
+    static float _median(const std::vector<T> &sorted)
+    {
+        size_t count = sorted.size();
+        if (count & 1)
+            return sorted[count / 2];
+
+        return (sorted[count / 2 - 1] + sorted[count / 2]) / 2.0;
+    }
+
+    uint8_t _mode;
+    uint8_t _size;
+    float _threshold;
+    std::deque<uint16_t> _window;
+};
+
+static std::vector<uint16_t> run(classFilter &filter, const std::vector<uint16_t> &input)
+{
+    std::vector<uint16_t> output;
+    for (uint16_t value : input)
+    {
+        output.push_back(filter.update(value));
+    }
+    return output;
+}
+
+// PMS-like readings - a slowly moving level with a little noise, occasional single and double
+// spikes, dropouts to zero and the odd step change
+static std::vector<uint16_t> spikeStream(uint32_t length, uint32_t seed)
+{
+    std::mt19937 random(seed);
+    std::vector<uint16_t> stream;
+    int32_t level = 12;
+
+    for (uint32_t i = 0; i < length; i++)
+    {
+        uint32_t roll = random() % 1000;
+        if (roll < 2)
+        {
+            level = random() % 300;
+        }
+        int32_t value = level + (int32_t)(random() % 5) - 2;
+
+        if (roll >= 990)
+        {
+            value += 200 + random() % 800;
+        }
+        else if (roll >= 985)
+        {
+            value = 0;
+        }
+        stream.push_back(value < 0 ? 0 : value);
+
+        // some spikes last two readings
+        if (roll >= 997 && ++i < length)
+        {
+            stream.push_back(value);
+        }
+    }
+    return stream;
+}
+
+static void testMedianVectors()
+{
+    classFilter filter;
+    filter.begin(FILTER_MODE_MEDIAN, 5);
+
+    // a lone spike never gets through a 5 wide median, even right at the start
+    std::vector<uint16_t> spike = run(filter, {10, 10, 10, 900, 10, 10, 10});
+    CHECK(spike == std::vector<uint16_t>({10, 10, 10, 10, 10, 10, 10}));
+
+    // nor do two in a row
+    filter.begin(FILTER_MODE_MEDIAN, 5);
+    std::vector<uint16_t> pair = run(filter, {10, 10, 10, 900, 900, 10, 10, 10});
+    CHECK(pair == std::vector<uint16_t>({10, 10, 10, 10, 10, 10, 10, 10}));
+
+    // a real step comes through window / 2 + 1 readings late
+    filter.begin(FILTER_MODE_MEDIAN, 5);
+    std::vector<uint16_t> step = run(filter, {10, 10, 10, 10, 10, 40, 40, 40, 40});
+    CHECK(step == std::vector<uint16_t>({10, 10, 10, 10, 10, 10, 10, 40, 40}));
+
+    // even counts average the middle pair while the window fills
+    filter.begin(FILTER_MODE_MEDIAN, 5);
+    std::vector<uint16_t> filling = run(filter, {10, 13});
+    CHECK(filling == std::vector<uint16_t>({10, 12}));
+
+    // a window of one is a pass-through
+    filter.begin(FILTER_MODE_MEDIAN, 0);
+    std::vector<uint16_t> single = run(filter, {5, 900, 0, 7});
+    CHECK(single == std::vector<uint16_t>({5, 900, 0, 7}));
+}
+
+static void testHampelVectors()
+{
+    classFilter filter;
+    filter.begin(FILTER_MODE_HAMPEL, 7, 3.0);
+
+    // readings within the noise pass through untouched - unlike a median they keep their detail
+    std::vector<uint16_t> noisy = run(filter, {10, 11, 9, 10, 12, 10, 9, 11});
+    CHECK(noisy == std::vector<uint16_t>({10, 11, 9, 10, 12, 10, 9, 11}));
+    CHECK_EQUAL(0, filter.getRejected());
+
+    // a spike is replaced with the median
+    std::vector<uint16_t> spike = run(filter, {10, 600, 10});
+    CHECK(spike == std::vector<uint16_t>({10, 10, 10}));
+    CHECK_EQUAL(1, filter.getRejected());
+
+    // perfectly flat readings have no deviation - the floor lets small changes through (up to the
+    // threshold of 3) rather than rejecting every change of one
+    classFilter flatFilter;
+    flatFilter.begin(FILTER_MODE_HAMPEL, 7, 3.0);
+    std::vector<uint16_t> flat = run(flatFilter, {5, 5, 5, 5, 5, 5, 5, 6, 8, 9});
+    CHECK(flat == std::vector<uint16_t>({5, 5, 5, 5, 5, 5, 5, 6, 8, 5}));
+    CHECK_EQUAL(1, flatFilter.getRejected());
+}
+
+// the incremental filter must agree with the reference reading for reading
+static void testAgainstReference()
+{
+    std::vector<uint16_t> stream = spikeStream(20000, 1);
+    uint32_t mismatches = 0;
+    uint32_t rejected = 0;
+
+    for (uint8_t mode : {FILTER_MODE_MEDIAN, FILTER_MODE_HAMPEL})
+    {
+        for (uint8_t window = 1; window <= FILTER_WINDOW_MAX; window++)
+        {
+            for (float threshold : {2.0f, 3.0f, 6.0f})
+            {
+                classFilter filter;
+                filter.begin(mode, window, threshold);
+                referenceFilter reference(mode, window, threshold);
+
+                for (uint16_t value : stream)
+                {
+                    mismatches += filter.update(value) != reference.update(value);
+                }
+                rejected += filter.getRejected();
+            }
+        }
+    }
+
+    CHECK_EQUAL(0, mismatches);
+    CHECK(rejected > 0);
+}
+
+// spikes swamp a plain average but barely move the filtered one
+static void testSpikeSuppression()
+{
+    std::vector<uint16_t> stream = spikeStream(20000, 2);
+
+    classFilter filter;
+    filter.begin(FILTER_MODE_HAMPEL, DEFAULT_FILTER_WINDOW);
+    std::vector<uint16_t> filtered = run(filter, stream);
+
+    uint32_t spikesIn = 0;
+    uint32_t spikesOut = 0;
+    for (size_t i = 1; i < stream.size(); i++)
+    {
+        spikesIn += stream[i] > stream[i - 1] + 150;
+        spikesOut += filtered[i] > filtered[i - 1] + 150 && filtered[i] > 300;
+    }
+    printf("spikes: %u in, %u out, %u rejected\n", spikesIn, spikesOut, filter.getRejected());
+    CHECK(spikesOut * 10 < spikesIn);
+}
+
+static void benchmark()
+{
+    std::vector<uint16_t> stream = spikeStream(100000, 3);
+
+    for (uint8_t window : {5, FILTER_WINDOW_MAX})
+    {
+        classFilter filter;
+        filter.begin(FILTER_MODE_HAMPEL, window);
+        referenceFilter reference(FILTER_MODE_HAMPEL, window, DEFAULT_FILTER_THRESHOLD);
+
+        double filterNs = benchNs(stream.size(), [&](uint32_t i) { benchKeep(filter.update(stream[i])); });
+        double referenceNs = benchNs(stream.size(), [&](uint32_t i) { benchKeep(reference.update(stream[i])); });
+        printf("hampel window %2u: %.0f ns/reading, brute force %.0f ns/reading\n", window, filterNs, referenceNs);
+    }
+}
+
+int main()
+{
+    testMedianVectors();
+    testHampelVectors();
+    testAgainstReference();
+    testSpikeSuppression();
+    benchmark();
+
+    return testResult("test_filter");
+}
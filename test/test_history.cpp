@@ -0,0 +1,155 @@
+// classHistory - slot arithmetic, gaps and wrap-around, plus an append / scan benchmark over a
+// full day of records (the PSRAM numbers on the device are slower, the ratios are not)
+#include <classHistory.h>
+
+#include "testing.h"
+
+static sensorRecord_t makeRecord(uint32_t timeS)
+{
+    sensorRecord_t record = {};
+    record.pm2_5 = timeS & 0xFFFF;
+    record.temp = 2150;
+    record.valid = RECORD_VALID_PMS | RECORD_VALID_BME;
+    return record;
+}
+
+static void testAppend()
+{
+    classHistory history;
+    CHECK(history.begin(10));
+    CHECK_EQUAL(0, history.count());
+    CHECK(history.get(0) == NULL);
+    CHECK(history.getAt(0) == NULL);
+
+    history.append(100, makeRecord(100));
+    history.append(101, makeRecord(101));
+    CHECK_EQUAL(2, history.count());
+    CHECK_EQUAL(100, history.getOldestTime());
+    CHECK_EQUAL(101, history.getNewestTime());
+    CHECK_EQUAL(101, history.getAt(101)->pm2_5);
+    CHECK_EQUAL(100, history.get(0)->pm2_5);
+
+    // late and repeated seconds are ignored
+    sensorRecord_t other = makeRecord(999);
+    history.append(101, other);
+    history.append(50, other);
+    CHECK_EQUAL(2, history.count());
+    CHECK_EQUAL(101, history.getAt(101)->pm2_5);
+
+    // skipped seconds become empty slots
+    history.append(104, makeRecord(104));
+    CHECK_EQUAL(5, history.count());
+    int32_t value;
+    CHECK(!recordGet(history.getAt(102), RECORD_PM2_5, value));
+    CHECK(!recordGet(history.getAt(103), RECORD_TEMP, value));
+    CHECK(recordGet(history.getAt(104), RECORD_PM2_5, value));
+    CHECK_EQUAL(104, value);
+    CHECK(history.getAt(105) == NULL);
+    CHECK(history.getAt(99) == NULL);
+}
+
+static void testWrap()
+{
+    classHistory history;
+    history.begin(10);
+
+    for (uint32_t t = 0; t < 25; t++)
+    {
+        history.append(t, makeRecord(t));
+    }
+    CHECK_EQUAL(10, history.count());
+    CHECK_EQUAL(15, history.getOldestTime());
+    CHECK(history.getAt(14) == NULL);
+    for (uint32_t t = 15; t < 25; t++)
+    {
+        CHECK_EQUAL(t, history.getAt(t)->pm2_5);
+        CHECK_EQUAL(t, history.get(t - 15)->pm2_5);
+    }
+
+    // a gap that wraps drops the oldest seconds
+    history.append(30, makeRecord(30));
+    CHECK_EQUAL(10, history.count());
+    CHECK_EQUAL(21, history.getOldestTime());
+    CHECK_EQUAL(24, history.getAt(24)->pm2_5);
+    CHECK_EQUAL(0, history.getAt(27)->valid);
+
+    // a gap longer than the ring starts again
+    history.append(100, makeRecord(100));
+    CHECK_EQUAL(1, history.count());
+    CHECK_EQUAL(100, history.getOldestTime());
+}
+
+static void testRecordChannels()
+{
+    sensorRecord_t record = {};
+    for (uint8_t c = 0; c < RECORD_CHANNEL_COUNT; c++)
+    {
+        recordSet(record, c, c == RECORD_TEMP ? -1234 : 1000 + c);
+    }
+
+    int32_t value;
+    CHECK(!recordGet(&record, RECORD_PM2_5, value));
+    CHECK(!recordGet(NULL, RECORD_PM2_5, value));
+
+    record.valid = RECORD_VALID_PMS;
+    CHECK(recordGet(&record, RECORD_PM10, value));
+    CHECK_EQUAL(1002, value);
+    CHECK(!recordGet(&record, RECORD_HUM, value));
+
+    record.valid |= RECORD_VALID_BME;
+    CHECK(recordGet(&record, RECORD_TEMP, value));
+    CHECK_EQUAL(-1234, value);
+    CHECK(recordTemp(record) == -12.34f);
+    CHECK(recordGet(&record, RECORD_BVOC, value));
+    CHECK_EQUAL(1006, value);
+    CHECK_EQUAL(RECORD_BVOC_SCALE, recordScale(RECORD_BVOC));
+    CHECK_EQUAL(1, recordScale(RECORD_CO2E));
+}
+
+static void benchmark()
+{
+    classHistory history;
+    CHECK(history.begin());
+
+    // a day and a bit, so the last appends are overwriting the oldest slots
+    uint32_t appends = HISTORY_CAPACITY + 3600;
+    sensorRecord_t record = makeRecord(0);
+    double appendNs = benchNs(appends, [&](uint32_t t) {
+        record.pm2_5 = t;
+        history.append(t, record);
+    });
+    CHECK_EQUAL(HISTORY_CAPACITY, history.count());
+
+    // a daily mean of one channel, the worst case for a history query
+    uint64_t sum = 0;
+    uint32_t valid = 0;
+    uint32_t oldest = history.getOldestTime();
+    double scanNs = benchNs(20, [&](uint32_t) {
+        sum = 0;
+        valid = 0;
+        for (uint32_t t = oldest; t <= history.getNewestTime(); t++)
+        {
+            int32_t value;
+            if (recordGet(history.getAt(t), RECORD_PM2_5, value))
+            {
+                sum += value;
+                valid++;
+            }
+        }
+        benchKeep(sum);
+    });
+    CHECK_EQUAL(HISTORY_CAPACITY, valid);
+
+    printf("append: %.1f ns/record\n", appendNs);
+    printf("scan:   %.2f ms/day, %.1f ns/record\n", scanNs / 1e6, scanNs / HISTORY_CAPACITY);
+}
+
+int main()
+{
+    testAppend();
+    testWrap();
+    testRecordChannels();
+    benchmark();
+
+    return testResult("test_history");
+}
@@ -0,0 +1,128 @@
+// classHumidity - the kappa-Kohler growth factor, the fixed-point table against the float
+// formula over the whole input range, and the cost of a table lookup against working it out
+#include <classHumidity.h>
+
+#include <math.h>
+
+#include "testing.h"
+
+#define CHECK_NEAR(expected, actual, tolerance) CHECK(fabs((double)(actual) - (double)(expected)) <= (tolerance))
+
+static void testGrowthFactor()
+{
+    // kappa 0.4 / density 1.65 = 0.2424 - at 50% RH 1 / aw - 1 = 1
+    CHECK_NEAR(1.2424, humidityGrowthFactor(50, 0.4, 1.65), 0.0001);
+    // at 90% RH 1 / aw - 1 = 0.1111
+    CHECK_NEAR(3.1818, humidityGrowthFactor(90, 0.4, 1.65), 0.0001);
+
+    CHECK_NEAR(1.0, humidityGrowthFactor(0, 0.4, 1.65), 0);
+    CHECK_NEAR(1.0, humidityGrowthFactor(-5, 0.4, 1.65), 0);
+    CHECK_NEAR(1.0, humidityGrowthFactor(80, 0, 1.65), 0);
+
+    // clamped where the curve runs away
+    CHECK_NEAR(humidityGrowthFactor(HUMIDITY_CORRECTION_RH_MAX, 0.4, 1.65), humidityGrowthFactor(100, 0.4, 1.65), 0);
+    CHECK(isfinite(humidityGrowthFactor(100, 0.4, 1.65)));
+
+    // always growing with humidity
+    float last = 1;
+    for (float rh = 1; rh <= HUMIDITY_CORRECTION_RH_MAX; rh += 0.5)
+    {
+        float growth = humidityGrowthFactor(rh, 0.4, 1.65);
+        CHECK(growth > last);
+        last = growth;
+    }
+}
+
+static void testDisabled()
+{
+    classHumidity humidity;
+    humidity.begin(0);
+    CHECK(!humidity.isEnabled());
+    CHECK_EQUAL(123, humidity.correct(123, 9000));
+
+    humidity.begin(0.4, 0);
+    CHECK(!humidity.isEnabled());
+    CHECK_EQUAL(123, humidity.correct(123, 9000));
+
+    humidity.begin(0.4);
+    CHECK(humidity.isEnabled());
+    CHECK(humidity.correct(123, 9000) < 123);
+}
+
+// the table quantises humidity to whole percent, so it should match the float formula at the
+// nearest percent to within a count, for every humidity and across the sensor's range
+static void testAgainstFormula()
+{
+    const float kappas[] = {0.1, 0.4, 0.6};
+    uint32_t worst = 0;
+
+    for (float kappa : kappas)
+    {
+        classHumidity humidity;
+        humidity.begin(kappa);
+
+        for (uint16_t hum = 0; hum <= 10000; hum += 7)
+        {
+            float rh = roundf(hum / 100.0);
+            float growth = humidityGrowthFactor(rh, kappa, DEFAULT_HUMIDITY_DENSITY);
+
+            for (uint16_t concentration = 0; concentration <= 1000; concentration += 13)
+            {
+                long expected = lroundf(concentration / growth);
+                uint32_t error = labs(humidity.correct(concentration, hum) - expected);
+                if (error > worst)
+                {
+                    worst = error;
+                }
+            }
+        }
+    }
+
+    CHECK(worst <= 1);
+}
+
+static void testExamples()
+{
+    classHumidity humidity;
+    humidity.begin(0.4);
+
+    // dry air is left alone, 50% takes off about a fifth, 90% about two thirds
+    CHECK_EQUAL(100, humidity.correct(100, 0));
+    CHECK_EQUAL(80, humidity.correct(100, 5000));
+    CHECK_EQUAL(31, humidity.correct(100, 9000));
+
+    // rounds to the nearest percent either side
+    CHECK_EQUAL(humidity.correct(1000, 5000), humidity.correct(1000, 4950));
+    CHECK_EQUAL(humidity.correct(1000, 5000), humidity.correct(1000, 5049));
+
+    // beyond the clamp and at the top of the sensor's range, with no overflow
+    CHECK_EQUAL(humidity.correct(1000, 9500), humidity.correct(1000, 10000));
+    CHECK_EQUAL(humidity.correct(1000, 9500), humidity.correct(1000, 65535));
+    // the 14-bit factor at 95% is 2923, good to about 1 part in 5000
+    float dry = 65535 / humidityGrowthFactor(HUMIDITY_CORRECTION_RH_MAX, 0.4, DEFAULT_HUMIDITY_DENSITY);
+    CHECK_NEAR(dry, humidity.correct(65535, 10000), dry / 5000);
+}
+
+static void benchmark()
+{
+    classHumidity humidity;
+    humidity.begin(0.4);
+
+    double tableNs = benchNs(1000000, [&](uint32_t i) { benchKeep(humidity.correct(i & 0x3FF, (i * 37) % 10000)); });
+    double formulaNs = benchNs(1000000, [&](uint32_t i) {
+        float volatile kappa = 0.4;
+        benchKeep((uint16_t)lroundf((i & 0x3FF) / humidityGrowthFactor(((i * 37) % 10000) / 100.0f, kappa, DEFAULT_HUMIDITY_DENSITY)));
+    });
+    printf("correct: %.1f ns from the table, %.1f ns working it out\n", tableNs, formulaNs);
+}
+
+int main()
+{
+    testGrowthFactor();
+    testDisabled();
+    testAgainstFormula();
+    testExamples();
+    benchmark();
+
+    return testResult("test_humidity");
+}
@@ -0,0 +1,282 @@
+// classLog on a directory-backed file system, with power cuts simulated by cutting writes off
+// part way through a block (stubFsWriteBudget) and then "rebooting" into a fresh classLog
+#include <classLog.h>
+#include <classScheduler.h>
+
+#include <filesystem>
+#include <vector>
+
+#include "testing.h"
+
+#define FS_ROOT "log_fs"
+
+typedef struct
+{
+    uint32_t bootId;
+    uint32_t timeS;
+    uint16_t pm2_5;
+} replayed_t;
+
+static std::vector<replayed_t> replayed;
+
+static void collect(uint32_t bootId, uint32_t timeS, const sensorRecord_t &record)
+{
+    replayed.push_back({bootId, timeS, record.pm2_5});
+}
+
+static std::vector<replayed_t> replay(classLog &log)
+{
+    replayed.clear();
+    uint32_t count = log.replay(collect);
+    CHECK_EQUAL(replayed.size(), count);
+    return replayed;
+}
+
+static void appendEntries(classLog &log, uint32_t first, uint32_t count)
+{
+    for (uint32_t i = first; i < first + count; i++)
+    {
+        sensorRecord_t record = {};
+        record.pm2_5 = i;
+        record.valid = RECORD_VALID_PMS;
+        log.append(i * 60, record);
+    }
+}
+
+// every entry that made it back, in order and with the boot ids never going backwards
+static bool isOrdered(const std::vector<replayed_t> &entries)
+{
+    for (size_t i = 1; i < entries.size(); i++)
+    {
+        if (entries[i].pm2_5 <= entries[i - 1].pm2_5 || entries[i].bootId < entries[i - 1].bootId)
+            return false;
+    }
+    return true;
+}
+
+static fs::FS freshFs()
+{
+    std::filesystem::remove_all(FS_ROOT);
+    std::filesystem::create_directory(FS_ROOT);
+    stubFsWriteBudget = -1;
+    return fs::FS(FS_ROOT);
+}
+
+static void testAppendReplay()
+{
+    fs::FS fs = freshFs();
+
+    classLog log;
+    CHECK(log.begin(fs));
+    CHECK_EQUAL(1, log.getBootId());
+
+    appendEntries(log, 0, LOG_BLOCK_ENTRIES * 2 + 5);
+    CHECK_EQUAL(2, log.getBlocksWritten());
+    CHECK_EQUAL(LOG_BLOCK_ENTRIES * 2, replay(log).size());
+
+    log.flush();
+    log.flush();
+    std::vector<replayed_t> entries = replay(log);
+    CHECK_EQUAL(LOG_BLOCK_ENTRIES * 2 + 5, entries.size());
+    CHECK_EQUAL(3, log.getBlocksWritten());
+    CHECK(isOrdered(entries));
+    CHECK_EQUAL(60, entries[1].timeS);
+    CHECK_EQUAL(1, entries.back().bootId);
+}
+
+// clean reboots carry on in the same segment with the next boot id
+static void testCleanReboots()
+{
+    fs::FS fs = freshFs();
+
+    for (uint32_t boot = 1; boot <= 20; boot++)
+    {
+        classLog log;
+        CHECK(log.begin(fs));
+        CHECK_EQUAL(boot, log.getBootId());
+        CHECK_EQUAL(1, log.getSegmentCount());
+        CHECK_EQUAL(0, log.getRecoveredBlocks());
+
+        appendEntries(log, boot * 10, 3);
+        log.flush();
+    }
+
+    classLog log;
+    log.begin(fs);
+    std::vector<replayed_t> entries = replay(log);
+    CHECK_EQUAL(60, entries.size());
+    CHECK(isOrdered(entries));
+    CHECK_EQUAL(20, entries.back().bootId);
+    CHECK_EQUAL(1, log.getSegmentCount());
+}
+
+// the power goes half way through a block - that block is lost, nothing before it, and the
+// next boot starts a new segment rather than appending after the torn block
+static void testTornWrite()
+{
+    fs::FS fs = freshFs();
+    {
+        classLog log;
+        log.begin(fs);
+        appendEntries(log, 0, LOG_BLOCK_ENTRIES * 3);
+
+        stubFsWriteBudget = LOG_BLOCK_SIZE / 3;
+        appendEntries(log, 100, LOG_BLOCK_ENTRIES);
+        stubFsWriteBudget = -1;
+        CHECK_EQUAL(1, log.getWriteErrors());
+    }
+
+    classLog log;
+    CHECK(log.begin(fs));
+    CHECK_EQUAL(1, log.getRecoveredBlocks());
+    CHECK_EQUAL(2, log.getBootId());
+    CHECK_EQUAL(2, log.getSegmentCount());
+
+    std::vector<replayed_t> entries = replay(log);
+    CHECK_EQUAL(LOG_BLOCK_ENTRIES * 3, entries.size());
+
+    appendEntries(log, 200, 4);
+    log.flush();
+    entries = replay(log);
+    CHECK_EQUAL(LOG_BLOCK_ENTRIES * 3 + 4, entries.size());
+    CHECK(isOrdered(entries));
+    CHECK_EQUAL(2, entries.back().bootId);
+
+    // and the boot after that carries on in the new (clean) segment
+    classLog next;
+    next.begin(fs);
+    CHECK_EQUAL(0, next.getRecoveredBlocks());
+    CHECK_EQUAL(3, next.getBootId());
+    CHECK_EQUAL(2, next.getSegmentCount());
+}
+
+// a torn first block leaves the newest segment with no boot id in it - it has to come from
+// the segment before, not start again at 1
+static void testTornFirstBlock()
+{
+    fs::FS fs = freshFs();
+    for (uint8_t boot = 0; boot < 3; boot++)
+    {
+        classLog log;
+        log.begin(fs);
+        appendEntries(log, boot * 100, 5);
+        log.flush();
+    }
+
+    // boot 4 tears its last block, boot 5 tears the first block of the segment it then starts
+    for (uint8_t boot = 3; boot < 5; boot++)
+    {
+        classLog log;
+        log.begin(fs);
+        CHECK_EQUAL(4, log.getBootId());
+        stubFsWriteBudget = 10;
+        appendEntries(log, boot * 100, 5);
+        log.flush();
+        stubFsWriteBudget = -1;
+    }
+
+    classLog log;
+    log.begin(fs);
+    CHECK_EQUAL(4, log.getBootId());
+    CHECK_EQUAL(1, log.getRecoveredBlocks());
+
+    appendEntries(log, 600, 1);
+    log.flush();
+    std::vector<replayed_t> entries = replay(log);
+    CHECK_EQUAL(16, entries.size());
+    CHECK(isOrdered(entries));
+    CHECK_EQUAL(4, entries.back().bootId);
+}
+
+// a filled segment is closed off and the oldest go once there are too many
+static void testRotation()
+{
+    fs::FS fs = freshFs();
+
+    classLog log;
+    log.begin(fs);
+    uint32_t blocks = LOG_SEGMENT_BLOCKS * (LOG_SEGMENT_COUNT + 2) + 10;
+    appendEntries(log, 0, blocks * LOG_BLOCK_ENTRIES);
+    CHECK_EQUAL(LOG_SEGMENT_COUNT, log.getSegmentCount());
+
+    std::vector<replayed_t> entries = replay(log);
+    CHECK_EQUAL(((LOG_SEGMENT_COUNT - 1) * LOG_SEGMENT_BLOCKS + 10) * LOG_BLOCK_ENTRIES, entries.size());
+    CHECK(isOrdered(entries));
+    CHECK_EQUAL(blocks * LOG_BLOCK_ENTRIES - 1, entries.back().pm2_5);
+
+    uint32_t files = 0;
+    for (auto &entry : std::filesystem::directory_iterator(FS_ROOT LOG_DIR))
+    {
+        (void)entry;
+        files++;
+    }
+    CHECK_EQUAL(LOG_SEGMENT_COUNT, files);
+
+    classLog next;
+    next.begin(fs);
+    CHECK_EQUAL(LOG_SEGMENT_COUNT, next.getSegmentCount());
+    CHECK_EQUAL(entries.size(), replay(next).size());
+}
+
+// with a minute record and the flush job run off the scheduler, a power cut at any moment
+// loses no more than LOG_FLUSH_INTERVAL_MS of entries
+static classLog *flushedLog;
+static uint32_t minutesLogged;
+
+static bool logMinute()
+{
+    appendEntries(*flushedLog, minutesLogged++, 1);
+    return true;
+}
+
+static bool flushLog()
+{
+    flushedLog->flush();
+    return true;
+}
+
+static void testFlushBound()
+{
+    uint32_t worst = 0;
+
+    for (uint32_t cutMinutes = 1; cutMinutes < 60; cutMinutes += 7)
+    {
+        fs::FS fs = freshFs();
+        {
+            classLog log;
+            log.begin(fs);
+            flushedLog = &log;
+            minutesLogged = 0;
+
+            classScheduler scheduler;
+            scheduler.every(60000, logMinute);
+            scheduler.every(LOG_FLUSH_INTERVAL_MS, flushLog);
+            for (uint32_t s = 0; s < cutMinutes * 60 + 30; s++)
+            {
+                stubAdvanceMs(1000);
+                scheduler.loop();
+            }
+        }
+
+        classLog log;
+        log.begin(fs);
+        uint32_t lost = minutesLogged - replay(log).size();
+        worst = max(worst, lost);
+    }
+
+    CHECK(worst * 60000 <= LOG_FLUSH_INTERVAL_MS);
+    CHECK(worst > 0);
+}
+
+int main()
+{
+    testAppendReplay();
+    testCleanReboots();
+    testTornWrite();
+    testTornFirstBlock();
+    testRotation();
+    testFlushBound();
+
+    std::filesystem::remove_all(FS_ROOT);
+    return testResult("test_log");
+}
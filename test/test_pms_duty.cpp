@@ -0,0 +1,273 @@
+// Duty-cycled PMS7003 sampling against a simulated sensor
+//
+// The simulated PMS7003 sits on the far end of the stub UART and the SET pin. While awake in
+// active mode it streams frames, with junk readings until its fan and laser have warmed up,
+// and in passive mode it answers read requests. It also sends one last active frame just
+// after being switched to passive, like a frame already in flight on the real line.
+#include <classPms.h>
+
+#include <deque>
+#include <vector>
+
+#include "testing.h"
+
+#define SET_PIN 41
+
+// what the sensor reports once settled, while warming up, and in active mode
+#define SETTLED_VALUE 10
+#define WARMUP_VALUE 500
+#define ACTIVE_VALUE 77
+#define DUPLICATE_VALUE 300
+
+#define SENSOR_WARMUP_MS 30000
+#define SENSOR_ACTIVE_PERIOD_MS 900
+#define SENSOR_REPLY_MS 40
+
+class mockPms
+{
+public:
+    mockPms()
+    {
+        Serial1.onTransmit = [this](const uint8_t *data, size_t length) { _command.insert(_command.end(), data, data + length); };
+    }
+
+    // runs the sensor up to now
+    void tick(uint64_t now)
+    {
+        bool awake = digitalRead(SET_PIN) == HIGH;
+        if (awake && !_awake)
+        {
+            _wokeMs = now;
+            _nextActiveMs = now + SENSOR_ACTIVE_PERIOD_MS;
+        }
+        _awake = awake;
+
+        _parseCommands(now);
+
+        if (!_awake || muted)
+        {
+            _pending.clear();
+            return;
+        }
+
+        if (_active && now >= _nextActiveMs)
+        {
+            _send(ACTIVE_VALUE, now);
+            _nextActiveMs += SENSOR_ACTIVE_PERIOD_MS;
+        }
+
+        while (!_pending.empty() && _pending.front().first <= now)
+        {
+            _sendFrame(_pending.front().second);
+            _pending.pop_front();
+        }
+    }
+
+    bool isActive() { return _active; }
+
+    bool muted = false;
+    // answers each read request twice, the second time with DUPLICATE_VALUE
+    bool duplicateReplies = false;
+    uint32_t readRequests = 0;
+
+private:
+    void _parseCommands(uint64_t now)
+    {
+        while (_command.size() >= PMS_COMMAND_SIZE)
+        {
+            if (_command[0] != PMS_FRAME_START_1 || _command[1] != PMS_FRAME_START_2)
+            {
+                _command.pop_front();
+                continue;
+            }
+
+            uint8_t command = _command[2];
+            uint8_t data = _command[4];
+            _command.erase(_command.begin(), _command.begin() + PMS_COMMAND_SIZE);
+
+            if (command == PMS_CMD_MODE)
+            {
+                // the frame already on the wire still arrives
+                if (_active && data == PMS_MODE_PASSIVE && _awake)
+                {
+                    _pending.push_back({now + 20, _value(ACTIVE_VALUE, now)});
+                }
+                _active = data == PMS_MODE_ACTIVE;
+            }
+            else if (command == PMS_CMD_READ && !_active)
+            {
+                readRequests++;
+                _pending.push_back({now + SENSOR_REPLY_MS, _value(SETTLED_VALUE, now)});
+                if (duplicateReplies)
+                {
+                    _pending.push_back({now + SENSOR_REPLY_MS + 5, _value(DUPLICATE_VALUE, now)});
+                }
+            }
+        }
+    }
+
+    uint16_t _value(uint16_t settled, uint64_t now) { return now - _wokeMs < SENSOR_WARMUP_MS ? WARMUP_VALUE : settled; }
+
+    void _send(uint16_t value, uint64_t now) { _sendFrame(_value(value, now)); }
+
+    void _sendFrame(uint16_t value)
+    {
+        uint8_t frame[PMS_FRAME_SIZE] = {PMS_FRAME_START_1, PMS_FRAME_START_2, 0, PMS_FRAME_LENGTH};
+        for (uint8_t i = 0; i < PMS_FRAME_WORDS; i++)
+        {
+            frame[4 + (i * 2)] = value >> 8;
+            frame[5 + (i * 2)] = value & 0xFF;
+        }
+
+        uint16_t checksum = 0;
+        for (uint8_t i = 0; i < PMS_FRAME_SIZE - 2; i++)
+        {
+            checksum += frame[i];
+        }
+        frame[PMS_FRAME_SIZE - 2] = checksum >> 8;
+        frame[PMS_FRAME_SIZE - 1] = checksum & 0xFF;
+
+        Serial1.inject(frame, PMS_FRAME_SIZE);
+    }
+
+    bool _awake = false;
+    bool _active = true;
+    uint64_t _wokeMs = 0;
+    uint64_t _nextActiveMs = 0;
+
+    std::deque<uint8_t> _command;
+    std::deque<std::pair<uint64_t, uint16_t>> _pending;
+};
+
+typedef struct
+{
+    uint64_t timeMs;
+    uint16_t pm2_5;
+} sample_t;
+
+// runs the sensor and the sampling state machine for the given time in 10ms steps
+static std::vector<sample_t> run(classPms &pms, mockPms &sensor, uint32_t durationMs)
+{
+    std::vector<sample_t> samples;
+    for (uint32_t elapsed = 0; elapsed < durationMs; elapsed += 10)
+    {
+        stubAdvanceMs(10);
+        sensor.tick(monotonicMs());
+        if (pms.loop())
+        {
+            samples.push_back({monotonicMs(), pms.getSample()->pm2_5});
+        }
+    }
+    return samples;
+}
+
+static void testDutyCycle()
+{
+    mockPms sensor;
+    classPms pms;
+    pms.begin(&Serial1, SET_PIN);
+    pms.setDutyCycle(60, 30, 5);
+
+    uint64_t startMs = monotonicMs();
+    CHECK_EQUAL(HIGH, digitalRead(SET_PIN));
+    CHECK_EQUAL(PMS_STATE_WARMUP, pms.getState());
+
+    // nothing reported while warming up, however many frames arrive
+    std::vector<sample_t> samples = run(pms, sensor, 29000);
+    CHECK_EQUAL(0, samples.size());
+    CHECK_EQUAL(PMS_STATE_WARMUP, pms.getState());
+
+    // switched to passive, asked for 5 frames and averaged only those - no warm-up or in-flight active frames
+    samples = run(pms, sensor, 10000);
+    CHECK_EQUAL(1, samples.size());
+    CHECK_EQUAL(SETTLED_VALUE, samples[0].pm2_5);
+    CHECK(!sensor.isActive());
+    CHECK_EQUAL(5, sensor.readRequests);
+    CHECK_EQUAL(PMS_STATE_SLEEPING, pms.getState());
+    CHECK_EQUAL(LOW, digitalRead(SET_PIN));
+    CHECK_EQUAL(0, pms.getSampleTimeouts());
+
+    // one sample a minute after that, each one taken after a fresh warm-up
+    samples = run(pms, sensor, 10 * 60000);
+    CHECK_EQUAL(10, samples.size());
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        CHECK_EQUAL(SETTLED_VALUE, samples[i].pm2_5);
+        if (i > 0)
+        {
+            CHECK_EQUAL(60000, samples[i].timeMs - samples[i - 1].timeMs);
+        }
+    }
+    CHECK((samples[0].timeMs - startMs) % 60000 < 40000);
+}
+
+// a sensor that stops answering costs one cycle, not the scheduler
+static void testTimeout()
+{
+    mockPms sensor;
+    classPms pms;
+    pms.begin(&Serial1, SET_PIN);
+    pms.setDutyCycle(60, 30, 5);
+
+    sensor.muted = true;
+    std::vector<sample_t> samples = run(pms, sensor, 59000);
+    CHECK_EQUAL(0, samples.size());
+    CHECK_EQUAL(1, pms.getSampleTimeouts());
+    CHECK_EQUAL(PMS_STATE_SLEEPING, pms.getState());
+
+    sensor.muted = false;
+    samples = run(pms, sensor, 61000);
+    CHECK_EQUAL(1, samples.size());
+    CHECK_EQUAL(SETTLED_VALUE, samples[0].pm2_5);
+    CHECK_EQUAL(1, pms.getSampleTimeouts());
+}
+
+// a sensor answering each request twice still only has one frame per request averaged
+static void testDuplicateReplies()
+{
+    mockPms sensor;
+    sensor.duplicateReplies = true;
+    classPms pms;
+    pms.begin(&Serial1, SET_PIN);
+    pms.setDutyCycle(60, 30, 5);
+
+    std::vector<sample_t> samples = run(pms, sensor, 40000);
+    CHECK_EQUAL(1, samples.size());
+    if (!samples.empty())
+    {
+        CHECK_EQUAL(SETTLED_VALUE, samples[0].pm2_5);
+    }
+    CHECK_EQUAL(5, sensor.readRequests);
+    CHECK_EQUAL(0, pms.getSampleTimeouts());
+}
+
+// an interval of zero goes back to streaming every frame
+static void testContinuous()
+{
+    mockPms sensor;
+    classPms pms;
+    pms.begin(&Serial1, SET_PIN);
+    pms.setDutyCycle(60, 30, 5);
+    run(pms, sensor, 45000);
+
+    pms.setDutyCycle(0, 30, 5);
+    CHECK_EQUAL(PMS_STATE_CONTINUOUS, pms.getState());
+    CHECK_EQUAL(HIGH, digitalRead(SET_PIN));
+
+    // the sensor was asleep, so it streams warm-up junk before settling
+    std::vector<sample_t> samples = run(pms, sensor, 40000);
+    CHECK(sensor.isActive());
+    CHECK(samples.size() >= 40);
+    CHECK_EQUAL(ACTIVE_VALUE, samples.back().pm2_5);
+    CHECK(!pms.isDutyCycled());
+}
+
+int main()
+{
+    testDutyCycle();
+    testTimeout();
+    testDuplicateReplies();
+    testContinuous();
+
+    return testResult("test_pms_duty");
+}
@@ -0,0 +1,252 @@
+// Replay harness for the PMS7003 frame parser
+//
+// Feeds byte streams through classPms::feed() the way the UART event task does - clean,
+// split at every possible point, corrupted and back to back - and checks every good frame
+// comes out once, in order, with the bad ones counted. Reports parser throughput.
+//
+//   test_pms_replay [capture.bin]   also replays a raw capture of the sensor's UART
+#include <classPms.h>
+
+#include <random>
+#include <vector>
+
+#include "testing.h"
+
+typedef std::vector<uint8_t> bytes_t;
+
+// a frame whose data words are base, base + 1, ... (so each one is recognisable)
+static void appendFrame(bytes_t &stream, uint16_t base)
+{
+    uint8_t frame[PMS_FRAME_SIZE] = {PMS_FRAME_START_1, PMS_FRAME_START_2, 0, PMS_FRAME_LENGTH};
+    for (uint8_t i = 0; i < PMS_FRAME_WORDS; i++)
+    {
+        frame[4 + (i * 2)] = (base + i) >> 8;
+        frame[5 + (i * 2)] = (base + i) & 0xFF;
+    }
+
+    uint16_t checksum = 0;
+    for (uint8_t i = 0; i < PMS_FRAME_SIZE - 2; i++)
+    {
+        checksum += frame[i];
+    }
+    frame[PMS_FRAME_SIZE - 2] = checksum >> 8;
+    frame[PMS_FRAME_SIZE - 1] = checksum & 0xFF;
+
+    stream.insert(stream.end(), frame, frame + PMS_FRAME_SIZE);
+}
+
+// feeds the stream in chunks of the given sizes (cycled), draining the frame queue after each
+// like loop() would - returns the base value of every frame received
+static std::vector<uint16_t> replay(classPms &pms, const bytes_t &stream, const std::vector<size_t> &chunks)
+{
+    std::vector<uint16_t> received;
+    size_t offset = 0;
+
+    for (size_t c = 0; offset < stream.size(); c++)
+    {
+        size_t length = min(chunks[c % chunks.size()], stream.size() - offset);
+        pms.feed(&stream[offset], length);
+        offset += length;
+
+        const pmsFrame_t *frame;
+        while ((frame = pms.peek()) != NULL)
+        {
+            received.push_back(pmsWord(frame->pm1_0Cf1));
+            CHECK_EQUAL(pmsWord(frame->pm1_0Cf1) + 12, pmsWord(frame->reserved));
+            pms.pop();
+        }
+    }
+    return received;
+}
+
+static void testBackToBack()
+{
+    bytes_t stream;
+    for (uint16_t i = 0; i < 1000; i++)
+    {
+        appendFrame(stream, i * 16);
+    }
+
+    classPms pms;
+    std::vector<uint16_t> received = replay(pms, stream, {PMS_FRAME_SIZE * 4});
+
+    CHECK_EQUAL(1000, received.size());
+    for (size_t i = 0; i < received.size(); i++)
+    {
+        CHECK_EQUAL(i * 16, received[i]);
+    }
+    CHECK_EQUAL(0, pms.getChecksumErrors());
+    CHECK_EQUAL(0, pms.getSkippedBytes());
+    CHECK_EQUAL(0, pms.getOverflows());
+}
+
+// every split point of a pair of frames, then random chunking of a long stream
+static void testSplitFrames()
+{
+    bytes_t pair;
+    appendFrame(pair, 100);
+    appendFrame(pair, 200);
+
+    for (size_t split = 1; split < pair.size(); split++)
+    {
+        classPms pms;
+        std::vector<uint16_t> received = replay(pms, pair, {split, pair.size()});
+        CHECK_EQUAL(2, received.size());
+        CHECK_EQUAL(0, pms.getChecksumErrors());
+    }
+
+    bytes_t stream;
+    for (uint16_t i = 0; i < 500; i++)
+    {
+        appendFrame(stream, i);
+    }
+
+    std::mt19937 random(1);
+    std::vector<size_t> chunks;
+    for (int i = 0; i < 64; i++)
+    {
+        chunks.push_back(1 + (random() % 40));
+    }
+
+    classPms pms;
+    std::vector<uint16_t> received = replay(pms, stream, chunks);
+    CHECK_EQUAL(500, received.size());
+    CHECK_EQUAL(0, pms.getSkippedBytes());
+}
+
+// corrupt frames are rejected without losing the good ones around them
+static void testCorruption()
+{
+    bytes_t stream;
+    size_t expected = 0;
+    for (uint16_t i = 0; i < 300; i++)
+    {
+        size_t start = stream.size();
+        appendFrame(stream, i);
+
+        switch (i % 10)
+        {
+        case 3:
+            // a flipped data bit - fails its checksum
+            stream[start + 10] ^= 0x04;
+            break;
+        case 6:
+            // a bad length - dropped as soon as the header is read
+            stream[start + 3] = 0x1D;
+            break;
+        case 8:
+            // line noise (including a stray header) between frames
+            stream.insert(stream.begin() + start, {0x00, 0x42, 0x4D, 0x42, 0xFF, 0x4D});
+            expected++;
+            break;
+        default:
+            expected++;
+        }
+    }
+
+    // cut off part way through a frame at the end
+    appendFrame(stream, 999);
+    stream.resize(stream.size() - 5);
+
+    classPms pms;
+    std::vector<uint16_t> received = replay(pms, stream, {7, 33, 64});
+
+    CHECK_EQUAL(expected, received.size());
+    CHECK_EQUAL(30, pms.getChecksumErrors());
+    CHECK(pms.getSkippedBytes() > 0);
+    for (uint16_t value : received)
+    {
+        CHECK(value % 10 != 3 && value % 10 != 6);
+    }
+}
+
+// the queue holds PMS_FRAME_QUEUE_SIZE - 1 frames if loop() falls behind - the rest are counted, not corrupted
+static void testOverflow()
+{
+    bytes_t stream;
+    for (uint16_t i = 0; i < 20; i++)
+    {
+        appendFrame(stream, i);
+    }
+
+    classPms pms;
+    pms.feed(stream.data(), stream.size());
+
+    CHECK_EQUAL(PMS_FRAME_QUEUE_SIZE - 1, pms.available());
+    CHECK_EQUAL(20 - (PMS_FRAME_QUEUE_SIZE - 1), pms.getOverflows());
+    CHECK_EQUAL(0, pmsWord(pms.peek()->pm1_0Cf1));
+}
+
+static void benchmark()
+{
+    bytes_t stream;
+    for (uint16_t i = 0; i < 2000; i++)
+    {
+        appendFrame(stream, i);
+    }
+
+    classPms pms;
+    uint32_t frames = 0;
+    double ns = benchNs(50, [&](uint32_t) {
+        for (size_t offset = 0; offset < stream.size(); offset += PMS_FRAME_SIZE)
+        {
+            pms.feed(&stream[offset], PMS_FRAME_SIZE);
+            pms.pop();
+            frames++;
+        }
+    });
+
+    printf("parser: %.0f frames/s (%.1f ns/byte)\n", 2000 / (ns / 1e9), ns / stream.size());
+    CHECK_EQUAL(frames, pms.getFrameCount());
+}
+
+static void replayCapture(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        printf("can't open %s\n", path);
+        testFailures++;
+        return;
+    }
+
+    bytes_t stream;
+    uint8_t buffer[4096];
+    size_t length;
+    while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        stream.insert(stream.end(), buffer, buffer + length);
+    }
+    fclose(file);
+
+    // the UART hands over a FIFO threshold's worth at a time
+    classPms pms;
+    size_t frames = 0;
+    for (size_t offset = 0; offset < stream.size(); offset += PMS_RX_FIFO_THRESHOLD)
+    {
+        pms.feed(&stream[offset], min((size_t)PMS_RX_FIFO_THRESHOLD, stream.size() - offset));
+        while (pms.peek() != NULL)
+        {
+            pms.pop();
+            frames++;
+        }
+    }
+
+    printf("%s: %zu bytes, %zu frames, %u checksum rejects, %u bytes skipped\n", path, stream.size(), frames, pms.getChecksumErrors(), pms.getSkippedBytes());
+}
+
+int main(int argc, char **argv)
+{
+    testBackToBack();
+    testSplitFrames();
+    testCorruption();
+    testOverflow();
+    benchmark();
+
+    if (argc > 1)
+    {
+        replayCapture(argv[1]);
+    }
+
+    return testResult("test_pms_replay");
+}
@@ -0,0 +1,274 @@
+// classPublisher against a PubSubClient stand-in that drops or delays publishes
+//
+// The broker is a callback that records what reached it and fails on demand, and time is
+// stepped a millisecond at a time, so every retry can be checked against the backoff it
+// should have waited out.
+#include <classPublisher.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "testing.h"
+
+// the broker - takes a publish unless it is down, or only every acceptEvery'th attempt when slow
+static bool brokerUp = true;
+static uint32_t acceptEvery = 1;
+static uint32_t attempts = 0;
+static std::vector<uint64_t> attemptMs;
+static std::vector<std::string> received;
+static uint64_t nowMs = 0;
+
+static bool brokerPublish(const char *payload, size_t length, const char *subtopic)
+{
+    attempts++;
+    attemptMs.push_back(nowMs);
+    if (!brokerUp || attempts % acceptEvery != 0)
+        return false;
+
+    received.push_back(std::string(subtopic ? subtopic : "") + ":" + std::string(payload, length));
+    return true;
+}
+
+static void reset()
+{
+    brokerUp = true;
+    acceptEvery = 1;
+    attempts = 0;
+    attemptMs.clear();
+    received.clear();
+    nowMs = 0;
+}
+
+static uint8_t publish(classPublisher &publisher, const char *payload, const char *subtopic = NULL)
+{
+    return publisher.publish(payload, strlen(payload), subtopic, nowMs);
+}
+
+static void run(classPublisher &publisher, uint64_t ms, bool online = true)
+{
+    for (uint64_t end = nowMs + ms; nowMs < end; nowMs++)
+    {
+        publisher.loop(online, nowMs);
+    }
+}
+
+// the expected wait, jitter included
+static bool withinJitter(uint64_t waitMs, uint32_t backoffMs)
+{
+    uint32_t spread = backoffMs * PUBLISHER_JITTER_PERCENT / 100;
+    return waitMs >= backoffMs - spread && waitMs <= backoffMs + spread;
+}
+
+// nothing queued - straight out, and nothing touched by loop()
+static void testSend()
+{
+    reset();
+    classPublisher publisher;
+    CHECK(publisher.begin(brokerPublish, 1));
+
+    CHECK_EQUAL(PUBLISHER_SENT, publish(publisher, "one"));
+    CHECK_EQUAL(PUBLISHER_SENT, publish(publisher, "two", "cbor"));
+    run(publisher, 1000);
+
+    CHECK_EQUAL(2, attempts);
+    CHECK(received.size() == 2 && received[0] == ":one" && received[1] == "cbor:two");
+    CHECK(publisher.isIdle());
+    CHECK_EQUAL(PUBLISHER_STATE_OK, publisher.getState());
+    CHECK_EQUAL(2, publisher.getSent());
+    CHECK_EQUAL(0, publisher.getFailures());
+    CHECK_EQUAL(0, publisher.getRejected());
+}
+
+// with the broker down the retries back off 500ms, 1s, 2s... up to 30s, never on every pass
+static void testBackoff()
+{
+    reset();
+    classPublisher publisher;
+    CHECK(publisher.begin(brokerPublish, 1234));
+
+    brokerUp = false;
+    CHECK_EQUAL(PUBLISHER_QUEUED, publish(publisher, "held"));
+    CHECK_EQUAL(PUBLISHER_STATE_RETRYING, publisher.getState());
+    CHECK(!publisher.isIdle());
+
+    run(publisher, 5 * 60 * 1000);
+
+    // 500ms doubling to the 30s cap is 0.5+1+2+4+8+16 = 31.5s, then 30s apiece
+    CHECK(attemptMs.size() >= 12 && attemptMs.size() <= 16);
+    uint32_t backoffMs = PUBLISHER_BACKOFF_MIN_MS;
+    for (size_t i = 1; i < attemptMs.size(); i++)
+    {
+        uint64_t waitMs = attemptMs[i] - attemptMs[i - 1];
+        if (!withinJitter(waitMs, backoffMs))
+        {
+            printf("retry %zu waited %llu ms, backoff %u ms\n", i, (unsigned long long)waitMs, backoffMs);
+            testFailures++;
+        }
+        backoffMs = backoffMs * 2 > PUBLISHER_BACKOFF_MAX_MS ? PUBLISHER_BACKOFF_MAX_MS : backoffMs * 2;
+    }
+    CHECK_EQUAL(attempts, publisher.getFailures());
+    CHECK_EQUAL(1, publisher.getDepth());
+
+    // the held copy goes on the next attempt once the broker is back, and the backoff resets
+    brokerUp = true;
+    run(publisher, PUBLISHER_BACKOFF_MAX_MS * 2);
+    CHECK(received.size() == 1 && received[0] == ":held");
+    CHECK(publisher.isIdle());
+
+    brokerUp = false;
+    attemptMs.clear();
+    CHECK_EQUAL(PUBLISHER_QUEUED, publish(publisher, "again"));
+    run(publisher, 1000);
+    CHECK(attemptMs.size() == 2 && withinJitter(attemptMs[1] - attemptMs[0], PUBLISHER_BACKOFF_MIN_MS));
+}
+
+// the jitter actually spreads a fleet out - different seeds, different first waits
+static void testJitter()
+{
+    uint64_t shortest = UINT64_MAX;
+    uint64_t longest = 0;
+
+    for (uint32_t seed = 1; seed <= 100; seed++)
+    {
+        reset();
+        classPublisher publisher;
+        publisher.begin(brokerPublish, seed);
+
+        brokerUp = false;
+        publish(publisher, "x");
+        run(publisher, PUBLISHER_BACKOFF_MIN_MS * 2);
+        CHECK_EQUAL(2, attemptMs.size());
+
+        uint64_t waitMs = attemptMs[1] - attemptMs[0];
+        CHECK(withinJitter(waitMs, PUBLISHER_BACKOFF_MIN_MS));
+        shortest = waitMs < shortest ? waitMs : shortest;
+        longest = waitMs > longest ? waitMs : longest;
+    }
+
+    CHECK(longest - shortest >= PUBLISHER_BACKOFF_MIN_MS * PUBLISHER_JITTER_PERCENT / 100);
+}
+
+// order is kept across the queue, and what doesn't fit is handed back rather than dropped
+static void testQueue()
+{
+    reset();
+    classPublisher publisher;
+    CHECK(publisher.begin(brokerPublish, 7));
+
+    CHECK_EQUAL(PUBLISHER_SENT, publish(publisher, "a"));
+
+    brokerUp = false;
+    CHECK_EQUAL(PUBLISHER_QUEUED, publish(publisher, "b"));
+    brokerUp = true;
+
+    // queued behind "b" even though the broker would take them now
+    CHECK_EQUAL(PUBLISHER_QUEUED, publish(publisher, "c", "cbor"));
+    CHECK_EQUAL(PUBLISHER_QUEUED, publish(publisher, "d"));
+    CHECK_EQUAL(PUBLISHER_QUEUED, publish(publisher, "e"));
+    CHECK_EQUAL(PUBLISHER_QUEUE_SIZE, publisher.getDepth());
+    CHECK_EQUAL(PUBLISHER_REJECTED, publish(publisher, "full"));
+    CHECK_EQUAL(2, attempts);
+
+    run(publisher, 1000);
+    CHECK(received.size() == 5 && received[1] == ":b" && received[2] == "cbor:c" && received[3] == ":d" && received[4] == ":e");
+    CHECK(publisher.isIdle());
+    CHECK_EQUAL(5, publisher.getSent());
+    CHECK_EQUAL(1, publisher.getFailures());
+    CHECK_EQUAL(1, publisher.getRejected());
+
+    // a failed payload too big for a slot is rejected, not truncated
+    std::string large(PUBLISHER_PAYLOAD_MAX + 1, 'x');
+    brokerUp = false;
+    CHECK_EQUAL(PUBLISHER_REJECTED, publish(publisher, large.c_str()));
+    CHECK_EQUAL(0, publisher.getDepth());
+
+    // one that just fits is kept whole
+    large.pop_back();
+    CHECK_EQUAL(PUBLISHER_QUEUED, publish(publisher, large.c_str()));
+    brokerUp = true;
+    run(publisher, 1000);
+    CHECK(received.size() == 6 && received[5] == ":" + large);
+}
+
+// offline nothing is attempted and new payloads go back to the caller
+static void testOffline()
+{
+    reset();
+    classPublisher publisher;
+    CHECK(publisher.begin(brokerPublish, 42));
+
+    brokerUp = false;
+    CHECK_EQUAL(PUBLISHER_QUEUED, publish(publisher, "held"));
+    uint32_t before = attempts;
+
+    run(publisher, 60000, false);
+    CHECK_EQUAL(PUBLISHER_STATE_OFFLINE, publisher.getState());
+    CHECK_EQUAL(before, attempts);
+    CHECK_EQUAL(PUBLISHER_REJECTED, publish(publisher, "new"));
+    CHECK_EQUAL(before, attempts);
+    CHECK_EQUAL(1, publisher.getDepth());
+
+    // back online - a short jittered wait, then the held payload goes
+    brokerUp = true;
+    uint64_t onlineMs = nowMs;
+    publisher.loop(true, nowMs);
+    CHECK_EQUAL(PUBLISHER_STATE_RETRYING, publisher.getState());
+    run(publisher, 1000);
+    CHECK(attemptMs.size() == before + 1 && withinJitter(attemptMs.back() - onlineMs, PUBLISHER_BACKOFF_MIN_MS));
+    CHECK(received.size() == 1 && received[0] == ":held");
+    CHECK_EQUAL(PUBLISHER_STATE_OK, publisher.getState());
+
+    // and offline with nothing queued comes back straight to ok
+    run(publisher, 1000, false);
+    publisher.loop(true, nowMs);
+    CHECK(publisher.isIdle());
+    CHECK(strcmp(publisher.getStateName(), "ok") == 0);
+}
+
+// a slow broker taking one publish in three - every payload arrives, once, in order
+static void testSlowBroker()
+{
+    reset();
+    acceptEvery = 3;
+    classPublisher publisher;
+    CHECK(publisher.begin(brokerPublish, 99));
+
+    const uint32_t count = 200;
+    uint32_t rejected = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        std::string payload = std::to_string(i);
+
+        // the caller holds on to a rejected payload and offers it again later
+        while (publish(publisher, payload.c_str()) == PUBLISHER_REJECTED)
+        {
+            rejected++;
+            run(publisher, 100);
+        }
+        run(publisher, 100);
+    }
+    run(publisher, PUBLISHER_BACKOFF_MAX_MS * 4);
+
+    CHECK_EQUAL(count, received.size());
+    for (uint32_t i = 0; i < received.size(); i++)
+    {
+        CHECK(received[i] == ":" + std::to_string(i));
+    }
+    CHECK(publisher.isIdle());
+    CHECK_EQUAL(count, publisher.getSent());
+    CHECK_EQUAL(rejected, publisher.getRejected());
+    CHECK_EQUAL(attempts - count, publisher.getFailures());
+    printf("slow broker: %u payloads, %u attempts, %u handed back\n", count, attempts, rejected);
+}
+
+int main()
+{
+    testSend();
+    testBackoff();
+    testJitter();
+    testQueue();
+    testOffline();
+    testSlowBroker();
+    return testResult("test_publisher");
+}
@@ -0,0 +1,157 @@
+// classQueue under real concurrency - one producer and one consumer thread hammering a small
+// queue, checking every item arrives once, in order and intact, or is counted as dropped.
+// Built a second time with ThreadSanitizer (test_queue_tsan) so a missing release/acquire
+// shows up as a reported race rather than a rare corrupted sample on the device.
+#include <classQueue.h>
+
+#include <atomic>
+#include <thread>
+
+#include "testing.h"
+
+#define ITEMS 200000
+
+// big enough that a torn copy is likely to be caught by the checksum
+typedef struct
+{
+    uint32_t sequence;
+    uint32_t words[6];
+    uint32_t checksum;
+} item_t;
+
+static item_t makeItem(uint32_t sequence)
+{
+    item_t item = {sequence, {}, sequence};
+    for (uint8_t i = 0; i < 6; i++)
+    {
+        item.words[i] = sequence * 2654435761u + i;
+        item.checksum ^= item.words[i];
+    }
+    return item;
+}
+
+static bool isIntact(const item_t &item)
+{
+    uint32_t checksum = item.sequence;
+    for (uint8_t i = 0; i < 6; i++)
+    {
+        checksum ^= item.words[i];
+    }
+    return checksum == item.checksum;
+}
+
+// the producer never waits, like the sensor task - whatever does not fit is dropped
+static void testLossy()
+{
+    static classQueue<item_t, 16> queue;
+    static std::atomic<bool> done{false};
+
+    std::thread producer([] {
+        for (uint32_t i = 0; i < ITEMS; i++)
+        {
+            queue.push(makeItem(i));
+            if ((i & 63) == 0)
+            {
+                std::this_thread::yield();
+            }
+        }
+        done.store(true, std::memory_order_release);
+    });
+
+    uint32_t received = 0;
+    uint32_t torn = 0;
+    uint32_t outOfOrder = 0;
+    int64_t last = -1;
+
+    item_t item{};
+    for (;;)
+    {
+        // checked before popping so nothing pushed last can be missed
+        bool finished = done.load(std::memory_order_acquire);
+        if (!queue.pop(item))
+        {
+            if (finished)
+                break;
+            continue;
+        }
+
+        received++;
+        torn += !isIntact(item);
+        outOfOrder += (int64_t)item.sequence <= last;
+        last = item.sequence;
+    }
+    producer.join();
+
+    CHECK_EQUAL(0, torn);
+    CHECK_EQUAL(0, outOfOrder);
+    CHECK_EQUAL(ITEMS, received + queue.getDropped());
+    CHECK_EQUAL(0, queue.available());
+    printf("lossy: %u received, %u dropped\n", received, queue.getDropped());
+}
+
+// a producer that retries when full loses nothing
+static void testLossless()
+{
+    static classQueue<item_t, 4> queue;
+
+    std::thread producer([] {
+        for (uint32_t i = 0; i < ITEMS; i++)
+        {
+            item_t item = makeItem(i);
+            while (!queue.push(item))
+            {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    uint32_t errors = 0;
+    item_t item{};
+    for (uint32_t expected = 0; expected < ITEMS;)
+    {
+        if (!queue.pop(item))
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        errors += item.sequence != expected || !isIntact(item);
+        expected++;
+    }
+    producer.join();
+
+    CHECK_EQUAL(0, errors);
+    CHECK_EQUAL(0, queue.available());
+}
+
+static void testWrap()
+{
+    static classQueue<uint16_t, 4> queue;
+    uint16_t value = 0;
+
+    CHECK(!queue.pop(value));
+    for (uint16_t i = 0; i < 1000; i++)
+    {
+        CHECK(queue.push(i));
+        CHECK(queue.push(i + 1));
+        CHECK(queue.push(i + 2));
+        CHECK(!queue.push(i + 3));
+        CHECK_EQUAL(3, queue.available());
+        for (uint16_t j = 0; j < 3; j++)
+        {
+            CHECK(queue.pop(value));
+            CHECK_EQUAL(i + j, value);
+        }
+        CHECK(!queue.pop(value));
+    }
+    CHECK_EQUAL(1000, queue.getDropped());
+}
+
+int main()
+{
+    testWrap();
+    testLossy();
+    testLossless();
+
+    return testResult("test_queue");
+}
@@ -0,0 +1,175 @@
+// classScheduler across the 32-bit millisecond wrap
+//
+// The clock is fast-forwarded to just short of 2^32 ms (49.7 days) and run across it, where a
+// millis() based scheduler would fire every job at once or stall for another 49 days.
+#include <Arduino.h>
+#include <classScheduler.h>
+#include <esp_timer.h>
+
+#include "testing.h"
+
+#define WRAP_MS (1ULL << 32)
+
+static uint32_t fastRuns = 0;
+static uint32_t slowRuns = 0;
+static uint32_t retryRuns = 0;
+static uint64_t lastFastMs = 0;
+static uint32_t fastGapErrors = 0;
+static bool retryFails = false;
+
+static bool fastJob()
+{
+    uint64_t now = monotonicMs();
+    if (fastRuns > 0 && now - lastFastMs != 100)
+    {
+        fastGapErrors++;
+    }
+    lastFastMs = now;
+    fastRuns++;
+    return true;
+}
+
+static bool slowJob()
+{
+    slowRuns++;
+    return true;
+}
+
+static bool retryJob()
+{
+    retryRuns++;
+    return !retryFails;
+}
+
+static void reset(uint64_t nowMs)
+{
+    stubTimeUs = nowMs * 1000;
+    fastRuns = slowRuns = retryRuns = fastGapErrors = 0;
+    retryFails = false;
+}
+
+// every job runs exactly once per period, straight through the wrap
+static void testWrap()
+{
+    reset(WRAP_MS - 5000);
+
+    classScheduler scheduler;
+    scheduler.every(100, fastJob);
+    scheduler.every(1000, slowJob);
+
+    uint32_t maxRunsPerPass = 0;
+    for (uint32_t elapsed = 0; elapsed < 10000; elapsed += 10)
+    {
+        stubAdvanceMs(10);
+        uint32_t before = fastRuns;
+        scheduler.loop();
+        maxRunsPerPass = max(maxRunsPerPass, fastRuns - before);
+    }
+
+    // millis() has wrapped round to 5s, the scheduler has not noticed
+    CHECK_EQUAL(5000, millis());
+    CHECK_EQUAL(100, fastRuns);
+    CHECK_EQUAL(10, slowRuns);
+    CHECK_EQUAL(0, fastGapErrors);
+    CHECK_EQUAL(1, maxRunsPerPass);
+    CHECK_EQUAL(0, scheduler.getSkipped());
+    CHECK_EQUAL(100, scheduler.getMsUntilNext());
+}
+
+// a deadline just short of the wrap and a clock just past it
+static void testDeadlineStraddlesWrap()
+{
+    reset(WRAP_MS - 50);
+
+    classScheduler scheduler;
+    scheduler.every(100, slowJob);
+    CHECK_EQUAL(100, scheduler.getMsUntilNext());
+
+    stubAdvanceMs(99);
+    scheduler.loop();
+    CHECK_EQUAL(0, slowRuns);
+    CHECK_EQUAL(1, scheduler.getMsUntilNext());
+
+    stubAdvanceMs(1);
+    scheduler.loop();
+    CHECK_EQUAL(1, slowRuns);
+    scheduler.loop();
+    CHECK_EQUAL(1, slowRuns);
+    CHECK_EQUAL(100, scheduler.getMsUntilNext());
+}
+
+// a stall across the wrap costs one late run and counted skips, not a burst
+static void testStallAcrossWrap()
+{
+    reset(WRAP_MS - 1000);
+
+    classScheduler scheduler;
+    scheduler.every(100, fastJob);
+
+    stubAdvanceMs(60000 + 50);
+    scheduler.loop();
+    scheduler.loop();
+    CHECK_EQUAL(1, fastRuns);
+    CHECK_EQUAL(599, scheduler.getSkipped()); // 600 deadlines passed, one of them ran
+    CHECK_EQUAL(100, scheduler.getMsUntilNext());
+
+    stubAdvanceMs(100);
+    scheduler.loop();
+    CHECK_EQUAL(2, fastRuns);
+}
+
+// a job that asks to be retried runs again on the next pass, then keeps its cadence
+static void testRetryAcrossWrap()
+{
+    reset(WRAP_MS - 100);
+
+    classScheduler scheduler;
+    scheduler.every(100, retryJob);
+
+    retryFails = true;
+    stubAdvanceMs(100);
+    scheduler.loop();
+    stubAdvanceMs(10);
+    scheduler.loop();
+    CHECK_EQUAL(2, retryRuns);
+    CHECK_EQUAL(0, scheduler.getMsUntilNext());
+
+    retryFails = false;
+    stubAdvanceMs(10);
+    scheduler.loop();
+    CHECK_EQUAL(3, retryRuns);
+    CHECK_EQUAL(80, scheduler.getMsUntilNext());
+}
+
+// zero pauses a job, and a new period counts from now
+static void testPause()
+{
+    reset(WRAP_MS - 100);
+
+    classScheduler scheduler;
+    int8_t job = scheduler.every(0, slowJob);
+    CHECK_EQUAL(UINT32_MAX, scheduler.getMsUntilNext());
+
+    stubAdvanceMs(1000);
+    scheduler.loop();
+    CHECK_EQUAL(0, slowRuns);
+
+    scheduler.setPeriod(job, 250);
+    stubAdvanceMs(249);
+    scheduler.loop();
+    CHECK_EQUAL(0, slowRuns);
+    stubAdvanceMs(1);
+    scheduler.loop();
+    CHECK_EQUAL(1, slowRuns);
+}
+
+int main()
+{
+    testWrap();
+    testDeadlineStraddlesWrap();
+    testStallAcrossWrap();
+    testRetryAcrossWrap();
+    testPause();
+
+    return testResult("test_scheduler");
+}
@@ -0,0 +1,179 @@
+// classStateStore against a stand-in NVS - saves cut off by a power loss, damaged copies,
+// blob size changes and sequence wrap, with a fresh store (a reboot) after each
+#include <classStateStore.h>
+
+#include "testing.h"
+
+#define NAMESPACE "bsecState"
+#define BLOB_SIZE 221
+
+static std::vector<uint8_t> blob(uint8_t fill)
+{
+    std::vector<uint8_t> data(BLOB_SIZE);
+    for (uint16_t i = 0; i < BLOB_SIZE; i++)
+    {
+        data[i] = fill + i;
+    }
+    return data;
+}
+
+// starts a store as at boot and returns the blob it loads (empty if none)
+static std::vector<uint8_t> boot(classStateStore &store, uint16_t length = BLOB_SIZE)
+{
+    CHECK(store.begin(NAMESPACE, length));
+
+    std::vector<uint8_t> data(length);
+    if (!store.load(data.data()))
+        return {};
+    return data;
+}
+
+static void reset()
+{
+    stubNvs.clear();
+    stubNvsPowerCut = false;
+    stubNvsBytesWritten = 0;
+}
+
+static void testSaveLoad()
+{
+    reset();
+    classStateStore first;
+    CHECK(boot(first).empty());
+    CHECK(!first.isValid());
+
+    CHECK(first.save(blob(1).data()));
+    CHECK(first.save(blob(2).data()));
+
+    classStateStore second;
+    CHECK(boot(second) == blob(2));
+    CHECK_EQUAL(2, second.getSequence());
+
+    // one key per slot, each save writing a single copy
+    CHECK_EQUAL(STATE_STORE_SLOTS, stubNvs[NAMESPACE].size());
+    CHECK_EQUAL(2 * (sizeof(stateSlotHeader_t) + BLOB_SIZE), stubNvsBytesWritten);
+
+    // saves alternate between the slots
+    uint8_t slot = second.getSlot();
+    CHECK(second.save(blob(3).data()));
+    CHECK(second.getSlot() != slot);
+    CHECK(second.save(blob(4).data()));
+    CHECK_EQUAL(slot, second.getSlot());
+
+    classStateStore third;
+    CHECK(boot(third) == blob(4));
+}
+
+// a save that never completes costs only that save
+static void testInterruptedSave()
+{
+    reset();
+    classStateStore first;
+    boot(first);
+    CHECK(first.save(blob(1).data()));
+    CHECK(first.save(blob(2).data()));
+
+    stubNvsPowerCut = true;
+    CHECK(!first.save(blob(3).data()));
+    stubNvsPowerCut = false;
+
+    classStateStore second;
+    CHECK(boot(second) == blob(2));
+    CHECK_EQUAL(2, second.getSequence());
+
+    // and the next save after the reboot carries on as normal
+    CHECK(second.save(blob(4).data()));
+
+    classStateStore third;
+    CHECK(boot(third) == blob(4));
+    CHECK_EQUAL(3, third.getSequence());
+}
+
+// a damaged copy fails its CRC and the one before it is used
+static void testDamagedCopy()
+{
+    reset();
+    classStateStore first;
+    boot(first);
+    CHECK(first.save(blob(1).data()));
+    CHECK(first.save(blob(2).data()));
+
+    char newest[8];
+    sprintf(newest, "slot%u", first.getSlot());
+    stubNvs[NAMESPACE][newest][sizeof(stateSlotHeader_t) + 100] ^= 0x10;
+
+    classStateStore second;
+    CHECK(boot(second) == blob(1));
+    CHECK_EQUAL(1, second.getSequence());
+
+    // the next save goes over the damaged copy, not the good one
+    CHECK(second.save(blob(3).data()));
+
+    classStateStore third;
+    CHECK(boot(third) == blob(3));
+
+    // a copy cut short (or left by a different build) is ignored too
+    stubNvs[NAMESPACE][newest].resize(20);
+
+    classStateStore fourth;
+    CHECK(boot(fourth) == blob(1));
+
+    // both gone means no state rather than garbage
+    for (auto &slot : stubNvs[NAMESPACE])
+    {
+        slot.second[0] ^= 0xFF;
+    }
+
+    classStateStore fifth;
+    CHECK(boot(fifth).empty());
+    CHECK(!fifth.isValid());
+}
+
+// a BSEC update that changes the blob size starts again rather than loading the wrong shape
+static void testLengthChange()
+{
+    reset();
+    classStateStore first;
+    boot(first);
+    CHECK(first.save(blob(1).data()));
+
+    classStateStore resized;
+    CHECK(boot(resized, BLOB_SIZE + 8).empty());
+
+    classStateStore original;
+    CHECK(boot(original) == blob(1));
+}
+
+// the newest copy is picked by a signed difference, so the sequence can wrap
+static void testSequenceWrap()
+{
+    reset();
+
+    // hand made slots either side of the wrap
+    for (uint8_t slot = 0; slot < 2; slot++)
+    {
+        std::vector<uint8_t> data = blob(slot + 1);
+        stateSlotHeader_t header = {STATE_STORE_MAGIC, BLOB_SIZE, slot ? 0x00000001u : 0xFFFFFFFFu, 0};
+        header.crc = crc32Ieee(data.data(), BLOB_SIZE, crc32Ieee((const uint8_t *)&header, offsetof(stateSlotHeader_t, crc)));
+
+        std::vector<uint8_t> &stored = stubNvs[NAMESPACE][slot ? "slot1" : "slot0"];
+        stored.assign((const uint8_t *)&header, (const uint8_t *)&header + sizeof(header));
+        stored.insert(stored.end(), data.begin(), data.end());
+    }
+
+    classStateStore store;
+    CHECK(boot(store) == blob(2));
+    CHECK_EQUAL(1, store.getSlot());
+    CHECK_EQUAL(1, store.getSequence());
+}
+
+int main()
+{
+    testSaveLoad();
+    testInterruptedSave();
+    testDamagedCopy();
+    testLengthChange();
+    testSequenceWrap();
+
+    return testResult("test_state_store");
+}
@@ -0,0 +1,645 @@
+// classTelemetry - exact JSON output for each kind of value, the overflow and misuse cases,
+// and what a full telemetry payload costs against snprintf and the ArduinoJson JsonDocument
+// build it replaced (the version pinned in platformio.ini). The CBOR encoding is checked
+// byte for byte where it matters and otherwise by decoding it back to the JSON.
+#include <classTelemetry.h>
+
+#include <string>
+
+#include "testing.h"
+
+#include <ArduinoJson.h>
+
+// every allocation made while building a payload - operator new here, malloc and realloc
+// through the linker's --wrap (which is how ArduinoJson's default allocator gets them)
+static uint32_t allocations = 0;
+
+extern "C" void *__real_malloc(size_t size);
+extern "C" void *__real_realloc(void *pointer, size_t size);
+
+extern "C" void *__wrap_malloc(size_t size)
+{
+    allocations++;
+    return __real_malloc(size);
+}
+
+extern "C" void *__wrap_realloc(void *pointer, size_t size)
+{
+    allocations++;
+    return __real_realloc(pointer, size);
+}
+
+void *operator new(size_t size)
+{
+    allocations++;
+    return __real_malloc(size);
+}
+
+void operator delete(void *pointer) noexcept { free(pointer); }
+void operator delete(void *pointer, size_t) noexcept { free(pointer); }
+
+static classTelemetry telemetry;
+
+static std::string payload()
+{
+    size_t length;
+    const char *data = telemetry.end(length);
+    return data ? std::string(data, length) : "(null)";
+}
+
+static void testValues()
+{
+    telemetry.clearKeys();
+    int8_t a = telemetry.addKey("a");
+    int8_t b = telemetry.addKey("pm", "2_5");
+    int8_t c = telemetry.addKey("c");
+
+    telemetry.begin();
+    CHECK(telemetry.isEmpty());
+    CHECK(payload() == "{}");
+
+    telemetry.begin();
+    telemetry.addInt(a, 0);
+    telemetry.addInt(b, -42);
+    telemetry.addInt(c, INT64_MIN);
+    CHECK(!telemetry.isEmpty());
+    CHECK(payload() == "{\"a\":0,\"pm2_5\":-42,\"c\":-9223372036854775808}");
+
+    telemetry.begin();
+    telemetry.addInt(a, 5000000000LL);
+    telemetry.addInt(b, INT64_MAX);
+    CHECK(payload() == "{\"a\":5000000000,\"pm2_5\":9223372036854775807}");
+
+    // fixed point keeps its decimals, and its sign between -1 and 0
+    telemetry.begin();
+    telemetry.addFixed(a, 215, 1);
+    telemetry.addFixed(b, -5, 1);
+    telemetry.addFixed(c, 5, 2);
+    CHECK(payload() == "{\"a\":21.5,\"pm2_5\":-0.5,\"c\":0.05}");
+
+    telemetry.begin();
+    telemetry.addFixed(a, 210, 1);
+    telemetry.addFixed(b, -123456, 3);
+    telemetry.addFixed(c, 7, 0);
+    CHECK(payload() == "{\"a\":21.0,\"pm2_5\":-123.456,\"c\":7}");
+
+    telemetry.begin();
+    telemetry.addString(a, "moderate");
+    telemetry.addNull(b);
+    CHECK(payload() == "{\"a\":\"moderate\",\"pm2_5\":null}");
+}
+
+static void testNesting()
+{
+    telemetry.clearKeys();
+    int8_t stats = telemetry.addKey("stats");
+    int8_t window = telemetry.addKey("1h");
+    int8_t mean = telemetry.addKey("mean");
+    int8_t list = telemetry.addKey("list");
+
+    telemetry.begin();
+    telemetry.beginObject(stats);
+    telemetry.beginObject(window);
+    telemetry.beginObject(mean);
+    telemetry.addFixed(window, 123, 1);
+    telemetry.endObject();
+    telemetry.endObject();
+    telemetry.endObject();
+    telemetry.beginArray(list);
+    telemetry.addInt(TELEMETRY_NO_KEY, 1);
+    telemetry.addNull(TELEMETRY_NO_KEY);
+    telemetry.beginObject(TELEMETRY_NO_KEY);
+    telemetry.endObject();
+    telemetry.endArray();
+    CHECK(payload() == "{\"stats\":{\"1h\":{\"mean\":{\"1h\":12.3}}},\"list\":[1,null,{}]}");
+
+    // one level deeper than allowed
+    telemetry.begin();
+    for (uint8_t i = 0; i <= TELEMETRY_DEPTH_MAX; i++)
+    {
+        telemetry.beginObject(stats);
+    }
+    for (uint8_t i = 0; i <= TELEMETRY_DEPTH_MAX; i++)
+    {
+        telemetry.endObject();
+    }
+    CHECK(payload() == "(null)");
+
+    // left open
+    telemetry.begin();
+    telemetry.beginArray(list);
+    CHECK(payload() == "(null)");
+}
+
+static void testLimits()
+{
+    telemetry.clearKeys();
+    int8_t key = telemetry.addKey("value");
+
+    // a key that was never added
+    telemetry.begin();
+    telemetry.addInt(key + 1, 1);
+    CHECK(payload() == "(null)");
+
+    // too much for the buffer
+    telemetry.begin();
+    for (uint16_t i = 0; i < TELEMETRY_BUFFER_SIZE / 8; i++)
+    {
+        telemetry.addInt(key, i);
+    }
+    CHECK(payload() == "(null)");
+
+    // and the next payload is fine again
+    telemetry.begin();
+    telemetry.addInt(key, 1);
+    CHECK(payload() == "{\"value\":1}");
+
+    // the key table fills up
+    telemetry.clearKeys();
+    int8_t last = 0;
+    for (uint8_t i = 0; i <= TELEMETRY_KEYS_MAX; i++)
+    {
+        last = telemetry.addKey("k");
+    }
+    CHECK_EQUAL(TELEMETRY_NO_KEY, last);
+
+    telemetry.clearKeys();
+    std::string longKey(300, 'x');
+    CHECK_EQUAL(TELEMETRY_NO_KEY, telemetry.addKey(longKey.c_str()));
+}
+
+// a full payload - every reading, the AQI and a 1h/24h stats block, as the firmware sends with everything turned on
+static const char *channelName[] = {"PM1_0", "PM2_5", "PM10", "temperature", "humidity", "co2e", "bvoc"};
+static const int32_t channelValue[] = {5, 12, 17, 215, 471, 612, 53};
+static const uint8_t channelDecimals[] = {0, 0, 0, 1, 1, 0, 1};
+static const char *windowName[] = {"1h", "24h"};
+static const char *statName[] = {"mean", "sd", "min", "max"};
+
+static int8_t keyChannel, keyAqi, keyCategory, keyPollutant, keyIaq, keyStats, keyWindow, keyStat;
+
+static void buildKeys()
+{
+    telemetry.clearKeys();
+    keyChannel = telemetry.addKey(channelName[0]);
+    for (uint8_t i = 1; i < 7; i++)
+    {
+        telemetry.addKey(channelName[i]);
+    }
+    keyAqi = telemetry.addKey("aqi");
+    keyCategory = telemetry.addKey("aqiCategory");
+    keyPollutant = telemetry.addKey("aqiPollutant");
+    keyIaq = telemetry.addKey("iaq");
+    keyStats = telemetry.addKey("stats");
+    keyWindow = telemetry.addKey(windowName[0]);
+    telemetry.addKey(windowName[1]);
+    keyStat = telemetry.addKey(statName[0]);
+    for (uint8_t i = 1; i < 4; i++)
+    {
+        telemetry.addKey(statName[i]);
+    }
+}
+
+static const char *buildPayload(size_t &length)
+{
+    telemetry.begin();
+    for (uint8_t i = 0; i < 7; i++)
+    {
+        telemetry.addFixed(keyChannel + i, channelValue[i], channelDecimals[i]);
+    }
+    telemetry.addInt(keyAqi, 57);
+    telemetry.addString(keyCategory, "moderate");
+    telemetry.addString(keyPollutant, "PM2_5");
+    telemetry.addInt(keyIaq, 48);
+
+    telemetry.beginObject(keyStats);
+    for (uint8_t w = 0; w < 2; w++)
+    {
+        telemetry.beginObject(keyWindow + w);
+        for (uint8_t s = 0; s < 4; s++)
+        {
+            telemetry.beginObject(keyStat + s);
+            for (uint8_t i = 0; i < 7; i++)
+            {
+                telemetry.addFixed(keyChannel + i, channelValue[i] + s, 1);
+            }
+            telemetry.endObject();
+        }
+        telemetry.endObject();
+    }
+    telemetry.endObject();
+
+    return telemetry.end(length);
+}
+
+// the same payload the obvious way, one snprintf per value into a fixed buffer
+static size_t buildSnprintf(char *buffer, size_t size)
+{
+    size_t used = snprintf(buffer, size, "{");
+    for (uint8_t i = 0; i < 7; i++)
+    {
+        if (channelDecimals[i])
+            used += snprintf(buffer + used, size - used, "%s\"%s\":%.1f", i ? "," : "", channelName[i], channelValue[i] / 10.0);
+        else
+            used += snprintf(buffer + used, size - used, "%s\"%s\":%d", i ? "," : "", channelName[i], channelValue[i]);
+    }
+    used += snprintf(buffer + used, size - used, ",\"aqi\":%d,\"aqiCategory\":\"%s\",\"aqiPollutant\":\"%s\",\"iaq\":%d,\"stats\":{", 57, "moderate", "PM2_5", 48);
+    for (uint8_t w = 0; w < 2; w++)
+    {
+        used += snprintf(buffer + used, size - used, "%s\"%s\":{", w ? "," : "", windowName[w]);
+        for (uint8_t s = 0; s < 4; s++)
+        {
+            used += snprintf(buffer + used, size - used, "%s\"%s\":{", s ? "," : "", statName[s]);
+            for (uint8_t i = 0; i < 7; i++)
+            {
+                used += snprintf(buffer + used, size - used, "%s\"%s\":%.1f", i ? "," : "", channelName[i], (channelValue[i] + s) / 10.0);
+            }
+            used += snprintf(buffer + used, size - used, "}");
+        }
+        used += snprintf(buffer + used, size - used, "}");
+    }
+    used += snprintf(buffer + used, size - used, "}}");
+    return used;
+}
+
+static size_t buildJsonDocument(char *buffer, size_t size)
+{
+    JsonDocument json;
+    for (uint8_t i = 0; i < 7; i++)
+    {
+        if (channelDecimals[i])
+            json[channelName[i]] = channelValue[i] / 10.0;
+        else
+            json[channelName[i]] = channelValue[i];
+    }
+    json["aqi"] = 57;
+    json["aqiCategory"] = "moderate";
+    json["aqiPollutant"] = "PM2_5";
+    json["iaq"] = 48;
+
+    JsonObject stats = json["stats"].to<JsonObject>();
+    for (uint8_t w = 0; w < 2; w++)
+    {
+        JsonObject window = stats[windowName[w]].to<JsonObject>();
+        for (uint8_t s = 0; s < 4; s++)
+        {
+            JsonObject stat = window[statName[s]].to<JsonObject>();
+            for (uint8_t i = 0; i < 7; i++)
+            {
+                stat[channelName[i]] = (channelValue[i] + s) / 10.0;
+            }
+        }
+    }
+    return serializeJson(json, buffer, size);
+}
+
+static void testPayload()
+{
+    buildKeys();
+
+    size_t length;
+    const char *data = buildPayload(length);
+    CHECK(data != NULL);
+
+    // same bytes as the snprintf version
+    char expected[TELEMETRY_BUFFER_SIZE];
+    size_t expectedLength = buildSnprintf(expected, sizeof(expected));
+    CHECK(std::string(data, length) == std::string(expected, expectedLength));
+}
+
+static void benchmark()
+{
+    buildKeys();
+
+    // make sure the counting works before trusting a zero from it
+    uint32_t probe = allocations;
+    void *pointer = malloc(16);
+    benchKeep(pointer);
+    free(pointer);
+    int *object = new int;
+    benchKeep(object);
+    delete object;
+    CHECK_EQUAL(probe + 2, allocations);
+
+    size_t length = 0;
+    uint32_t before = allocations;
+    double telemetryNs = benchNs(100000, [&](uint32_t) {
+        buildPayload(length);
+        benchKeep(length);
+    });
+    uint32_t telemetryAllocations = allocations - before;
+    printf("classTelemetry: %.0f ns/payload (%zu bytes), %.2f allocations/payload\n", telemetryNs, length, telemetryAllocations / 100000.0);
+    CHECK_EQUAL(0, telemetryAllocations);
+
+    char buffer[TELEMETRY_BUFFER_SIZE];
+    before = allocations;
+    double snprintfNs = benchNs(100000, [&](uint32_t) { benchKeep(buildSnprintf(buffer, sizeof(buffer))); });
+    printf("snprintf:       %.0f ns/payload, %.2f allocations/payload\n", snprintfNs, (allocations - before) / 100000.0);
+
+    before = allocations;
+    double jsonNs = benchNs(100000, [&](uint32_t) { benchKeep(buildJsonDocument(buffer, sizeof(buffer))); });
+    printf("JsonDocument:   %.0f ns/payload, %.2f allocations/payload\n", jsonNs, (allocations - before) / 100000.0);
+}
+
+// A minimal CBOR decoder for checking the encoder - renders what it reads as the JSON the same
+// calls would have produced, with decimal fractions (tag 4) written out as fixed point. Any
+// malformed or unexpected input makes it return false.
+class cborDecoder
+{
+public:
+    cborDecoder(const char *data, size_t length) : _data((const uint8_t *)data), _end((const uint8_t *)data + length) {}
+
+    bool decode(std::string &json)
+    {
+        return _item(json) && _data == _end;
+    }
+
+private:
+    bool _argument(uint8_t info, uint64_t &argument)
+    {
+        if (info < 24)
+        {
+            argument = info;
+            return true;
+        }
+        if (info > 27)
+            return false;
+
+        uint8_t bytes = 1 << (info - 24);
+        if (_end - _data < bytes)
+            return false;
+
+        argument = 0;
+        while (bytes--)
+        {
+            argument = (argument << 8) | *_data++;
+        }
+        return true;
+    }
+
+    bool _integer(int64_t &value)
+    {
+        if (_data >= _end)
+            return false;
+
+        uint8_t major = *_data >> 5;
+        uint64_t argument;
+        if (major > 1 || !_argument(*_data++ & 0x1F, argument))
+            return false;
+
+        value = major == 0 ? (int64_t)argument : -1 - (int64_t)argument;
+        return true;
+    }
+
+    bool _item(std::string &json)
+    {
+        if (_data >= _end)
+            return false;
+
+        uint8_t major = *_data >> 5;
+        uint8_t info = *_data & 0x1F;
+
+        if (*_data == 0xF6)
+        {
+            _data++;
+            json += "null";
+            return true;
+        }
+
+        // only maps and arrays are ever indefinite
+        if (info == 0x1F && (major == 4 || major == 5))
+        {
+            _data++;
+            json += major == 5 ? '{' : '[';
+            for (bool first = true; _data < _end && *_data != 0xFF; first = false)
+            {
+                if (!first)
+                    json += ',';
+                if (!_item(json))
+                    return false;
+                if (major == 5 && (json += ':', !_item(json)))
+                    return false;
+            }
+            if (_data >= _end)
+                return false;
+            _data++;
+            json += major == 5 ? '}' : ']';
+            return true;
+        }
+
+        if (major <= 1)
+        {
+            int64_t value;
+            if (!_integer(value))
+                return false;
+            json += std::to_string(value);
+            return true;
+        }
+
+        _data++;
+        uint64_t argument;
+        if (!_argument(info, argument))
+            return false;
+
+        if (major == 3)
+        {
+            if ((uint64_t)(_end - _data) < argument)
+                return false;
+            json += '"';
+            json.append((const char *)_data, argument);
+            json += '"';
+            _data += argument;
+            return true;
+        }
+
+        // decimal fraction [exponent, mantissa]
+        if (major == 6 && argument == 4)
+        {
+            int64_t exponent, mantissa;
+            if (_data >= _end || *_data++ != 0x82 || !_integer(exponent) || !_integer(mantissa) || exponent >= 0)
+                return false;
+
+            std::string digits = std::to_string(mantissa < 0 ? -mantissa : mantissa);
+            if (digits.size() <= (size_t)-exponent)
+            {
+                digits.insert(0, -exponent - digits.size() + 1, '0');
+            }
+            digits.insert(digits.size() + exponent, ".");
+            json += (mantissa < 0 ? "-" : "") + digits;
+            return true;
+        }
+
+        return false;
+    }
+
+    const uint8_t *_data;
+    const uint8_t *_end;
+};
+
+static std::string hex(const char *data, size_t length)
+{
+    std::string text;
+    char byte[3];
+    for (size_t i = 0; i < length; i++)
+    {
+        snprintf(byte, sizeof(byte), "%02x", (uint8_t)data[i]);
+        text += byte;
+    }
+    return text;
+}
+
+static std::string cborPayload()
+{
+    size_t length;
+    const char *data = telemetry.end(length);
+    return data ? hex(data, length) : "(null)";
+}
+
+// the shortest head for every argument size, and integers either side of each boundary
+static void testCborEncoding()
+{
+    telemetry.clearKeys();
+    telemetry.addKey("a");
+    telemetry.setFormat(TELEMETRY_FORMAT_CBOR);
+
+    const struct
+    {
+        int64_t value;
+        const char *encoded;
+    } integers[] = {
+        {0, "00"},
+        {23, "17"},
+        {24, "1818"},
+        {255, "18ff"},
+        {256, "190100"},
+        {65535, "19ffff"},
+        {65536, "1a00010000"},
+        {4294967295LL, "1affffffff"},
+        {4294967296LL, "1b0000000100000000"},
+        {-1, "20"},
+        {-24, "37"},
+        {-25, "3818"},
+        {-256, "38ff"},
+        {-257, "390100"},
+        {INT64_MIN, "3b7fffffffffffffff"},
+    };
+
+    for (auto &integer : integers)
+    {
+        telemetry.begin();
+        telemetry.beginArray(TELEMETRY_NO_KEY);
+        telemetry.addInt(TELEMETRY_NO_KEY, integer.value);
+        telemetry.endArray();
+        CHECK(cborPayload() == std::string("bf9f") + integer.encoded + "ffff");
+    }
+
+    // {"a": 21.5, "a": "ok", "a": null} - decimal fraction 215 x 10^-1
+    telemetry.begin();
+    telemetry.addFixed(0, 215, 1);
+    telemetry.addString(0, "ok");
+    telemetry.addNull(0);
+    CHECK(cborPayload() == "bf6161c4822018d76161626f6b6161f6ff");
+
+    // a key or string of 24 bytes or more needs the longer head
+    telemetry.clearKeys();
+    telemetry.addKey(std::string(23, 'k').c_str());
+    telemetry.addKey(std::string(24, 'k').c_str());
+    telemetry.begin();
+    telemetry.addInt(0, 1);
+    telemetry.addInt(1, 1);
+    CHECK(cborPayload() == "bf77" + hex(std::string(23, 'k').data(), 23) + "01" + "7818" + hex(std::string(24, 'k').data(), 24) + "01ff");
+
+    telemetry.setFormat(TELEMETRY_FORMAT_JSON);
+}
+
+// every payload decodes back to exactly what the JSON encoder writes for the same calls
+static void testCborMatchesJson()
+{
+    buildKeys();
+
+    size_t length;
+    const char *data = buildPayload(length);
+    std::string json(data, length);
+
+    telemetry.setFormat(TELEMETRY_FORMAT_CBOR);
+    const char *cbor = buildPayload(length);
+    CHECK(cbor != NULL);
+
+    std::string decoded;
+    CHECK(cborDecoder(cbor, length).decode(decoded));
+    CHECK(decoded == json);
+    CHECK(length < json.size());
+
+    // fixed point at every number of decimals, both signs
+    telemetry.clearKeys();
+    telemetry.addKey("v");
+    const int32_t values[] = {0, 5, -5, 99, -99, 100, 123456, -123456, INT32_MAX, INT32_MIN + 1};
+    for (uint8_t format = 0; format < 2; format++)
+    {
+        telemetry.setFormat(format == 0 ? TELEMETRY_FORMAT_JSON : TELEMETRY_FORMAT_CBOR);
+        telemetry.begin();
+        telemetry.beginArray(0);
+        for (int32_t value : values)
+        {
+            for (uint8_t decimals = 0; decimals <= 4; decimals++)
+            {
+                telemetry.addFixed(TELEMETRY_NO_KEY, value, decimals);
+            }
+        }
+        telemetry.endArray();
+
+        data = telemetry.end(length);
+        CHECK(data != NULL);
+        if (format == 0)
+        {
+            json.assign(data, length);
+        }
+        else
+        {
+            decoded.clear();
+            CHECK(cborDecoder(data, length).decode(decoded));
+            CHECK(decoded == json);
+        }
+    }
+
+    // too much for the buffer is caught the same way
+    telemetry.begin();
+    for (uint16_t i = 0; i < TELEMETRY_BUFFER_SIZE / 4; i++)
+    {
+        telemetry.addInt(0, 100000);
+    }
+    CHECK(cborPayload() == "(null)");
+
+    telemetry.setFormat(TELEMETRY_FORMAT_JSON);
+}
+
+static void cborBenchmark()
+{
+    buildKeys();
+
+    size_t jsonLength = 0;
+    double jsonNs = benchNs(100000, [&](uint32_t) { benchKeep(buildPayload(jsonLength)); });
+
+    telemetry.setFormat(TELEMETRY_FORMAT_CBOR);
+    size_t cborLength = 0;
+    uint32_t before = allocations;
+    double cborNs = benchNs(100000, [&](uint32_t) { benchKeep(buildPayload(cborLength)); });
+    CHECK_EQUAL(before, allocations);
+    telemetry.setFormat(TELEMETRY_FORMAT_JSON);
+
+    printf("JSON: %zu bytes, %.0f ns/payload\n", jsonLength, jsonNs);
+    printf("CBOR: %zu bytes (%.0f%%), %.0f ns/payload\n", cborLength, 100.0 * cborLength / jsonLength, cborNs);
+}
+
+int main()
+{
+    testValues();
+    testNesting();
+    testLimits();
+    testPayload();
+    testCborEncoding();
+    testCborMatchesJson();
+    benchmark();
+    cborBenchmark();
+
+    return testResult("test_telemetry");
+}
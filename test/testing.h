@@ -0,0 +1,57 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+
+#include <chrono>
+
+// Just enough to write host tests without a framework - each failed check is reported with
+// its line and counted, and testResult() turns the count into the exit code ctest looks at.
+static int testFailures = 0;
+
+#define CHECK(condition)                                                  \
+    do                                                                    \
+    {                                                                     \
+        if (!(condition))                                                 \
+        {                                                                 \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            testFailures++;                                               \
+        }                                                                 \
+    } while (0)
+
+#define CHECK_EQUAL(expected, actual)                                                                     \
+    do                                                                                                    \
+    {                                                                                                     \
+        long long _expected = (long long)(expected);                                                      \
+        long long _actual = (long long)(actual);                                                          \
+        if (_expected != _actual)                                                                         \
+        {                                                                                                 \
+            printf("%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, _actual, _expected); \
+            testFailures++;                                                                               \
+        }                                                                                                 \
+    } while (0)
+
+static inline int testResult(const char *name)
+{
+    printf("%s: %s (%d failure%s)\n", name, testFailures ? "FAILED" : "passed", testFailures, testFailures == 1 ? "" : "s");
+    return testFailures ? 1 : 0;
+}
+
+// nanoseconds per call of body, over the given number of calls
+template <typename Body>
+static double benchNs(uint32_t iterations, Body body)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        body(i);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+}
+
+// keeps the compiler from optimising a benchmark's result away
+template <typename T>
+static inline void benchKeep(const T &value)
+{
+    asm volatile("" : : "g"(&value) : "memory");
+}